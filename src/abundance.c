@@ -0,0 +1,31 @@
+#include "abundance.h"
+
+static int compare_values(const void* a, const void* b){
+    double x = ((weighted_value*) a)->value;
+    double y = ((weighted_value*) b)->value;
+    return x < y ? -1 : x > y;
+}
+
+// weighted percentile of values as Plot.R computes it: the smallest value whose cumulative weight reaches the percentile
+// values are sorted in place, NAN when there is no weight at all
+double weighted_percentile(weighted_value* values, uint32_t count, double percentile){
+    uint64_t total_weight = 0;
+    for(uint32_t i=0; i<count; ++i) total_weight += values[i].weight;
+    if(total_weight == 0) return NAN;
+    qsort(values, count, sizeof(weighted_value), compare_values);
+    uint64_t cumulative = 0;
+    for(uint32_t i=0; i<count; ++i){
+        cumulative += values[i].weight;
+        if((double) cumulative / total_weight - percentile / 100 >= 0) return values[i].value;
+    }
+    return values[count-1].value;
+}
+
+// quantile of sorted values as R computes it by default (type 7), NAN when there are none
+double quantile(const double* sorted, uint32_t count, double probability){
+    if(count == 0) return NAN;
+    double position = (count - 1) * probability;
+    uint32_t below = (uint32_t) floor(position);
+    if(below + 1 >= count) return sorted[count - 1];
+    return sorted[below] + (position - below) * (sorted[below + 1] - sorted[below]);
+}
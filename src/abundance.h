@@ -0,0 +1,17 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Strain abundances as Plot.R estimates them, shared by readcounter's early stopping and strainboot so neither drifts from Plot.R
+ * The abundance of a strain is the weighted percentile of its subcontigs' FUKMs weighted by unique k-mers (weighted.percentile
+ * in Plot.R), among the subcontigs with at least the subcontig filter's quantile of the strain's unique k-mers
+ */
+
+typedef struct weighted_value{
+    double value;
+    uint64_t weight;
+} weighted_value;
+
+double weighted_percentile(weighted_value* values, uint32_t count, double percentile);
+double quantile(const double* sorted, uint32_t count, double probability);
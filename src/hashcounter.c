@@ -1,379 +1,202 @@
 #include "hashcounter.h"
-#include "kseq.h"
 
 /*
- * Implemented hashtable has open addressing with linear probe collision policy
- * A memory efficient hashtable entry is also available, with half the memory usage (collisions are more likely with this)
- * The hashtable resizes when the load factor exceeds 0.75 after entering the k-mers of a subcontig
- * Keys are k-mers hashed using the non-cryptographic MurMurHash
- * Values are the status of the k-mer (i.e. unique or not) and also the id of the subcontig from which it originates
+ * Command line front end to libstrainr's unique k-mer counting (see strainr.h)
+ * Subcontigs from subcontig's output directories are added to a table, excluded ones first, and the unique k-mer count of
+ * each subcontig is written to KmerContent.report (and the unique k-mers themselves to UniqueKmers.index with -u, and a
+ * filter of every k-mer to ReferenceKmers.filter with -f, from another pass with the bases uppercased as BBMap reads them)
+ * With -l the table is not built at all, the counts come from merging per-genome k-mer sets kept in a library (see kmerset.h)
+ * With -p the included subcontigs are read a second time to record where their unique k-mers start (see uniquemask.h)
+ * Each pass over the subcontigs and each output is a stage of the telemetry log when STRAINR_TELEMETRY is set (see telemetry.h)
  */
 
-KSEQ_INIT(gzFile, gzread)
-
-hashtable* hashtable_create(uint32_t kmer_size, bool is_small, uint32_t num_subconts){
-    hashtable* ht = (hashtable*) malloc(sizeof(hashtable));
-    ht->subcontig_names = calloc(num_subconts,sizeof(char*));
-    ht->subcontig_counts = calloc(num_subconts,sizeof(int));
-    ht->num_subcontigs = num_subconts;
-    ht->curr_subcontig = 0;
-    ht->size = INITIAL_HT_SIZE;
-    ht->count = 0;
-    ht->entry_bitmask = INITIAL_HT_BITMASK;
-    ht->kmer_size = kmer_size;
-    ht->is_small = is_small;
-    if(is_small){
-        ht->items_small = (ht_element_small*) calloc(INITIAL_HT_SIZE, sizeof(ht_element_small));
-    }else{
-        ht->items = (ht_element*) calloc(INITIAL_HT_SIZE, sizeof(ht_element));
-    }
-    return ht;
-}
-
-void hashtable_destroy(hashtable* ht){
-    int i=1;
-    while(ht->subcontig_names[i]!=NULL){
-        free(ht->subcontig_names[i]);
-        ++i;
-    }
-    free(ht->subcontig_names);
-    free(ht->subcontig_counts);
-    if(ht->is_small){
-        free(ht->items_small);
-    }else{
-        free(ht->items);
-    }
-    free(ht);
-}
-
-static inline ht_element_status ht_small_get_status(ht_element_small* element){
-    return (element->value & 0xC0000000) >> 30;
-}
-
-static inline void ht_small_set_status(ht_element_small* element, ht_element_status status){
-    element->value &= 0x3FFFFFFF;
-    element->value |= (status << 30);
-}
-
-static inline uint32_t ht_small_get_id(ht_element_small* element){
-    return element->value & 0x3FFFFFFF;
-}
-
-static inline void ht_small_set_id(ht_element_small* element, uint32_t id){
-    element->value &= 0xC0000000;
-    element->value |= id;
-}
-
-// insert into hashtable with linear probe collision policy
-// return entry if found in ht 
-ht_element* hashtable_insert(hashtable* ht, uint64_t key, ht_element_status status, uint32_t subcontig_id){
-    uint64_t hash = key & ht->entry_bitmask;
-    ht_element* current_item = &(ht->items[hash]);
-    while(current_item->status != EMPTY){
-        if(current_item->key == key) return current_item;
-        ++current_item;
-        // reset to beginning of hashtable if end is reached
-        if((uint64_t)(current_item - ht->items) == ht->size) current_item = ht->items;
-    }
-    current_item->key = key;
-    current_item->status = status;
-    current_item->subcontig_id = subcontig_id;
-    return NULL;
-}
-
-// insert function with same behaviour, but for memory-efficient version
-ht_element_small* hashtable_insert_small(hashtable* ht, uint32_t key, ht_element_status status, uint32_t subcontig_id){
-    uint32_t hash = key & ht->entry_bitmask;
-    ht_element_small* current_item = &(ht->items_small[hash]);
-    while(ht_small_get_status(current_item) != EMPTY){
-        if(current_item->key == key) return current_item;
-        ++current_item;
-        // reset to beginning of hashtable if end is reached
-        if((uint64_t)(current_item - ht->items_small) == ht->size) current_item = ht->items_small;
-    }
-    current_item->key = key;
-    ht_small_set_status(current_item, status);
-    ht_small_set_id(current_item, subcontig_id);
-    return NULL;
-}
-
-// double ht size and re-enter all elements from left to right
-void hashtable_resize(hashtable* ht){
-    if(ht->is_small){hashtable_resize_small(ht); return;}
-    ht->size *= 2;
-    printf("Hashtable is resizing, new size will use ~ %ld GiB of memory\n", ht->size/INITIAL_HT_SIZE/2);
-    uint64_t changed_bit = ht->entry_bitmask;
-    ht->entry_bitmask = (ht->entry_bitmask << 1) | 0x1;
-    changed_bit ^= ht->entry_bitmask;
-    ht->items = realloc(ht->items, ht->size * sizeof(ht_element));
-    ht_element* current_entry =  ht->items-1;
-    while(current_entry != &ht->items[ht->size/2]){
-        ++current_entry;
-        if(current_entry->status == EMPTY) continue;
-        if(hashtable_insert(ht, current_entry->key, current_entry->status, current_entry->subcontig_id)!=NULL) continue;
-        current_entry->key = 0;
-        current_entry->status = EMPTY;
-        current_entry->subcontig_id = 0;
-    }
-}
-
-void hashtable_resize_small(hashtable* ht){
-    /*
-    add warnings and errors for big sizes
-    */
-    ht->size *= 2;
-    printf("Hashtable is resizing, new size will use ~ %.1f GiB of memory\n", (float)ht->size/INITIAL_HT_SIZE/4);
-    if(ht->size == 536870912){ // 2^29
-        printf("Warning: Due to the large input size and use of the memory-efficient mode, the output is losing some accuracy.\n");
-    }
-    if(ht->size == 1073741824){ // 2^30
-        fprintf(stderr,"Error: memory-efficient mode has lost too much accuracy to continue, please try again without it enabled.\n");
-        exit(EXIT_FAILURE);
-    }
-    uint64_t changed_bit = ht->entry_bitmask;
-    ht->entry_bitmask = (ht->entry_bitmask << 1) | 0x1;
-    changed_bit ^= ht->entry_bitmask;
-    ht->items_small = realloc(ht->items_small, ht->size * sizeof(ht_element_small));
-    ht_element_small* current_entry =  ht->items_small-1;
-    while(current_entry != &ht->items_small[ht->size/2]){
-        ++current_entry;
-        if(ht_small_get_status(current_entry) == EMPTY) continue;
-        if(hashtable_insert_small(ht, current_entry->key, ht_small_get_status(current_entry), ht_small_get_id(current_entry))!=NULL) continue;
-        current_entry->key = 0;
-        ht_small_set_status(current_entry, EMPTY);
-        ht_small_set_id(current_entry, 0);
-    }
-}
-
-// return the sum of all unique hashes
-uint64_t sum_unique_hahses(hashtable* ht){
-    uint64_t sum = 0;
-    for(uint32_t i=0; i<ht->num_subcontigs; ++i){
-        sum+=ht->subcontig_counts[i];
-    }
-    return sum;
-}
-
-// add one k-mer (to be hashed) to the hashtable
-static inline void hashtable_add_kmer(hashtable* ht, char* seq, uint32_t subcontig_id){
-    uint64_t hash = MurmurHash64A(seq, ht->kmer_size, (uint64_t)07062024);
-    ht_element* hashtable_item = hashtable_insert(ht, hash, UNIQUE, subcontig_id);
-    if(hashtable_item == NULL){
-        ++ht->subcontig_counts[subcontig_id];
-        ++ht->count;
-    } else if(hashtable_item->status == UNIQUE){
-        hashtable_item->status = NON_UNIQUE;
-        --ht->subcontig_counts[hashtable_item->subcontig_id];
-    }
-}
-
-// same functionality but for memory-efficient mode
-static inline void hashtable_small_add_kmer(hashtable* ht, char* seq, uint32_t subcontig_id){
-    uint32_t hash = MurmurHash3_x86_32(seq, ht->kmer_size, (uint32_t)07062024);
-    ht_element_small* hashtable_item = hashtable_insert_small(ht, hash, UNIQUE, subcontig_id);
-    if(hashtable_item == NULL){
-        ++ht->subcontig_counts[subcontig_id];
-        ++ht->count;
-    } else if(ht_small_get_status(hashtable_item) == UNIQUE){
-        ht_small_set_status(hashtable_item, NON_UNIQUE);
-        --ht->subcontig_counts[ht_small_get_id(hashtable_item)];
+// bytes of the files in a directory, what a pass over it reads
+static uint64_t dir_bytes(const char* dir_location){
+    uint64_t bytes = 0;
+    DIR* dr = opendir(dir_location);
+    if(dr == NULL) return 0;
+    struct dirent* de;
+    char* location = NULL;
+    while((de = readdir(dr)) != NULL){
+        location = realloc(location, strlen(dir_location) + strlen(de->d_name) + 1);
+        sprintf(location, "%s%s", dir_location, de->d_name);
+        struct stat st;
+        if(stat(location, &st) == 0 && S_ISREG(st.st_mode)) bytes += st.st_size;
     }
+    free(location);
+    closedir(dr);
+    return bytes;
 }
 
-// function for marking a k-mer as non-unique
-static inline void hashtable_mark_kmer(hashtable* ht, char* seq, uint32_t subcont_id){
-    uint64_t hash = MurmurHash64A(seq, ht->kmer_size, (uint64_t)07062024);
-    if(hashtable_insert(ht, hash, NON_UNIQUE, subcont_id)==NULL) ++ht->count;
-}
-
-static inline void hashtable_small_mark_kmer(hashtable* ht, char* seq, uint32_t subcont_id){
-    uint32_t hash = MurmurHash3_x86_32(seq, ht->kmer_size, (uint32_t)07062024);
-    if(hashtable_insert_small(ht, hash, NON_UNIQUE, subcont_id)==NULL) ++ht->count;
+// run one pass over a directory of subcontigs as a telemetry stage counting the k-mers it hashed
+static int add_dir_stage(strainr_table* table, const char* dir_location, bool excluded, const char* stage_name){
+    telemetry_stage stage;
+    strainr_table_stats before, after;
+    uint64_t bytes_in = telemetry_enabled() ? dir_bytes(dir_location) : 0;
+    strainr_table_get_stats(table, &before);
+    telemetry_begin(&stage, "hashcounter", stage_name, "kmers");
+    if(strainr_table_add_dir(table, dir_location, excluded) != STRAINR_OK) return STRAINR_ERROR;
+    strainr_table_get_stats(table, &after);
+    stage.bytes_in = bytes_in;
+    stage.items = after.kmers - before.kmers;
+    telemetry_end(&stage);
+    return STRAINR_OK;
 }
 
-/* following function adapted from Austin Appleby */
-uint64_t MurmurHash64A (const void* key, int len, uint64_t seed){
-    const uint64_t m = 0xc6a4a7935bd1e995;
-    const int r = 47;
-    uint64_t h = seed ^ (len * m);
-    const uint64_t* data = (const uint64_t*) key;
-    const uint64_t* end = data + (len/8);
-
-    while(data != end){
-        uint64_t k = *data++;
-
-        k *= m; 
-        k ^= k >> r; 
-        k *= m; 
-
-        h ^= k;
-        h *= m; 
-    }
-    const unsigned char * data2 = (const unsigned char*)data;
-    switch(len & 7){
-        case 7: h ^= (uint64_t)(data2[6]) << 48; break;
-        case 6: h ^= (uint64_t)(data2[5]) << 40; break;
-        case 5: h ^= (uint64_t)(data2[4]) << 32; break;
-        case 4: h ^= (uint64_t)(data2[3]) << 24; break;
-        case 3: h ^= (uint64_t)(data2[2]) << 16; break;
-        case 2: h ^= (uint64_t)(data2[1]) << 8; break;
-        case 1: h ^= (uint64_t)(data2[0]); break;
-            h *= m;
-    };
-    h ^= h >> r;
-    h *= m;
-    h ^= h >> r;
-
-    return h;
+// strainr_table_subcontig_name as called by unique_mask_writer_write
+static const char* mask_subcontig_name(void* table, uint32_t subcontig_id){
+    return strainr_table_subcontig_name((strainr_table*) table, subcontig_id);
 }
 
-/* following function adapted from Austin Appleby */
-uint32_t MurmurHash3_x86_32(const void* key, int len, uint32_t seed){
-    const uint8_t* data = (const uint8_t*)key;
-    const int nblocks = len / 4;
-    uint32_t h1 = seed;
-    const uint32_t c1 = 0xcc9e2d51;
-    const uint32_t c2 = 0x1b873593;
-
-    const uint32_t* blocks = (const uint32_t*)(data + nblocks*4);
-    for(int i = -nblocks; i; ++i){
-        uint32_t k1 = blocks[i];
-
-        k1 *= c1;
-        k1 = (k1 << 15) | (k1 >> 17);
-        k1 *= c2;
-
-        h1 ^= k1;
-        h1 = (h1 << 13) | (h1 >> 19); 
-        h1 = h1*5+0xe6546b64;
+// second pass over the included subcontigs, marking the start of every k-mer unique to the subcontig it is in
+// first_id is the id the table gave the first included subcontig, the reader hands them out in the same order
+static int write_mask_stage(strainr_table* table, char* dir_location, uint32_t first_id, strainr_options* options,
+                            char* mask_location, char* bed_location){
+    telemetry_stage stage;
+    telemetry_begin(&stage, "hashcounter", "mask_write", "kmers");
+    read_ahead_options read_ahead = {options->reader_threads, options->read_ahead_depth, options->read_ahead_bytes};
+    subcontig_reader* reader = subcontig_reader_open(dir_location, &read_ahead);
+    unique_mask_writer* writer = unique_mask_writer_create(options->kmer_size);
+    uint64_t* hashes = NULL;
+    uint32_t* positions = NULL;
+    uint8_t* unique = NULL;
+    uint32_t capacity = 0;
+    uint32_t subcontig_id = first_id;
+    subcontig_slot* slot;
+    while((slot = subcontig_reader_next(reader)) != NULL){
+        const char* name = strainr_table_subcontig_name(table, subcontig_id);
+        if(name == NULL || strcmp(name, slot->name) != 0){
+            fprintf(stderr, "Error: %s changed while its subcontigs were being hashed\n", dir_location);
+            return STRAINR_ERROR;
+        }
+        uint32_t seq_len = strlen(slot->seq);
+        if(seq_len > capacity){
+            capacity = seq_len;
+            hashes = realloc(hashes, capacity * sizeof(uint64_t));
+            positions = realloc(positions, capacity * sizeof(uint32_t));
+            unique = realloc(unique, capacity * sizeof(uint8_t));
+        }
+        uint32_t num_positions = seq_len < options->kmer_size ? 0 : seq_len - options->kmer_size + 1;
+        memset(unique, 0, num_positions);
+        uint32_t num_hashes = hash_canonical_kmers_at(slot->seq, seq_len, options->kmer_size, hashes, positions);
+        for(uint32_t i=0; i<num_hashes; ++i){
+            uint32_t owner;
+            if(strainr_table_query_hash(table, hashes[i], &owner) == STRAINR_UNIQUE && owner == subcontig_id) unique[positions[i]] = 1;
+        }
+        unique_mask_writer_add(writer, subcontig_id, unique, num_positions);
+        stage.items += num_hashes;
+        ++subcontig_id;
     }
-
-    const uint8_t* tail = (const uint8_t*)(data + nblocks*4);
-    uint32_t k1 = 0;
-    switch(len & 3){
-    case 3: k1 ^= tail[2] << 16; break;
-    case 2: k1 ^= tail[1] << 8; break;
-    case 1: k1 ^= tail[0]; break;
-            k1 *= c1; k1 = (k1 << 15) | (k1 >> 17); k1 *= c2; h1 ^= k1;
-    };
-
-    h1 ^= len;
-    h1 ^= h1 >> 16;
-    h1 *= 0x85ebca6b;
-    h1 ^= h1 >> 13;
-    h1 *= 0xc2b2ae35;
-    h1 ^= h1 >> 16;
-    return h1;
-} 
-
-// following lookup basemap for use in reverse complementing
-static const unsigned char basemap[256] = {
-      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
-     16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
-     32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
-     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
-     64, 'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D', 'I', 'J', 'M', 'L', 'K', 'N', 'O',
-    'P', 'Q', 'Y', 'S', 'A', 'A', 'B', 'W', 'X', 'R', 'Z',  91,  92,  93,  94,  95,
-     96, 'T', 'v', 'G', 'h', 'e', 'f', 'C', 'd', 'i', 'j', 'm', 'l', 'k', 'N', 'o',
-    'p', 'q', 'y', 's', 'A', 'A', 'b', 'w', 'x', 'r', 'z', 123, 124, 125, 126, 127,
-    128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
-    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
-    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
-    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
-    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
-    208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
-    224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
-    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
-};
-static inline char* reverse_complement(char* seq){
-    char* rc = calloc(strlen(seq)+1, sizeof(char));
-    uint32_t j = 0;
-    for (int i = strlen(seq) - 1; i >= 0; --i) {
-        rc[j] = basemap[(int)seq[i]];
-        ++j;
+    stage.bytes_in = reader->bytes_read;
+    subcontig_reader_close(reader);
+    free(hashes);
+    free(positions);
+    free(unique);
+
+    if(!unique_mask_writer_write(writer, mask_location, mask_subcontig_name, table,
+                                 strainr_table_num_subcontigs(table))){
+        fprintf(stderr, "Error: failed to open %s for writing\n", mask_location);
+        return STRAINR_ERROR;
     }
-    return rc;
-}
-
-// check if sequence k-mer has an N in it
-static inline int check_n(char* seq, uint32_t kmer_size){
-    for(uint32_t i=0; i < kmer_size; ++i){
-        if(seq[i] == 'N') return i+1;
+    unique_mask_writer_destroy(writer);
+    stage.bytes_out = telemetry_file_size(mask_location);
+    if(bed_location != NULL){
+        unique_mask* mask = unique_mask_load(mask_location);
+        if(!unique_mask_write_bed(mask, bed_location)){
+            fprintf(stderr, "Error: failed to open %s for writing\n", bed_location);
+            return STRAINR_ERROR;
+        }
+        unique_mask_destroy(mask);
+        stage.bytes_out += telemetry_file_size(bed_location);
     }
-    return 0;
+    telemetry_end(&stage);
+    return STRAINR_OK;
 }
 
-// add k-mers to the hashtable for an entire subcontig
-void hash_and_insert_subcontig(hashtable* ht, char* seq, uint32_t subcontig_id, void (*kmer_func)(hashtable*, char*, uint32_t)){
-    uint32_t i = 0;
-    char* rc = reverse_complement(seq);
-    uint32_t n;
-    uint32_t seq_len = strlen(seq);
-    while((n=check_n(&seq[i], ht->kmer_size))){
-        i+=n;
-    }
-    while(ht->kmer_size + i <= seq_len){
-        if(seq[i+ht->kmer_size-1]=='N'){
-            i+=ht->kmer_size;
-            if(i+ht->kmer_size > seq_len) break;
-            while((n=check_n(&seq[i], ht->kmer_size))) i+=n;
-            continue;
-        }
-    
-        if(strncmp(&seq[i], &rc[seq_len-ht->kmer_size-i], ht->kmer_size) < 0){
-            kmer_func(ht, &seq[i], subcontig_id);
-        }else{
-            kmer_func(ht, &rc[seq_len-ht->kmer_size-i], subcontig_id);
+// pass over the excluded and included subcontigs adding every k-mer, uppercased, to ReferenceKmers.filter
+// the table hashes bases as they are, but BBMap maps to soft-masked sequence too, so the filter must hold those k-mers uppercased
+static int write_filter_stage(char* exc_dir_location, char* dir_location, uint64_t num_kmers, strainr_options* options,
+                              char* filter_location){
+    telemetry_stage stage;
+    telemetry_begin(&stage, "hashcounter", "filter_write", "kmers");
+    read_ahead_options read_ahead = {options->reader_threads, options->read_ahead_depth, options->read_ahead_bytes};
+    kmer_filter* filter = kmer_filter_create(options->kmer_size, num_kmers);
+    uint64_t* hashes = NULL;
+    uint32_t capacity = 0;
+    char* dir_locations[2] = {exc_dir_location, dir_location};
+    for(uint32_t d=0; d<2; ++d){
+        subcontig_reader* reader = subcontig_reader_open(dir_locations[d], &read_ahead);
+        subcontig_slot* slot;
+        while((slot = subcontig_reader_next(reader)) != NULL){
+            uint32_t seq_len = strlen(slot->seq);
+            if(seq_len > capacity){
+                capacity = seq_len;
+                hashes = realloc(hashes, capacity * sizeof(uint64_t));
+            }
+            uppercase_bases(slot->seq, seq_len);
+            uint32_t num_hashes = hash_canonical_kmers(slot->seq, seq_len, options->kmer_size, hashes);
+            for(uint32_t i=0; i<num_hashes; ++i) kmer_filter_add(filter, hashes[i]);
+            stage.items += num_hashes;
         }
-        
-        ++i;
+        stage.bytes_in += reader->bytes_read;
+        subcontig_reader_close(reader);
+    }
+    free(hashes);
+    bool written = kmer_filter_write(filter, filter_location);
+    kmer_filter_destroy(filter);
+    if(!written){
+        fprintf(stderr, "Error: failed to open %s for writing\n", filter_location);
+        return STRAINR_ERROR;
     }
-    free(rc);
-    // resize hashtable if load factor is >0.75 after subcontig addition
-    if((float) ht->count / ht->size > 0.75) hashtable_resize(ht);
+    stage.bytes_out = telemetry_file_size(filter_location);
+    telemetry_end(&stage);
+    return STRAINR_OK;
 }
 
-// add k-mers to the hashtable for all subcontigs in a directory
-void hash_and_insert(hashtable* ht, char* dir_location, void (*kmer_func)(hashtable*, char*, uint32_t)){
-    kseq_t* seq;
-    struct dirent *de;
-    DIR *dr = opendir(dir_location);
-    if(dr == NULL) {
-        fprintf(stderr, "Could not open subcontigs directory\n\n");
-        exit(EXIT_FAILURE);
+// KmerContent.report from the k-mer sets of the library, building the sets of genomes the library does not have yet
+static int library_report(char* library_location, char* exc_dir_location, char* dir_location, strainr_options* options,
+                          char* report_location){
+    mkdir(library_location, 0777);
+    telemetry_stage stage;
+    kmer_library_stats stats;
+    uint32_t num_sets;
+    printf("Finding the k-mer set of each genome in %s\n", library_location);
+    telemetry_begin(&stage, "hashcounter", "library_sets", "kmers");
+    kmer_set** sets = kmer_library_sets(library_location, exc_dir_location, dir_location, options->kmer_size, options->num_threads,
+                                        &num_sets, &stats);
+    stage.bytes_in = stats.bytes_read;
+    stage.items = stats.kmers_hashed;
+    telemetry_end(&stage);
+    printf("%d k-mer sets were reused and %d were built from %ld k-mers\n", stats.sets_reused, stats.sets_built, stats.kmers_hashed);
+
+    printf("Merging k-mer sets\n");
+    telemetry_begin(&stage, "hashcounter", "library_merge", "kmers");
+    subcontig_registry* registry = subcontig_registry_create(0);
+    for(uint32_t i=0; i<num_sets; ++i){
+        for(uint32_t j=0; j<sets[i]->num_subcontigs; ++j) subcontig_registry_add(registry, sets[i]->subcontig_names[j]);
     }
-    char* subcont_location;
-    char* subcont_name;
-    while (((de = readdir(dr)) != NULL)) {
-        if(!(strlen(de->d_name) >= 10 && strcmp(&de->d_name[strlen(de->d_name) - 10], ".subcontig") == 0)) continue;
-        uint32_t loc_size = strlen(dir_location)+strlen(de->d_name)+1;
-        subcont_location = calloc(loc_size, sizeof(char));
-        strcpy(subcont_location, dir_location);
-        subcont_location = strcat(subcont_location, de->d_name);
-        gzFile fp = gzopen(subcont_location,"r");
-        if(fp == NULL){
-            fprintf(stderr, "Error opening %s\n", de->d_name);
-            exit(EXIT_FAILURE);
-        }
-        seq = kseq_init(fp);
-        kseq_read(seq);
-        if(seq->comment.s != NULL){
-            subcont_name = calloc(strlen(seq->name.s)+strlen(seq->comment.s)+2, sizeof(char));
-            memcpy(subcont_name, seq->name.s, strlen(seq->name.s));
-            subcont_name[strlen(seq->name.s)] = ' ';
-            strcat(subcont_name, seq->comment.s);
-        } else {
-            subcont_name = calloc(strlen(seq->name.s)+1, sizeof(char));
-            memcpy(subcont_name, seq->name.s, strlen(seq->name.s));
-        }
-        ht->subcontig_names[ht->curr_subcontig] = subcont_name;
-        hash_and_insert_subcontig(ht, seq->seq.s, ht->curr_subcontig, kmer_func);
-        ++ht->curr_subcontig;
-        free(subcont_location);
-        gzclose(fp);
-        kseq_destroy(seq);
+    uint32_t* counts = calloc(registry->count + 1, sizeof(uint32_t));
+    uint64_t distinct = kmer_set_merge(sets, num_sets, options->num_threads, counts);
+    uint64_t unique = 0;
+    for(uint32_t i=0; i<registry->count; ++i) unique += counts[i];
+    stage.items = distinct;
+    telemetry_end(&stage);
+    printf("A total of %ld different k-mers were found\n%ld k-mers were unique\n", distinct, unique);
+
+    telemetry_begin(&stage, "hashcounter", "report_write", "subcontigs");
+    bool written = subcontig_registry_write_report(registry, counts, report_location);
+    stage.items = registry->count;
+    stage.bytes_out = telemetry_file_size(report_location);
+    telemetry_end(&stage);
+    for(uint32_t i=0; i<num_sets; ++i) kmer_set_close(sets[i]);
+    free(sets);
+    free(counts);
+    subcontig_registry_destroy(registry);
+    if(!written){
+        fprintf(stderr, "Error: failed to open the specified output directory, exiting\n");
+        return STRAINR_ERROR;
     }
-    closedir(dr);
+    return STRAINR_OK;
 }
 
 int main(int argc, char **argv){
@@ -381,12 +204,20 @@ int main(int argc, char **argv){
     char* subcontigs = NULL;
     char* exc_subcontigs = NULL;
     char* outdir = NULL;
-    uint32_t kmer_size = 0;
-    bool is_mem_efficient = false;
-    uint32_t num_subcontigs = 0;
+    char* index_location = NULL;
+    char* mask_location = NULL;
+    char* bed_location = NULL;
+    char* filter_location = NULL;
+    char* library_location = NULL;
+    bool write_index = false;
+    bool write_filter = false;
+    bool write_mask = false;
+    bool write_bed = false;
+    strainr_options options;
+    strainr_options_init(&options, 0);
 
     // parse options
-    while ((opt = getopt(argc, argv, "s:e:k:n:o:h")) != -1) {
+    while ((opt = getopt(argc, argv, "s:e:k:o:a:t:r:i:d:b:ufpPl:n:h")) != -1) {
         switch (opt) {
             case 's': {
                 subcontigs = calloc(strlen(optarg) + 2, sizeof(char));
@@ -399,18 +230,74 @@ int main(int argc, char **argv){
                 exc_subcontigs[strlen(optarg)] = '/';
             } break;
             case 'k': {
-                kmer_size = atoi(optarg);
-            } break;
-            case 'n': {
-                num_subcontigs = atoi(optarg);
+                options.kmer_size = atoi(optarg);
             } break;
             case 'o': {
                 outdir = calloc(strlen(optarg) + strlen("/KmerContent.report") + 1, sizeof(char));
                 strcpy(outdir, optarg);
                 strcat(outdir, "/KmerContent.report");
+                index_location = calloc(strlen(optarg) + strlen("/UniqueKmers.index") + 1, sizeof(char));
+                strcpy(index_location, optarg);
+                strcat(index_location, "/UniqueKmers.index");
+                filter_location = calloc(strlen(optarg) + strlen("/ReferenceKmers.filter") + 1, sizeof(char));
+                strcpy(filter_location, optarg);
+                strcat(filter_location, "/ReferenceKmers.filter");
+                mask_location = calloc(strlen(optarg) + strlen("/UniqueRegions.mask") + 1, sizeof(char));
+                strcpy(mask_location, optarg);
+                strcat(mask_location, "/UniqueRegions.mask");
+                bed_location = calloc(strlen(optarg) + strlen("/UniqueRegions.bed") + 1, sizeof(char));
+                strcpy(bed_location, optarg);
+                strcat(bed_location, "/UniqueRegions.bed");
+            } break;
+            case 'a': {
+                if(strcmp(optarg, "sort") == 0){
+                    options.engine = STRAINR_SORT;
+                }else if(strcmp(optarg, "hashtable") != 0){
+                    fprintf(stderr, "Error: counting engine must be hashtable or sort\n");
+                    return EXIT_FAILURE;
+                }
+            } break;
+            case 't': {
+                options.num_threads = atoi(optarg);
+            } break;
+            case 'r': {
+                if(strcmp(optarg, "incremental") == 0){
+                    options.incremental_resize = true;
+                }else if(strcmp(optarg, "parallel") != 0){
+                    fprintf(stderr, "Error: resize mode must be parallel or incremental\n");
+                    return EXIT_FAILURE;
+                }
+            } break;
+            case 'i': {
+                options.reader_threads = atoi(optarg);
+            } break;
+            case 'd': {
+                options.read_ahead_depth = atoi(optarg);
+            } break;
+            case 'b': {
+                options.read_ahead_bytes = (size_t) atoi(optarg) << 20;
+            } break;
+            case 'u': {
+                write_index = true;
+            } break;
+            case 'f': {
+                write_filter = true;
+            } break;
+            case 'p': {
+                write_mask = true;
+            } break;
+            case 'P': {
+                write_mask = true;
+                write_bed = true;
+            } break;
+            case 'l': {
+                library_location = optarg;
+            } break;
+            case 'n': {
+                // the subcontig registry grows as subcontigs are read, -n is still accepted so existing callers keep working
             } break;
             /*case 'm': {
-                is_mem_efficient = true;
+                options.memory_efficient = true;
             } break;*/
             case 'h': {
                 printf(USAGE);
@@ -424,59 +311,120 @@ int main(int argc, char **argv){
     }
 
     // check validity of inputs
-    if(subcontigs == NULL || exc_subcontigs == NULL || outdir == NULL || kmer_size == 0 || num_subcontigs == 0) {
+    if(subcontigs == NULL || exc_subcontigs == NULL || outdir == NULL || options.kmer_size == 0 ||
+       options.num_threads == 0 || options.reader_threads == 0 || options.read_ahead_depth == 0) {
         printf(USAGE);
         return EXIT_FAILURE;
     }
 
-    if(is_mem_efficient){
+    if(options.kmer_size < STRAINR_MIN_KMER_SIZE){
+        fprintf(stderr, "Error: the k-mer size must be at least %d, shorter k-mers are hashed by their last base alone\n",
+                STRAINR_MIN_KMER_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    if(options.memory_efficient && (write_index || write_filter)){
+        fprintf(stderr, "Error: the unique k-mer table and reference k-mer filter can not be written in memory-efficient mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if(options.memory_efficient && write_mask){
+        fprintf(stderr, "Error: unique regions can not be found in memory-efficient mode\n");
+        return EXIT_FAILURE;
+    }
+
+    if(library_location != NULL && (write_index || write_filter || write_mask)){
+        fprintf(stderr, "Error: the unique k-mer table, reference k-mer filter, and unique regions are not written when counting with a library\n");
+        return EXIT_FAILURE;
+    }
+
+    if(library_location != NULL){
+        int status = library_report(library_location, exc_subcontigs, subcontigs, &options, outdir);
+        if(status == STRAINR_OK){
+            printf("K-mers hashed and counted, the results can be found in the output directory under KmerContent.report\n");
+        }
+        free(outdir);
+        free(index_location);
+        free(filter_location);
+        free(mask_location);
+        free(bed_location);
+        free(subcontigs);
+        free(exc_subcontigs);
+        return status == STRAINR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if(options.memory_efficient){
         printf("Memory-efficient mode has been enabled. Note that this comes with reduced accuracy when there are larger input sizes.\n");
     }
 
-    printf("Hashing and counting k-mers\n");
-    hashtable* ht = hashtable_create(kmer_size, is_mem_efficient, num_subcontigs+1);
+    printf(options.engine == STRAINR_SORT ? "Hashing k-mers into records to be sorted\n" : "Hashing and counting k-mers\n");
+    strainr_table* table = strainr_table_create(&options);
 
     // main pipeline
-    if(is_mem_efficient){
-        printf("Hashing excluded subcontigs and marking them as non-unique\n");
-        hash_and_insert(ht, exc_subcontigs, hashtable_small_mark_kmer);
-        printf("Hashing subcontigs and finding unique k-mers\n");
-        hash_and_insert(ht, subcontigs, hashtable_small_add_kmer);
-    }else{
-        printf("Hashing excluded subcontigs and marking them as non-unique\n");
-        hash_and_insert(ht, exc_subcontigs, hashtable_mark_kmer);
-        printf("Hashing subcontigs and finding unique k-mers\n");
-        hash_and_insert(ht, subcontigs, hashtable_add_kmer);
+    printf("Hashing excluded subcontigs and marking them as non-unique\n");
+    if(add_dir_stage(table, exc_subcontigs, true, "excluded_pass") != STRAINR_OK){
+        fprintf(stderr, "Could not open subcontigs directory\n\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t first_id = strainr_table_num_subcontigs(table);
+    printf("Hashing subcontigs and finding unique k-mers\n");
+    if(add_dir_stage(table, subcontigs, false, "included_pass") != STRAINR_OK){
+        fprintf(stderr, "Could not open subcontigs directory\n\n");
+        return EXIT_FAILURE;
     }
 
-    printf("A total of %ld different k-mers were found\n%ld k-mers were unique\n",ht->count, sum_unique_hahses(ht));
+    telemetry_stage stage;
+    telemetry_begin(&stage, "hashcounter", "finish", "kmers");
+    strainr_table_finish(table);
+    stage.items = strainr_table_distinct_kmers(table);
+    telemetry_end(&stage);
+    printf("A total of %ld different k-mers were found\n%ld k-mers were unique\n", strainr_table_distinct_kmers(table),
+           strainr_table_unique_kmers(table));
+
+    if(write_index){
+        printf("Writing unique k-mer table\n");
+        telemetry_begin(&stage, "hashcounter", "index_write", "kmers");
+        if(strainr_table_write_index(table, index_location) != STRAINR_OK){
+            fprintf(stderr, "Error: failed to open %s for writing\n", index_location);
+            return EXIT_FAILURE;
+        }
+        stage.items = strainr_table_unique_kmers(table);
+        stage.bytes_out = telemetry_file_size(index_location);
+        telemetry_end(&stage);
+    }
 
-    // write tsv of unique hashes file
-    FILE *kmercontent;
-    char* subcontig_info;
-    kmercontent = fopen(outdir, "w+");
-    if(kmercontent == NULL){
-        fprintf(stderr, "Error: failed to open the specified output directory, exiting\n");
-        return EXIT_FAILURE;
+    if(write_filter){
+        printf("Writing reference k-mer filter\n");
+        // uppercasing only merges k-mers, so the table's distinct k-mers are enough room for the filter
+        if(write_filter_stage(exc_subcontigs, subcontigs, strainr_table_distinct_kmers(table), &options, filter_location) != STRAINR_OK){
+            return EXIT_FAILURE;
+        }
     }
-    fprintf(kmercontent,"SubcontigID\tStrainID\tContigID\tStart_Stop\tLength\tNunique\n");
-    uint32_t i=0;
-    while(ht->subcontig_names[i]!=NULL){
-        fprintf(kmercontent,"%s\t", ht->subcontig_names[i]);
-        subcontig_info = strtok(ht->subcontig_names[i], ";");
-        for(int j=0; j<4; ++j){
-            fprintf(kmercontent,"%s\t", subcontig_info);
-            subcontig_info = strtok(NULL, ";");
+
+    if(write_mask){
+        printf("Finding the unique regions of each subcontig\n");
+        if(write_mask_stage(table, subcontigs, first_id, &options, mask_location, write_bed ? bed_location : NULL) != STRAINR_OK){
+            return EXIT_FAILURE;
         }
-        fprintf(kmercontent,"%d\n", ht->subcontig_counts[i]);
-        ++i;
     }
 
+    telemetry_begin(&stage, "hashcounter", "report_write", "subcontigs");
+    if(strainr_table_write_report(table, outdir) != STRAINR_OK){
+        fprintf(stderr, "Error: failed to open the specified output directory, exiting\n");
+        return EXIT_FAILURE;
+    }
+    stage.items = strainr_table_num_subcontigs(table);
+    stage.bytes_out = telemetry_file_size(outdir);
+    telemetry_end(&stage);
+
     printf("K-mers hashed and counted, the results can be found in the output directory under KmerContent.report\n");
 
-    fclose(kmercontent);
     free(outdir);
+    free(index_location);
+    free(filter_location);
+    free(mask_location);
+    free(bed_location);
     free(subcontigs);
     free(exc_subcontigs);
-    hashtable_destroy(ht);
-}
\ No newline at end of file
+    strainr_table_destroy(table);
+}
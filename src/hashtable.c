@@ -0,0 +1,485 @@
+#include "hashtable.h"
+
+/*
+ * Implemented hashtable has open addressing with linear probe collision policy
+ * A memory efficient hashtable entry is also available, with half the memory usage (collisions are more likely with this)
+ * The hashtable resizes when the load factor exceeds 0.75 after entering the k-mers of a subcontig
+ * A resize moves every entry into a new table of twice the size, either with several threads at once or one chunk after
+ * each subcontig (see hashtable_resize)
+ * Keys are k-mers hashed using the non-cryptographic MurMurHash
+ * Values are the status of the k-mer (i.e. unique or not) and also the id of the subcontig from which it originates
+ * kmersort.c counts the same unique k-mers by sorting instead of with a hashtable
+ */
+
+hashtable* hashtable_create(uint32_t kmer_size, bool is_small, uint32_t num_subconts, uint32_t num_threads, bool incremental_resize){
+    hashtable* ht = (hashtable*) malloc(sizeof(hashtable));
+    ht->registry = subcontig_registry_create(num_subconts);
+    ht->subcontig_counts = calloc(num_subconts,sizeof(int));
+    ht->subcontigs_capacity = num_subconts;
+    ht->curr_subcontig = 0;
+    ht->bases_added = 0;
+    ht->kmers_added = 0;
+    ht->size = INITIAL_HT_SIZE;
+    ht->count = 0;
+    ht->entry_bitmask = INITIAL_HT_BITMASK;
+    ht->kmer_size = kmer_size;
+    ht->is_small = is_small;
+    ht->num_threads = num_threads;
+    ht->incremental_resize = incremental_resize;
+    ht->old_items = NULL;
+    ht->chunks = NULL;
+    if(is_small){
+        ht->items_small = (ht_element_small*) table_alloc(INITIAL_HT_SIZE * sizeof(ht_element_small), num_threads, &ht->placement);
+    }else{
+        ht->items = (ht_element*) table_alloc(INITIAL_HT_SIZE * sizeof(ht_element), num_threads, &ht->placement);
+    }
+    hashtable_print_placement(ht);
+    return ht;
+}
+
+void hashtable_destroy(hashtable* ht){
+    subcontig_registry_destroy(ht->registry);
+    free(ht->subcontig_counts);
+    hashtable_finish_resize(ht);
+    if(ht->is_small){
+        table_free(ht->items_small, ht->size * sizeof(ht_element_small));
+    }else{
+        table_free(ht->items, ht->size * sizeof(ht_element));
+    }
+    free(ht);
+}
+
+static inline ht_element_status ht_small_get_status(ht_element_small* element){
+    return (element->value & 0xC0000000) >> 30;
+}
+
+static inline void ht_small_set_status(ht_element_small* element, ht_element_status status){
+    element->value &= 0x3FFFFFFF;
+    element->value |= (status << 30);
+}
+
+static inline uint32_t ht_small_get_id(ht_element_small* element){
+    return element->value & 0x3FFFFFFF;
+}
+
+static inline void ht_small_set_id(ht_element_small* element, uint32_t id){
+    element->value &= 0xC0000000;
+    element->value |= id;
+}
+
+// insert into a table with linear probe collision policy
+// return entry if found in the table
+static inline ht_element* table_insert(ht_element* items, uint64_t size, uint64_t entry_bitmask, uint64_t key, ht_element_status status,
+                                       uint32_t subcontig_id){
+    ht_element* current_item = &(items[key & entry_bitmask]);
+    while(current_item->status != EMPTY){
+        if(current_item->key == key) return current_item;
+        ++current_item;
+        // reset to beginning of hashtable if end is reached
+        if((uint64_t)(current_item - items) == size) current_item = items;
+    }
+    current_item->key = key;
+    current_item->status = status;
+    current_item->subcontig_id = subcontig_id;
+    return NULL;
+}
+
+static inline ht_element* table_find(ht_element* items, uint64_t size, uint64_t entry_bitmask, uint64_t key){
+    ht_element* current_item = &(items[key & entry_bitmask]);
+    while(current_item->status != EMPTY){
+        if(current_item->key == key) return current_item;
+        ++current_item;
+        if((uint64_t)(current_item - items) == size) current_item = items;
+    }
+    return NULL;
+}
+
+// return the chunk of the old table holding the entries whose home is the old entry home
+static inline uint32_t resize_chunk_of(hashtable* ht, uint64_t home){
+    if(home < ht->chunks[0].start) return ht->wrap_chunk;
+    uint32_t chunk_id = home / RESIZE_CHUNK_SIZE < ht->num_chunks ? home / RESIZE_CHUNK_SIZE : ht->num_chunks - 1;
+    while(home < ht->chunks[chunk_id].start) --chunk_id;
+    return chunk_id;
+}
+
+// insert into hashtable with linear probe collision policy
+// return entry if found in ht 
+ht_element* hashtable_insert(hashtable* ht, uint64_t key, ht_element_status status, uint32_t subcontig_id){
+    // during an incremental resize, keys from chunks that have not been moved yet are still in the old table
+    if(ht->old_items != NULL && resize_chunk_of(ht, key & ht->old_bitmask) >= ht->chunks_migrated){
+        ht_element* old_item = table_find(ht->old_items, ht->old_size, ht->old_bitmask, key);
+        if(old_item != NULL) return old_item;
+    }
+    return table_insert(ht->items, ht->size, ht->entry_bitmask, key, status, subcontig_id);
+}
+
+// return the entry of key, or NULL if it is not in ht
+ht_element* hashtable_find(hashtable* ht, uint64_t key){
+    if(ht->old_items != NULL && resize_chunk_of(ht, key & ht->old_bitmask) >= ht->chunks_migrated){
+        ht_element* old_item = table_find(ht->old_items, ht->old_size, ht->old_bitmask, key);
+        if(old_item != NULL) return old_item;
+    }
+    return table_find(ht->items, ht->size, ht->entry_bitmask, key);
+}
+
+ht_element_small* hashtable_find_small(hashtable* ht, uint32_t key){
+    ht_element_small* current_item = &(ht->items_small[key & ht->entry_bitmask]);
+    while(ht_small_get_status(current_item) != EMPTY){
+        if(current_item->key == key) return current_item;
+        ++current_item;
+        if((uint64_t)(current_item - ht->items_small) == ht->size) current_item = ht->items_small;
+    }
+    return NULL;
+}
+
+// insert function with same behaviour, but for memory-efficient version
+ht_element_small* hashtable_insert_small(hashtable* ht, uint32_t key, ht_element_status status, uint32_t subcontig_id){
+    uint32_t hash = key & ht->entry_bitmask;
+    ht_element_small* current_item = &(ht->items_small[hash]);
+    while(ht_small_get_status(current_item) != EMPTY){
+        if(current_item->key == key) return current_item;
+        ++current_item;
+        // reset to beginning of hashtable if end is reached
+        if((uint64_t)(current_item - ht->items_small) == ht->size) current_item = ht->items_small;
+    }
+    current_item->key = key;
+    ht_small_set_status(current_item, status);
+    ht_small_set_id(current_item, subcontig_id);
+    return NULL;
+}
+
+/*
+ * Resizing moves every entry of the old table into a new table of twice the size
+ * The old table is split into chunks that start at empty entries, so the entries whose home is in a chunk are all stored
+ * in that chunk (apart from the cluster wrapping around the end of the table, which belongs to wrap_chunk). In the new
+ * table those entries have their home in the chunk's range or in the same range shifted by the old size
+ * Parallel: threads take chunks and insert their entries in order, probing only inside the chunk's two ranges of the new
+ * table, so no two threads write to the same entries. An entry that would probe past its chunk's range is deferred and
+ * inserted after all threads are done, in chunk order, as is the wrapping cluster. The new table does not depend on the
+ * number of threads
+ * Incremental: the new table is used at once and the old table is kept. After each subcontig one more chunk is moved.
+ * Lookups of a key whose home chunk has not been moved yet check the old table first, so a key is only ever in one of the
+ * two tables. Memory of moved chunks is handed back as the resize goes
+ * Either way every entry of the old table is inserted into the new table exactly once with the same key, status, and
+ * subcontig id, by linear probing from its new home, so the new table holds the same set of entries as rehashing in place
+ * would and every lookup or insert afterwards returns the same result
+ */
+
+static void resize_chunks_create(hashtable* ht){
+    ht->num_chunks = (ht->old_size + RESIZE_CHUNK_SIZE - 1) / RESIZE_CHUNK_SIZE;
+    ht->chunks = calloc(ht->num_chunks, sizeof(resize_chunk));
+    uint64_t position = 0;
+    for(uint32_t i=0; i<ht->num_chunks; ++i){
+        if(position < (uint64_t) i * RESIZE_CHUNK_SIZE) position = (uint64_t) i * RESIZE_CHUNK_SIZE;
+        while(position < ht->old_size && ht->old_items[position].status != EMPTY) ++position;
+        ht->chunks[i].start = position;
+    }
+    ht->wrap_chunk = ht->num_chunks;
+    for(uint32_t i=0; i<ht->num_chunks; ++i){
+        ht->chunks[i].end = i+1 < ht->num_chunks ? ht->chunks[i+1].start : ht->old_size;
+        if(ht->chunks[i].end == ht->old_size && ht->wrap_chunk == ht->num_chunks) ht->wrap_chunk = i;
+    }
+    ht->chunks_migrated = 0;
+}
+
+static void resize_end(hashtable* ht){
+    for(uint32_t i=0; i<ht->num_chunks; ++i) free(ht->chunks[i].deferred);
+    free(ht->chunks);
+    ht->chunks = NULL;
+    table_free(ht->old_items, ht->old_size * sizeof(ht_element));
+    ht->old_items = NULL;
+}
+
+static void defer_entry(resize_chunk* chunk, uint64_t position){
+    if(chunk->num_deferred == chunk->deferred_capacity){
+        chunk->deferred_capacity = chunk->deferred_capacity == 0 ? 1024 : chunk->deferred_capacity * 2;
+        chunk->deferred = realloc(chunk->deferred, chunk->deferred_capacity * sizeof(uint64_t));
+    }
+    chunk->deferred[chunk->num_deferred++] = position;
+}
+
+// insert an old entry into the chunk's ranges of the new table, returns false if it would have to probe past them
+static inline bool migrate_entry_bounded(hashtable* ht, resize_chunk* chunk, ht_element* entry){
+    uint64_t position = entry->key & ht->entry_bitmask;
+    uint64_t end = position < ht->old_size ? chunk->end : chunk->end + ht->old_size;
+    while(ht->items[position].status != EMPTY){
+        if(++position == end) return false;
+    }
+    ht->items[position] = *entry;
+    return true;
+}
+
+// move the entries of one chunk, bounded moves defer entries that would leave the chunk's ranges
+static void migrate_chunk(hashtable* ht, uint32_t chunk_id, bool bounded){
+    resize_chunk* chunk = &ht->chunks[chunk_id];
+    for(uint64_t i=chunk->start; i<chunk->end; ++i){
+        ht_element* entry = &ht->old_items[i];
+        if(entry->status == EMPTY) continue;
+        if(!bounded){
+            table_insert(ht->items, ht->size, ht->entry_bitmask, entry->key, entry->status, entry->subcontig_id);
+        }else if(!migrate_entry_bounded(ht, chunk, entry)){
+            defer_entry(chunk, i);
+        }
+    }
+    if(chunk_id != ht->wrap_chunk) return;
+    for(uint64_t i=0; i<ht->chunks[0].start; ++i){
+        ht_element* entry = &ht->old_items[i];
+        if(bounded){
+            defer_entry(chunk, i);
+        }else{
+            table_insert(ht->items, ht->size, ht->entry_bitmask, entry->key, entry->status, entry->subcontig_id);
+        }
+    }
+}
+
+// thread function moving chunks until none are left
+static void* migrate_chunks(void* worker){
+    resize_worker* w = (resize_worker*) worker;
+    uint32_t chunk_id;
+    while((chunk_id = __atomic_fetch_add(w->next_chunk, 1, __ATOMIC_RELAXED)) < w->ht->num_chunks){
+        migrate_chunk(w->ht, chunk_id, true);
+    }
+    return NULL;
+}
+
+// double ht size and move all entries to the new table, or start moving them when resizing incrementally
+void hashtable_resize(hashtable* ht){
+    if(ht->is_small){hashtable_resize_small(ht); return;}
+    hashtable_finish_resize(ht);
+    printf("Hashtable is resizing, new size will use ~ %ld GiB of memory\n", ht->size*2/INITIAL_HT_SIZE/2);
+    ht->old_items = ht->items;
+    ht->old_size = ht->size;
+    ht->old_bitmask = ht->entry_bitmask;
+    ht->size *= 2;
+    ht->entry_bitmask = (ht->entry_bitmask << 1) | 0x1;
+    resize_chunks_create(ht);
+    if(ht->incremental_resize){
+        ht->items = table_alloc_lazy(ht->size * sizeof(ht_element), &ht->placement);
+        hashtable_print_placement(ht);
+        return;
+    }
+
+    ht->items = table_alloc(ht->size * sizeof(ht_element), ht->num_threads, &ht->placement);
+    hashtable_print_placement(ht);
+    uint32_t next_chunk = 0;
+    pthread_t* threads = calloc(ht->num_threads, sizeof(pthread_t));
+    resize_worker worker = {ht, &next_chunk};
+    for(uint32_t i=0; i<ht->num_threads; ++i){
+        if(pthread_create(&threads[i], NULL, migrate_chunks, &worker) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(uint32_t i=0; i<ht->num_threads; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    for(uint32_t i=0; i<ht->num_chunks; ++i){
+        for(uint64_t j=0; j<ht->chunks[i].num_deferred; ++j){
+            ht_element* entry = &ht->old_items[ht->chunks[i].deferred[j]];
+            table_insert(ht->items, ht->size, ht->entry_bitmask, entry->key, entry->status, entry->subcontig_id);
+        }
+    }
+    resize_end(ht);
+}
+
+// move the next chunk of an incremental resize, the old table is freed after the last one
+void hashtable_continue_resize(hashtable* ht){
+    if(ht->old_items == NULL) return;
+    resize_chunk* chunk = &ht->chunks[ht->chunks_migrated];
+    migrate_chunk(ht, ht->chunks_migrated, false);
+    table_release(ht->old_items, chunk->start * sizeof(ht_element), chunk->end * sizeof(ht_element));
+    if(++ht->chunks_migrated == ht->num_chunks) resize_end(ht);
+}
+
+void hashtable_finish_resize(hashtable* ht){
+    while(ht->old_items != NULL) hashtable_continue_resize(ht);
+}
+
+void hashtable_resize_small(hashtable* ht){
+    /*
+    add warnings and errors for big sizes
+    */
+    ht->size *= 2;
+    printf("Hashtable is resizing, new size will use ~ %.1f GiB of memory\n", (float)ht->size/INITIAL_HT_SIZE/4);
+    if(ht->size == 536870912){ // 2^29
+        printf("Warning: Due to the large input size and use of the memory-efficient mode, the output is losing some accuracy.\n");
+    }
+    if(ht->size == 1073741824){ // 2^30
+        fprintf(stderr,"Error: memory-efficient mode has lost too much accuracy to continue, please try again without it enabled.\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t changed_bit = ht->entry_bitmask;
+    ht->entry_bitmask = (ht->entry_bitmask << 1) | 0x1;
+    changed_bit ^= ht->entry_bitmask;
+    ht->items_small = table_realloc(ht->items_small, ht->size/2 * sizeof(ht_element_small), ht->size * sizeof(ht_element_small),
+                                    ht->num_threads, &ht->placement);
+    hashtable_print_placement(ht);
+    ht_element_small* current_entry =  ht->items_small-1;
+    while(current_entry != &ht->items_small[ht->size/2]){
+        ++current_entry;
+        if(ht_small_get_status(current_entry) == EMPTY) continue;
+        if(hashtable_insert_small(ht, current_entry->key, ht_small_get_status(current_entry), ht_small_get_id(current_entry))!=NULL) continue;
+        current_entry->key = 0;
+        ht_small_set_status(current_entry, EMPTY);
+        ht_small_set_id(current_entry, 0);
+    }
+}
+
+// report which pages back the hashtable and how they are spread across NUMA nodes
+void hashtable_print_placement(hashtable* ht){
+    size_t bytes = ht->size * (ht->is_small ? sizeof(ht_element_small) : sizeof(ht_element));
+    if(ht->placement.numa_nodes > 1){
+        printf("Hashtable memory: %.1f GiB backed by %s, interleaved across %d NUMA nodes\n", (double) bytes / (1UL << 30),
+               table_backing_name(ht->placement.backing), ht->placement.numa_nodes);
+    }else{
+        printf("Hashtable memory: %.1f GiB backed by %s\n", (double) bytes / (1UL << 30), table_backing_name(ht->placement.backing));
+    }
+}
+
+// return the sum of all unique hashes
+uint64_t sum_unique_hahses(hashtable* ht){
+    uint64_t sum = 0;
+    for(uint32_t i=0; i<ht->curr_subcontig; ++i){
+        sum+=ht->subcontig_counts[i];
+    }
+    return sum;
+}
+
+// add one k-mer (to be hashed) to the hashtable
+static inline void hashtable_add_kmer(hashtable* ht, char* seq, uint32_t subcontig_id){
+    uint64_t hash = MurmurHash64A(seq, ht->kmer_size, (uint64_t)HASH_SEED);
+    ht_element* hashtable_item = hashtable_insert(ht, hash, UNIQUE, subcontig_id);
+    if(hashtable_item == NULL){
+        ++ht->subcontig_counts[subcontig_id];
+        ++ht->count;
+    } else if(hashtable_item->status == UNIQUE){
+        hashtable_item->status = NON_UNIQUE;
+        --ht->subcontig_counts[hashtable_item->subcontig_id];
+    }
+}
+
+// same functionality but for memory-efficient mode
+static inline void hashtable_small_add_kmer(hashtable* ht, char* seq, uint32_t subcontig_id){
+    uint32_t hash = MurmurHash3_x86_32(seq, ht->kmer_size, (uint32_t)HASH_SEED);
+    ht_element_small* hashtable_item = hashtable_insert_small(ht, hash, UNIQUE, subcontig_id);
+    if(hashtable_item == NULL){
+        ++ht->subcontig_counts[subcontig_id];
+        ++ht->count;
+    } else if(ht_small_get_status(hashtable_item) == UNIQUE){
+        ht_small_set_status(hashtable_item, NON_UNIQUE);
+        --ht->subcontig_counts[ht_small_get_id(hashtable_item)];
+    }
+}
+
+// function for marking a k-mer as non-unique
+// a k-mer already added as unique loses its count, so excluded subcontigs may come before or after the others
+static inline void hashtable_mark_kmer(hashtable* ht, char* seq, uint32_t subcont_id){
+    uint64_t hash = MurmurHash64A(seq, ht->kmer_size, (uint64_t)HASH_SEED);
+    ht_element* hashtable_item = hashtable_insert(ht, hash, NON_UNIQUE, subcont_id);
+    if(hashtable_item == NULL){
+        ++ht->count;
+    } else if(hashtable_item->status == UNIQUE){
+        hashtable_item->status = NON_UNIQUE;
+        --ht->subcontig_counts[hashtable_item->subcontig_id];
+    }
+}
+
+static inline void hashtable_small_mark_kmer(hashtable* ht, char* seq, uint32_t subcont_id){
+    uint32_t hash = MurmurHash3_x86_32(seq, ht->kmer_size, (uint32_t)HASH_SEED);
+    ht_element_small* hashtable_item = hashtable_insert_small(ht, hash, NON_UNIQUE, subcont_id);
+    if(hashtable_item == NULL){
+        ++ht->count;
+    } else if(ht_small_get_status(hashtable_item) == UNIQUE){
+        ht_small_set_status(hashtable_item, NON_UNIQUE);
+        --ht->subcontig_counts[ht_small_get_id(hashtable_item)];
+    }
+}
+
+// check if sequence k-mer has an N in it
+static inline int check_n(char* seq, uint32_t kmer_size){
+    for(uint32_t i=0; i < kmer_size; ++i){
+        if(seq[i] == 'N') return i+1;
+    }
+    return 0;
+}
+
+// add k-mers to the hashtable for an entire subcontig
+void hash_and_insert_subcontig(hashtable* ht, char* seq, uint32_t subcontig_id, void (*kmer_func)(hashtable*, char*, uint32_t)){
+    uint32_t i = 0;
+    char* rc = reverse_complement(seq);
+    uint32_t n;
+    uint32_t seq_len = strlen(seq);
+    while((n=check_n(&seq[i], ht->kmer_size))){
+        i+=n;
+    }
+    while(ht->kmer_size + i <= seq_len){
+        if(seq[i+ht->kmer_size-1]=='N'){
+            i+=ht->kmer_size;
+            if(i+ht->kmer_size > seq_len) break;
+            while((n=check_n(&seq[i], ht->kmer_size))) i+=n;
+            continue;
+        }
+    
+        if(strncmp(&seq[i], &rc[seq_len-ht->kmer_size-i], ht->kmer_size) < 0){
+            kmer_func(ht, &seq[i], subcontig_id);
+        }else{
+            kmer_func(ht, &rc[seq_len-ht->kmer_size-i], subcontig_id);
+        }
+        ++ht->kmers_added;
+        ++i;
+    }
+    free(rc);
+    ht->bases_added += seq_len;
+    hashtable_continue_resize(ht);
+    // resize hashtable if load factor is >0.75 after subcontig addition
+    if((float) ht->count / ht->size > 0.75) hashtable_resize(ht);
+}
+
+// give a subcontig the next id and add its k-mers, name is copied into the registry, returns the subcontig's id
+uint32_t hashtable_add_subcontig(hashtable* ht, const char* name, char* seq, bool excluded){
+    if(ht->curr_subcontig == ht->subcontigs_capacity){
+        ht->subcontigs_capacity *= 2;
+        ht->subcontig_counts = realloc(ht->subcontig_counts, ht->subcontigs_capacity * sizeof(uint32_t));
+    }
+    uint32_t subcontig_id = ht->curr_subcontig++;
+    subcontig_registry_add(ht->registry, name);
+    ht->subcontig_counts[subcontig_id] = 0;
+    if(ht->is_small){
+        hash_and_insert_subcontig(ht, seq, subcontig_id, excluded ? hashtable_small_mark_kmer : hashtable_small_add_kmer);
+    }else{
+        hash_and_insert_subcontig(ht, seq, subcontig_id, excluded ? hashtable_mark_kmer : hashtable_add_kmer);
+    }
+    return subcontig_id;
+}
+
+// add k-mers to the hashtable for all subcontigs in a directory, reader threads read the next subcontigs while one is hashed
+void hash_and_insert(hashtable* ht, char* dir_location, bool excluded, read_ahead_options* read_ahead){
+    subcontig_reader* reader = subcontig_reader_open(dir_location, read_ahead);
+    subcontig_slot* slot;
+    while((slot = subcontig_reader_next(reader)) != NULL){
+        hashtable_add_subcontig(ht, slot->name, slot->seq, excluded);
+    }
+    subcontig_reader_close(reader);
+}
+
+// write every unique k-mer and the subcontig it belongs to for use by readcounter
+void write_unique_kmers(hashtable* ht, char* index_location){
+    FILE* index = kmer_index_open_write(index_location, ht->kmer_size, subcontig_registry_index_name, ht->registry, ht->curr_subcontig,
+                                        sum_unique_hahses(ht));
+    for(uint64_t i=0; i<ht->size; ++i){
+        if(ht->items[i].status == UNIQUE) kmer_index_write_kmer(index, ht->items[i].key, ht->items[i].subcontig_id);
+    }
+    fclose(index);
+}
+
+// write every k-mer of the subcontigs and excluded subcontigs, unique or not, for readcounter to filter reads with
+bool write_kmer_filter(hashtable* ht, char* filter_location){
+    kmer_filter* filter = kmer_filter_create(ht->kmer_size, ht->count);
+    for(uint64_t i=0; i<ht->size; ++i){
+        if(ht->items[i].status != EMPTY) kmer_filter_add(filter, ht->items[i].key);
+    }
+    bool written = kmer_filter_write(filter, filter_location);
+    kmer_filter_destroy(filter);
+    return written;
+}
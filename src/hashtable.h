@@ -0,0 +1,88 @@
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "kmersort.h"
+
+#define INITIAL_HT_SIZE 33554432 // 2^25 entries, hashtable will initially use 0.5 GiB in memory
+#define INITIAL_HT_BITMASK 0x1FFFFFF // 25 1s
+#define RESIZE_CHUNK_SIZE 1048576 // 2^20 entries, a resize moves the old hashtable to the new one in chunks of about this size
+
+typedef enum ht_element_status{
+    EMPTY = 0,
+    UNIQUE = 1,
+    NON_UNIQUE = 2
+} ht_element_status;
+
+typedef struct ht_element{
+    uint64_t key; // key is a hash
+    ht_element_status status; // status of hash
+    uint32_t subcontig_id; // id is array index for hash name
+} ht_element;
+
+typedef struct ht_element_small{
+    uint32_t key; // key is a hash
+    uint32_t value; // upper 4 bits are status, lower 28 are subcontig id
+} ht_element_small;
+
+typedef struct resize_chunk{
+    uint64_t start; // first empty entry at or after the chunk's nominal start, so no cluster of entries spans two chunks
+    uint64_t end;
+    uint64_t* deferred; // entries that would probe past the chunk's part of the new table, they are inserted one by one afterwards
+    uint64_t num_deferred;
+    uint64_t deferred_capacity;
+} resize_chunk;
+
+typedef struct hashtable{
+    ht_element* items;
+    subcontig_registry* registry;
+    uint64_t size;
+    uint64_t entry_bitmask;
+    uint64_t count;
+    uint32_t* subcontig_counts;
+    uint32_t subcontigs_capacity;
+    uint32_t curr_subcontig; // number of subcontigs added so far
+    uint64_t bases_added;
+    uint64_t kmers_added; // k-mers hashed, those with an N are skipped
+    uint32_t kmer_size;
+    ht_element_small* items_small; // for use in memory-efficient option
+    bool is_small;
+    uint32_t num_threads;
+    table_placement placement; // how the memory of items is backed
+    bool incremental_resize;
+    // state of a resize in progress, old_items is NULL when there is none
+    ht_element* old_items;
+    uint64_t old_size;
+    uint64_t old_bitmask;
+    resize_chunk* chunks;
+    uint32_t num_chunks;
+    uint32_t chunks_migrated;
+    uint32_t wrap_chunk; // chunk whose last cluster wraps around to the start of the old table
+} hashtable;
+
+typedef struct resize_worker{
+    hashtable* ht;
+    uint32_t* next_chunk;
+} resize_worker;
+
+
+hashtable* hashtable_create(uint32_t kmer_size, bool is_small, uint32_t num_subconts, uint32_t num_threads, bool incremental_resize);
+void hashtable_destroy(hashtable* ht);
+ht_element* hashtable_insert(hashtable* ht, uint64_t key, ht_element_status status, uint32_t subcontig_id);
+ht_element_small* hashtable_insert_small(hashtable* ht, uint32_t key, ht_element_status status, uint32_t subcontig_id);
+void hashtable_resize(hashtable* ht);
+void hashtable_resize_small(hashtable* ht);
+void hashtable_continue_resize(hashtable* ht);
+void hashtable_finish_resize(hashtable* ht);
+void hashtable_print_placement(hashtable* ht);
+void hash_and_insert_subcontig(hashtable* ht, char* seq, uint32_t subcontig_id, void (*kmer_func)(hashtable*, char*, uint32_t));
+uint32_t hashtable_add_subcontig(hashtable* ht, const char* name, char* seq, bool excluded);
+void hash_and_insert(hashtable* ht, char* dir_location, bool excluded, read_ahead_options* read_ahead);
+ht_element* hashtable_find(hashtable* ht, uint64_t key);
+ht_element_small* hashtable_find_small(hashtable* ht, uint32_t key);
+uint64_t sum_unique_hahses(hashtable* ht);
+void write_unique_kmers(hashtable* ht, char* index_location);
+bool write_kmer_filter(hashtable* ht, char* filter_location);
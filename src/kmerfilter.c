@@ -0,0 +1,86 @@
+#include "kmerfilter.h"
+
+/*
+ * Writer and reader for the reference k-mer filter written by hashcounter -f, see kmerfilter.h
+ * The probes of a k-mer are spread by double hashing: the k-mer's hash, then steps of a second hash mixed from it
+ * Lookups never modify the filter, so it can be shared between threads without locking
+ */
+
+kmer_filter* kmer_filter_create(uint32_t kmer_size, uint64_t num_kmers){
+    kmer_filter* filter = malloc(sizeof(kmer_filter));
+    filter->num_bits = 64;
+    while(filter->num_bits < num_kmers * KMER_FILTER_BITS) filter->num_bits <<= 1;
+    filter->bit_bitmask = filter->num_bits - 1;
+    filter->words = calloc(filter->num_bits / 64, sizeof(uint64_t));
+    filter->probes = KMER_FILTER_PROBES;
+    filter->kmer_size = kmer_size;
+    return filter;
+}
+
+void kmer_filter_destroy(kmer_filter* filter){
+    free(filter->words);
+    free(filter);
+}
+
+// step between the probes of a k-mer, odd so every probe of a k-mer lands on a different bit
+static inline uint64_t probe_step(uint64_t key){
+    key ^= key >> 31;
+    key *= 0x7fb5d329728ea185ULL;
+    key ^= key >> 27;
+    key *= 0x81dadef4bc2dd44dULL;
+    key ^= key >> 33;
+    return key | 1;
+}
+
+void kmer_filter_add(kmer_filter* filter, uint64_t key){
+    uint64_t step = probe_step(key);
+    for(uint32_t i=0; i<filter->probes; ++i){
+        uint64_t bit = (key + i*step) & filter->bit_bitmask;
+        filter->words[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool kmer_filter_contains(kmer_filter* filter, uint64_t key){
+    uint64_t step = probe_step(key);
+    for(uint32_t i=0; i<filter->probes; ++i){
+        uint64_t bit = (key + i*step) & filter->bit_bitmask;
+        if(!(filter->words[bit >> 6] & (1ULL << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+bool kmer_filter_write(kmer_filter* filter, char* filter_location){
+    FILE* fp = fopen(filter_location, "wb");
+    if(fp == NULL) return false;
+    fwrite(KMER_FILTER_MAGIC, sizeof(char), strlen(KMER_FILTER_MAGIC), fp);
+    fwrite(&filter->kmer_size, sizeof(uint32_t), 1, fp);
+    fwrite(&filter->probes, sizeof(uint32_t), 1, fp);
+    fwrite(&filter->num_bits, sizeof(uint64_t), 1, fp);
+    fwrite(filter->words, sizeof(uint64_t), filter->num_bits / 64, fp);
+    bool written = !ferror(fp);
+    return fclose(fp) == 0 && written;
+}
+
+kmer_filter* kmer_filter_load(char* filter_location){
+    FILE* fp = fopen(filter_location, "rb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open k-mer filter %s\n", filter_location);
+        exit(EXIT_FAILURE);
+    }
+    char magic[sizeof(KMER_FILTER_MAGIC)] = {0};
+    kmer_filter* filter = malloc(sizeof(kmer_filter));
+    if(fread(magic, sizeof(char), strlen(KMER_FILTER_MAGIC), fp) != strlen(KMER_FILTER_MAGIC) || strcmp(magic, KMER_FILTER_MAGIC) != 0 ||
+       fread(&filter->kmer_size, sizeof(uint32_t), 1, fp) != 1 || fread(&filter->probes, sizeof(uint32_t), 1, fp) != 1 ||
+       fread(&filter->num_bits, sizeof(uint64_t), 1, fp) != 1 || filter->num_bits < 64 || (filter->num_bits & (filter->num_bits - 1)) != 0){
+        fprintf(stderr, "Error: %s is not a k-mer filter generated by hashcounter\n", filter_location);
+        exit(EXIT_FAILURE);
+    }
+    filter->bit_bitmask = filter->num_bits - 1;
+    filter->words = malloc(filter->num_bits / 8);
+    if(fread(filter->words, sizeof(uint64_t), filter->num_bits / 64, fp) != filter->num_bits / 64){
+        fprintf(stderr, "Error: k-mer filter %s is truncated\n", filter_location);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+    return filter;
+}
@@ -0,0 +1,30 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KMER_FILTER_MAGIC "SR2KFLT1"
+#define KMER_FILTER_BITS 10 // at least this many bits per k-mer, at most twice as many once rounded up to a power of two
+#define KMER_FILTER_PROBES 5 // bits set per k-mer, under 1% false positives at 10 bits per k-mer
+
+/*
+ * ReferenceKmers.filter is a Bloom filter of every k-mer hashcounter -f saw, in the subcontigs and the excluded subcontigs
+ * A k-mer it does not contain is in none of them, while a k-mer it contains is in the reference or, rarely, a false positive
+ * Layout: magic (8 bytes) | kmer_size (u32) | probes (u32) | num_bits (u64, a power of two) | num_bits / 64 words (u64)
+ */
+
+typedef struct kmer_filter{
+    uint64_t* words;
+    uint64_t num_bits;
+    uint64_t bit_bitmask;
+    uint32_t probes;
+    uint32_t kmer_size;
+} kmer_filter;
+
+kmer_filter* kmer_filter_create(uint32_t kmer_size, uint64_t num_kmers);
+void kmer_filter_destroy(kmer_filter* filter);
+void kmer_filter_add(kmer_filter* filter, uint64_t key);
+bool kmer_filter_contains(kmer_filter* filter, uint64_t key);
+bool kmer_filter_write(kmer_filter* filter, char* filter_location);
+kmer_filter* kmer_filter_load(char* filter_location);
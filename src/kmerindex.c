@@ -0,0 +1,129 @@
+#include "kmerindex.h"
+
+/*
+ * Reader and writer for the unique k-mer table written by hashcounter -u
+ * Once loaded, the k-mers are kept in a read-only open addressing table (linear probe) sized to a load factor <= 0.5
+ * Lookups never modify the table, so it can be shared between threads without locking
+ */
+
+// write the header and subcontig names, the caller then writes num_kmers k-mers with kmer_index_write_kmer
+FILE* kmer_index_open_write(char* index_location, uint32_t kmer_size, kmer_index_name_func subcontig_name, void* context,
+                            uint32_t num_subcontigs, uint64_t num_kmers){
+    FILE* fp = fopen(index_location, "wb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", index_location);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(KMER_INDEX_MAGIC, sizeof(char), strlen(KMER_INDEX_MAGIC), fp);
+    fwrite(&kmer_size, sizeof(uint32_t), 1, fp);
+    fwrite(&num_subcontigs, sizeof(uint32_t), 1, fp);
+    fwrite(&num_kmers, sizeof(uint64_t), 1, fp);
+    for(uint32_t i=0; i<num_subcontigs; ++i){
+        const char* name = subcontig_name(context, i);
+        fwrite(name, sizeof(char), strlen(name)+1, fp);
+    }
+    return fp;
+}
+
+void kmer_index_write_kmer(FILE* fp, uint64_t key, uint32_t subcontig_id){
+    fwrite(&key, sizeof(uint64_t), 1, fp);
+    fwrite(&subcontig_id, sizeof(uint32_t), 1, fp);
+}
+
+static void kmer_index_insert(kmer_index* index, uint64_t key, uint32_t subcontig_id){
+    kmer_index_element* current_item = &(index->items[key & index->entry_bitmask]);
+    while(current_item->subcontig_id != KMER_INDEX_NONE){
+        if(current_item->key == key) return;
+        ++current_item;
+        // reset to beginning of table if end is reached
+        if((uint64_t)(current_item - index->items) == index->size) current_item = index->items;
+    }
+    current_item->key = key;
+    current_item->subcontig_id = subcontig_id;
+}
+
+// read a NUL-terminated string from fp
+static char* read_name(FILE* fp){
+    uint32_t capacity = 128;
+    uint32_t len = 0;
+    char* name = malloc(capacity);
+    int c;
+    while((c = fgetc(fp)) != EOF && c != '\0'){
+        if(len+1 == capacity){
+            capacity *= 2;
+            name = realloc(name, capacity);
+        }
+        name[len++] = c;
+    }
+    if(c == EOF){
+        free(name);
+        return NULL;
+    }
+    name[len] = '\0';
+    return name;
+}
+
+kmer_index* kmer_index_load(char* index_location){
+    FILE* fp = fopen(index_location, "rb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open k-mer index %s\n", index_location);
+        exit(EXIT_FAILURE);
+    }
+    char magic[sizeof(KMER_INDEX_MAGIC)] = {0};
+    kmer_index* index = malloc(sizeof(kmer_index));
+    if(fread(magic, sizeof(char), strlen(KMER_INDEX_MAGIC), fp) != strlen(KMER_INDEX_MAGIC) || strcmp(magic, KMER_INDEX_MAGIC) != 0 ||
+       fread(&index->kmer_size, sizeof(uint32_t), 1, fp) != 1 || fread(&index->num_subcontigs, sizeof(uint32_t), 1, fp) != 1 ||
+       fread(&index->count, sizeof(uint64_t), 1, fp) != 1){
+        fprintf(stderr, "Error: %s is not a k-mer index generated by hashcounter\n", index_location);
+        exit(EXIT_FAILURE);
+    }
+
+    index->subcontig_names = calloc(index->num_subcontigs, sizeof(char*));
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        if((index->subcontig_names[i] = read_name(fp)) == NULL){
+            fprintf(stderr, "Error: k-mer index %s is truncated\n", index_location);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    index->size = 1;
+    while(index->size < 2*index->count) index->size <<= 1;
+    index->entry_bitmask = index->size - 1;
+    index->items = malloc(index->size * sizeof(kmer_index_element));
+    for(uint64_t i=0; i<index->size; ++i){
+        index->items[i].key = 0;
+        index->items[i].subcontig_id = KMER_INDEX_NONE;
+    }
+
+    uint64_t key;
+    uint32_t subcontig_id;
+    for(uint64_t i=0; i<index->count; ++i){
+        if(fread(&key, sizeof(uint64_t), 1, fp) != 1 || fread(&subcontig_id, sizeof(uint32_t), 1, fp) != 1){
+            fprintf(stderr, "Error: k-mer index %s is truncated\n", index_location);
+            exit(EXIT_FAILURE);
+        }
+        kmer_index_insert(index, key, subcontig_id);
+    }
+    fclose(fp);
+    return index;
+}
+
+void kmer_index_destroy(kmer_index* index){
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        free(index->subcontig_names[i]);
+    }
+    free(index->subcontig_names);
+    free(index->items);
+    free(index);
+}
+
+// return the id of the subcontig a hashed k-mer is unique to, or KMER_INDEX_NONE if it is not in the index
+uint32_t kmer_index_lookup(kmer_index* index, uint64_t key){
+    kmer_index_element* current_item = &(index->items[key & index->entry_bitmask]);
+    while(current_item->subcontig_id != KMER_INDEX_NONE){
+        if(current_item->key == key) return current_item->subcontig_id;
+        ++current_item;
+        if((uint64_t)(current_item - index->items) == index->size) current_item = index->items;
+    }
+    return KMER_INDEX_NONE;
+}
@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KMER_INDEX_MAGIC "SR2KIDX1"
+#define KMER_INDEX_NONE 0xFFFFFFFF // subcontig id of an empty slot, or of a k-mer that is not unique
+
+/*
+ * UniqueKmers.index holds every unique k-mer found by hashcounter along with the subcontig it belongs to
+ * Layout: magic (8 bytes) | kmer_size (u32) | num_subcontigs (u32) | num_kmers (u64)
+ *         num_subcontigs NUL-terminated subcontig names, the position of a name is its subcontig id
+ *         num_kmers records of hash (u64) followed by subcontig id (u32)
+ */
+
+typedef struct kmer_index_element{
+    uint64_t key; // key is a hash
+    uint32_t subcontig_id; // id is array index for subcontig name
+} kmer_index_element;
+
+typedef struct kmer_index{
+    kmer_index_element* items;
+    char** subcontig_names;
+    uint64_t size;
+    uint64_t entry_bitmask;
+    uint64_t count;
+    uint32_t num_subcontigs;
+    uint32_t kmer_size;
+} kmer_index;
+
+// name of a subcontig for kmer_index_open_write, the string only has to stay valid until the next call
+typedef const char* (*kmer_index_name_func)(void* context, uint32_t subcontig_id);
+
+FILE* kmer_index_open_write(char* index_location, uint32_t kmer_size, kmer_index_name_func subcontig_name, void* context,
+                            uint32_t num_subcontigs, uint64_t num_kmers);
+void kmer_index_write_kmer(FILE* fp, uint64_t key, uint32_t subcontig_id);
+kmer_index* kmer_index_load(char* index_location);
+void kmer_index_destroy(kmer_index* index);
+uint32_t kmer_index_lookup(kmer_index* index, uint64_t key);
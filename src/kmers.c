@@ -0,0 +1,200 @@
+#include "kmers.h"
+
+/*
+ * K-mer hashing shared by hashcounter and the tools that query its output
+ * Everything that must agree with hashcounter (hash functions, seed, canonical k-mer choice) lives here
+ */
+
+/* following function adapted from Austin Appleby */
+uint64_t MurmurHash64A (const void* key, int len, uint64_t seed){
+    const uint64_t m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const uint64_t* data = (const uint64_t*) key;
+    const uint64_t* end = data + (len/8);
+
+    while(data != end){
+        uint64_t k = *data++;
+
+        k *= m; 
+        k ^= k >> r; 
+        k *= m; 
+
+        h ^= k;
+        h *= m; 
+    }
+    const unsigned char * data2 = (const unsigned char*)data;
+    switch(len & 7){
+        case 7: h ^= (uint64_t)(data2[6]) << 48; break;
+        case 6: h ^= (uint64_t)(data2[5]) << 40; break;
+        case 5: h ^= (uint64_t)(data2[4]) << 32; break;
+        case 4: h ^= (uint64_t)(data2[3]) << 24; break;
+        case 3: h ^= (uint64_t)(data2[2]) << 16; break;
+        case 2: h ^= (uint64_t)(data2[1]) << 8; break;
+        case 1: h ^= (uint64_t)(data2[0]); break;
+            h *= m;
+    };
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+/* following function adapted from Austin Appleby */
+uint32_t MurmurHash3_x86_32(const void* key, int len, uint32_t seed){
+    const uint8_t* data = (const uint8_t*)key;
+    const int nblocks = len / 4;
+    uint32_t h1 = seed;
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+
+    const uint32_t* blocks = (const uint32_t*)(data + nblocks*4);
+    for(int i = -nblocks; i; ++i){
+        uint32_t k1 = blocks[i];
+
+        k1 *= c1;
+        k1 = (k1 << 15) | (k1 >> 17);
+        k1 *= c2;
+
+        h1 ^= k1;
+        h1 = (h1 << 13) | (h1 >> 19); 
+        h1 = h1*5+0xe6546b64;
+    }
+
+    const uint8_t* tail = (const uint8_t*)(data + nblocks*4);
+    uint32_t k1 = 0;
+    switch(len & 3){
+    case 3: k1 ^= tail[2] << 16; break;
+    case 2: k1 ^= tail[1] << 8; break;
+    case 1: k1 ^= tail[0]; break;
+            k1 *= c1; k1 = (k1 << 15) | (k1 >> 17); k1 *= c2; h1 ^= k1;
+    };
+
+    h1 ^= len;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+    return h1;
+} 
+
+// following lookup basemap for use in reverse complementing
+static const unsigned char basemap[256] = {
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+     16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,
+     32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,  46,  47,
+     48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+     64, 'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D', 'I', 'J', 'M', 'L', 'K', 'N', 'O',
+    'P', 'Q', 'Y', 'S', 'A', 'A', 'B', 'W', 'X', 'R', 'Z',  91,  92,  93,  94,  95,
+     96, 'T', 'v', 'G', 'h', 'e', 'f', 'C', 'd', 'i', 'j', 'm', 'l', 'k', 'N', 'o',
+    'p', 'q', 'y', 's', 'A', 'A', 'b', 'w', 'x', 'r', 'z', 123, 124, 125, 126, 127,
+    128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+    144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+    160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+    176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+    192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+    208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+    224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+    240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+};
+char* reverse_complement(char* seq){
+    char* rc = calloc(strlen(seq)+1, sizeof(char));
+    uint32_t j = 0;
+    for (int i = strlen(seq) - 1; i >= 0; --i) {
+        rc[j] = basemap[(int)seq[i]];
+        ++j;
+    }
+    return rc;
+}
+
+
+void uppercase_bases(char* seq, uint32_t len){
+    for(uint32_t i=0; i<len; ++i){
+        if(seq[i] >= 'a' && seq[i] <= 'z') seq[i] -= 'a' - 'A';
+    }
+}
+
+// MurmurHash64A of the len bases at seq, or of their reverse complement read back to front so it is never written out
+// whole_tail hashes every byte after the last 8 byte block as the reference MurmurHash64A does, without it only the last of
+// them is hashed as in MurmurHash64A above, which every table, index and filter hashcounter writes is built with
+static inline uint64_t murmur_kmer(const char* seq, int len, uint64_t seed, bool reverse, bool whole_tail){
+    const uint64_t m = 0xc6a4a7935bd1e995;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const unsigned char* bases = (const unsigned char*) seq;
+    unsigned char block[8];
+    int num_blocks = len / 8;
+
+    for(int i=0; i < num_blocks; ++i){
+        uint64_t k;
+        if(reverse){
+            for(int j=0; j<8; ++j) block[j] = basemap[bases[len-1 - 8*i - j]];
+            memcpy(&k, block, sizeof(uint64_t));
+        }else{
+            memcpy(&k, &bases[8*i], sizeof(uint64_t)); // same byte order as MurmurHash64A's loads
+        }
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+    int tail = len & 7;
+    for(int j=0; j<tail; ++j) block[j] = reverse ? basemap[bases[len-1 - 8*num_blocks - j]] : bases[8*num_blocks + j];
+    if(tail > 0 && whole_tail){
+        for(int j=tail-1; j>=0; --j) h ^= (uint64_t)(block[j]) << (8*j);
+        h *= m;
+    }else if(tail > 0){
+        h ^= (uint64_t)(block[tail-1]) << (8*(tail-1));
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+// returns whether the len bases at seq are lexicographically smaller than their reverse complement, as strncmp would order them
+static inline bool forward_is_canonical(const char* seq, uint32_t len){
+    for(uint32_t i=0; i<len; ++i){
+        unsigned char forward = seq[i];
+        unsigned char reverse = basemap[(unsigned char)seq[len-1-i]];
+        if(forward != reverse) return forward < reverse;
+    }
+    return false;
+}
+
+static uint32_t hash_canonical(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes, uint32_t* positions, bool whole_tail){
+    if(seq_len < kmer_size) return 0;
+    uint32_t num_hashes = 0;
+    uint32_t last_n = 0; // one past the position of the most recent N
+    for(uint32_t i=0; i < kmer_size-1; ++i){
+        if(seq[i] == 'N') last_n = i+1;
+    }
+    for(uint32_t i=0; i+kmer_size <= seq_len; ++i){
+        if(seq[i+kmer_size-1] == 'N') last_n = i+kmer_size;
+        if(last_n > i) continue;
+        bool reverse = !forward_is_canonical(&seq[i], kmer_size);
+        hashes[num_hashes] = murmur_kmer(&seq[i], kmer_size, (uint64_t)HASH_SEED, reverse, whole_tail);
+        if(positions != NULL) positions[num_hashes] = i;
+        ++num_hashes;
+    }
+    return num_hashes;
+}
+
+// hash every canonical k-mer without an N, using the same canonical choice as hash_and_insert_subcontig
+uint32_t hash_canonical_kmers(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes){
+    return hash_canonical(seq, seq_len, kmer_size, hashes, NULL, false);
+}
+
+uint32_t hash_canonical_kmers_at(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes, uint32_t* positions){
+    return hash_canonical(seq, seq_len, kmer_size, hashes, positions, false);
+}
+
+uint32_t hash_canonical_sketch_kmers(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes){
+    return hash_canonical(seq, seq_len, kmer_size, hashes, NULL, true);
+}
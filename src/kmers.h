@@ -0,0 +1,21 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_SEED 07062024 // seed shared by every tool hashing k-mers, changing it invalidates existing databases
+
+uint64_t MurmurHash64A (const void* key, int len, uint64_t seed);
+uint32_t MurmurHash3_x86_32(const void * key, int len, uint32_t seed);
+// return a newly allocated reverse complement of seq
+char* reverse_complement(char* seq);
+// uppercase the len bases of seq in place, so soft-masked sequence hashes as BBMap reads it
+void uppercase_bases(char* seq, uint32_t len);
+// hash every canonical k-mer (lexicographically smaller of k-mer and reverse complement) without an N in seq
+// hashes must hold seq_len-kmer_size+1 values, returns the number of hashes written
+uint32_t hash_canonical_kmers(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes);
+// hash_canonical_kmers that also sets positions[j] to the start of the k-mer of hashes[j], positions may be NULL
+uint32_t hash_canonical_kmers_at(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes, uint32_t* positions);
+// hash_canonical_kmers with every base of each k-mer hashed, for strain sketches, which need not match hashcounter's hashes
+// (MurmurHash64A only hashes the last of the bytes after its 8 byte blocks, so k-mers differing only in the others collide)
+uint32_t hash_canonical_sketch_kmers(char* seq, uint32_t seq_len, uint32_t kmer_size, uint64_t* hashes);
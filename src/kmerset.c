@@ -0,0 +1,427 @@
+#include "kmerset.h"
+
+/*
+ * Per-genome k-mer sets and the merge that builds a community's unique k-mer counts from them (hashcounter -l), see kmerset.h
+ * A genome's set is made with the sort engine (kmersort.c): its subcontigs are hashed into records and radix sorted, and
+ * each run of equal hashes becomes one record owned by its subcontig, or shared when the run has more than one record
+ * The merge splits the hash space between threads, each thread walks every set from the start of its part with a heap of
+ * cursors, so no more than a block of each set is held in memory at a time
+ */
+
+typedef struct library_file{
+    char* location;
+    char* strain;
+    bool excluded;
+} library_file;
+
+static void write_varint(FILE* fp, uint64_t value){
+    uint8_t bytes[10];
+    uint32_t len = 0;
+    while(value >= 0x80){
+        bytes[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    bytes[len++] = value;
+    fwrite(bytes, sizeof(uint8_t), len, fp);
+}
+
+static bool read_varint(kmer_set_cursor* cursor, uint64_t end, uint64_t* value){
+    *value = 0;
+    for(uint32_t shift = 0; shift < 70 && cursor->position < end; shift += 7){
+        uint8_t byte = cursor->data[cursor->position++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// write the sorted records of a sorter as a set, the owner of a hash is its one record's subcontig unless it is excluded
+bool kmer_set_write(kmer_sorter* sorter, char* set_location){
+    FILE* fp = fopen(set_location, "wb");
+    if(fp == NULL) return false;
+    kmer_record* records = sorter->records;
+    uint64_t num_records = 0;
+    for(uint64_t i=0; i<sorter->num_records; ++i){
+        if(i == 0 || records[i].hash != records[i-1].hash) ++num_records;
+    }
+    uint32_t num_blocks = (num_records + KMER_SET_BLOCK - 1) / KMER_SET_BLOCK;
+    uint64_t* block_hashes = calloc(num_blocks + 1, sizeof(uint64_t));
+    uint64_t* block_offsets = calloc(num_blocks + 1, sizeof(uint64_t));
+
+    fwrite(KMER_SET_MAGIC, sizeof(char), strlen(KMER_SET_MAGIC), fp);
+    fwrite(&sorter->kmer_size, sizeof(uint32_t), 1, fp);
+    fwrite(&sorter->curr_subcontig, sizeof(uint32_t), 1, fp);
+    fwrite(&num_records, sizeof(uint64_t), 1, fp);
+    fwrite(&num_blocks, sizeof(uint32_t), 1, fp);
+    for(uint32_t i=0; i<sorter->curr_subcontig; ++i){
+        const char* name = subcontig_registry_name(sorter->registry, i);
+        fwrite(name, sizeof(char), strlen(name)+1, fp);
+    }
+    // the block index is written once the blocks are, the space for it is kept here
+    long index_start = ftell(fp);
+    fwrite(block_hashes, sizeof(uint64_t), num_blocks, fp);
+    fwrite(block_offsets, sizeof(uint64_t), num_blocks + 1, fp);
+    long data_start = ftell(fp);
+
+    uint64_t record = 0;
+    uint64_t previous = 0;
+    uint64_t i = 0;
+    while(i < sorter->num_records){
+        uint64_t j = i + 1;
+        while(j < sorter->num_records && records[j].hash == records[i].hash) ++j;
+        if(record % KMER_SET_BLOCK == 0){
+            block_hashes[record / KMER_SET_BLOCK] = records[i].hash;
+            block_offsets[record / KMER_SET_BLOCK] = ftell(fp) - data_start;
+            previous = records[i].hash;
+        }
+        write_varint(fp, records[i].hash - previous);
+        write_varint(fp, j == i + 1 && !records[i].excluded ? (uint64_t) records[i].subcontig_id + 1 : KMER_SET_SHARED);
+        previous = records[i].hash;
+        ++record;
+        i = j;
+    }
+    block_offsets[num_blocks] = ftell(fp) - data_start;
+    fseek(fp, index_start, SEEK_SET);
+    fwrite(block_hashes, sizeof(uint64_t), num_blocks, fp);
+    fwrite(block_offsets, sizeof(uint64_t), num_blocks + 1, fp);
+    free(block_hashes);
+    free(block_offsets);
+    bool written = !ferror(fp);
+    return fclose(fp) == 0 && written;
+}
+
+// read a NUL-terminated string from fp
+static char* read_name(FILE* fp){
+    uint32_t capacity = 128;
+    uint32_t len = 0;
+    char* name = malloc(capacity);
+    int c;
+    while((c = fgetc(fp)) != EOF && c != '\0'){
+        if(len+1 == capacity){
+            capacity *= 2;
+            name = realloc(name, capacity);
+        }
+        name[len++] = c;
+    }
+    if(c == EOF){
+        free(name);
+        return NULL;
+    }
+    name[len] = '\0';
+    return name;
+}
+
+// read the header, names, and block index of a set, the blocks are read by the cursors as the merge gets to them
+kmer_set* kmer_set_open(char* set_location){
+    FILE* fp = fopen(set_location, "rb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open k-mer set %s\n", set_location);
+        return NULL;
+    }
+    char magic[sizeof(KMER_SET_MAGIC)] = {0};
+    kmer_set* set = calloc(1, sizeof(kmer_set));
+    if(fread(magic, sizeof(char), strlen(KMER_SET_MAGIC), fp) != strlen(KMER_SET_MAGIC) || strcmp(magic, KMER_SET_MAGIC) != 0 ||
+       fread(&set->kmer_size, sizeof(uint32_t), 1, fp) != 1 || fread(&set->num_subcontigs, sizeof(uint32_t), 1, fp) != 1 ||
+       fread(&set->num_records, sizeof(uint64_t), 1, fp) != 1 || fread(&set->num_blocks, sizeof(uint32_t), 1, fp) != 1){
+        fprintf(stderr, "Error: %s is not a k-mer set generated by hashcounter\n", set_location);
+        exit(EXIT_FAILURE);
+    }
+    set->subcontig_names = calloc(set->num_subcontigs + 1, sizeof(char*));
+    for(uint32_t i=0; i<set->num_subcontigs; ++i){
+        if((set->subcontig_names[i] = read_name(fp)) == NULL){
+            fprintf(stderr, "Error: k-mer set %s is truncated\n", set_location);
+            exit(EXIT_FAILURE);
+        }
+    }
+    set->block_hashes = calloc(set->num_blocks + 1, sizeof(uint64_t));
+    set->block_offsets = calloc(set->num_blocks + 1, sizeof(uint64_t));
+    if(fread(set->block_hashes, sizeof(uint64_t), set->num_blocks, fp) != set->num_blocks ||
+       fread(set->block_offsets, sizeof(uint64_t), set->num_blocks + 1, fp) != set->num_blocks + 1){
+        fprintf(stderr, "Error: k-mer set %s is truncated\n", set_location);
+        exit(EXIT_FAILURE);
+    }
+    set->data_start = ftell(fp);
+    fclose(fp);
+    set->fd = open(set_location, O_RDONLY);
+    if(set->fd < 0){
+        fprintf(stderr, "Error: failed to open k-mer set %s\n", set_location);
+        exit(EXIT_FAILURE);
+    }
+    return set;
+}
+
+void kmer_set_close(kmer_set* set){
+    for(uint32_t i=0; i<set->num_subcontigs; ++i) free(set->subcontig_names[i]);
+    free(set->subcontig_names);
+    free(set->block_hashes);
+    free(set->block_offsets);
+    close(set->fd);
+    free(set);
+}
+
+// read a block of the cursor's set, returns false past the last block
+static bool load_block(kmer_set_cursor* cursor, uint32_t block){
+    kmer_set* set = cursor->set;
+    if(block >= set->num_blocks) return false;
+    uint64_t size = set->block_offsets[block+1] - set->block_offsets[block];
+    if(size > cursor->data_capacity){
+        cursor->data_capacity = size;
+        cursor->data = realloc(cursor->data, cursor->data_capacity);
+    }
+    if(pread(set->fd, cursor->data, size, set->data_start + set->block_offsets[block]) != (ssize_t) size){
+        fprintf(stderr, "Error: failed to read a block of a k-mer set\n");
+        exit(EXIT_FAILURE);
+    }
+    cursor->block = block;
+    cursor->position = 0;
+    cursor->remaining = block + 1 < set->num_blocks ? KMER_SET_BLOCK : set->num_records - (uint64_t) block * KMER_SET_BLOCK;
+    cursor->hash = set->block_hashes[block];
+    return true;
+}
+
+// move the cursor to the next record, returns false once the set has no more
+static bool cursor_next(kmer_set_cursor* cursor){
+    if(cursor->remaining == 0 && !load_block(cursor, cursor->block + 1)) return false;
+    uint64_t end = cursor->set->block_offsets[cursor->block+1] - cursor->set->block_offsets[cursor->block];
+    uint64_t delta, owner;
+    if(!read_varint(cursor, end, &delta) || !read_varint(cursor, end, &owner)){
+        fprintf(stderr, "Error: a k-mer set is corrupt\n");
+        exit(EXIT_FAILURE);
+    }
+    cursor->hash += delta;
+    cursor->owner = owner;
+    --cursor->remaining;
+    return true;
+}
+
+// put the cursor on the first record with a hash of at least hash, returns false if there is none
+static bool cursor_seek(kmer_set_cursor* cursor, uint64_t hash){
+    kmer_set* set = cursor->set;
+    // last block starting at or below hash
+    uint32_t low = 0;
+    uint32_t high = set->num_blocks;
+    while(low < high){
+        uint32_t middle = low + (high - low) / 2;
+        if(set->block_hashes[middle] <= hash){
+            low = middle + 1;
+        }else{
+            high = middle;
+        }
+    }
+    if(!load_block(cursor, low > 0 ? low - 1 : 0)) return false;
+    while(cursor_next(cursor)){
+        if(cursor->hash >= hash) return true;
+    }
+    return false;
+}
+
+// keep the cursor with the smallest hash at the top of the heap
+static void sift_down(uint32_t* heap, uint32_t heap_size, kmer_set_cursor* cursors, uint32_t position){
+    while(true){
+        uint32_t smallest = position;
+        uint32_t left = 2 * position + 1;
+        uint32_t right = left + 1;
+        if(left < heap_size && cursors[heap[left]].hash < cursors[heap[smallest]].hash) smallest = left;
+        if(right < heap_size && cursors[heap[right]].hash < cursors[heap[smallest]].hash) smallest = right;
+        if(smallest == position) return;
+        uint32_t swap = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = swap;
+        position = smallest;
+    }
+}
+
+// thread function merging the sets over a worker's part of the hash space
+static void* merge_range(void* worker){
+    merge_worker* w = (merge_worker*) worker;
+    kmer_set_cursor* cursors = calloc(w->num_sets + 1, sizeof(kmer_set_cursor));
+    uint32_t* heap = calloc(w->num_sets + 1, sizeof(uint32_t));
+    uint32_t heap_size = 0;
+    for(uint32_t i=0; i<w->num_sets; ++i){
+        cursors[i].set = w->sets[i];
+        if(cursor_seek(&cursors[i], w->start)) heap[heap_size++] = i;
+    }
+    for(uint32_t i=heap_size; i>0; --i) sift_down(heap, heap_size, cursors, i-1);
+
+    while(heap_size > 0 && cursors[heap[0]].hash <= w->end){
+        uint64_t hash = cursors[heap[0]].hash;
+        uint32_t occurrences = 0;
+        uint32_t owner_set = 0;
+        uint32_t owner = KMER_SET_SHARED;
+        // a hash is in a set at most once, so each set with it comes to the top once
+        while(heap_size > 0 && cursors[heap[0]].hash == hash){
+            ++occurrences;
+            owner_set = heap[0];
+            owner = cursors[heap[0]].owner;
+            if(!cursor_next(&cursors[heap[0]])) heap[0] = heap[--heap_size];
+            sift_down(heap, heap_size, cursors, 0);
+        }
+        if(occurrences == 1 && owner != KMER_SET_SHARED) ++w->counts[w->first_ids[owner_set] + owner - 1];
+        ++w->distinct;
+    }
+    for(uint32_t i=0; i<w->num_sets; ++i) free(cursors[i].data);
+    free(cursors);
+    free(heap);
+    return NULL;
+}
+
+// count the unique k-mers of every subcontig of the community made of sets, counts holds the subcontigs of the sets in order
+// returns the number of different k-mers
+uint64_t kmer_set_merge(kmer_set** sets, uint32_t num_sets, uint32_t num_threads, uint32_t* counts){
+    uint32_t* first_ids = calloc(num_sets + 1, sizeof(uint32_t));
+    for(uint32_t i=0; i<num_sets; ++i) first_ids[i+1] = first_ids[i] + sets[i]->num_subcontigs;
+    uint32_t num_subcontigs = first_ids[num_sets];
+    merge_worker* workers = calloc(num_threads, sizeof(merge_worker));
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    // hashes are spread evenly, so equal parts of the hash space are close to equal work
+    uint64_t step = UINT64_MAX / num_threads;
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].sets = sets;
+        workers[i].num_sets = num_sets;
+        workers[i].first_ids = first_ids;
+        workers[i].start = i * step;
+        workers[i].end = i + 1 < num_threads ? (i + 1) * step - 1 : UINT64_MAX;
+        workers[i].counts = calloc(num_subcontigs + 1, sizeof(uint32_t));
+        if(pthread_create(&threads[i], NULL, merge_range, &workers[i]) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint64_t distinct = 0;
+    memset(counts, 0, num_subcontigs * sizeof(uint32_t));
+    for(uint32_t i=0; i<num_threads; ++i){
+        pthread_join(threads[i], NULL);
+        for(uint32_t j=0; j<num_subcontigs; ++j) counts[j] += workers[i].counts[j];
+        distinct += workers[i].distinct;
+        free(workers[i].counts);
+    }
+    free(workers);
+    free(threads);
+    free(first_ids);
+    return distinct;
+}
+
+// subcontig writes <strain>_<start>_<stop>.subcontig, so the strain is the file name up to the second to last _
+static char* file_strain(const char* file_name){
+    char* strain = strdup(file_name);
+    for(int i=0; i<2; ++i){
+        char* separator = strrchr(strain, '_');
+        if(separator != NULL) *separator = '\0';
+    }
+    return strain;
+}
+
+static uint32_t list_dir(char* dir_location, bool excluded, library_file** files, uint32_t num_files, uint32_t* capacity){
+    DIR* dr = opendir(dir_location);
+    if(dr == NULL){
+        fprintf(stderr, "Could not open subcontigs directory\n\n");
+        exit(EXIT_FAILURE);
+    }
+    struct dirent* de;
+    while((de = readdir(dr)) != NULL){
+        if(!(strlen(de->d_name) >= 10 && strcmp(&de->d_name[strlen(de->d_name) - 10], ".subcontig") == 0)) continue;
+        if(num_files == *capacity){
+            *capacity *= 2;
+            *files = realloc(*files, *capacity * sizeof(library_file));
+        }
+        library_file* file = &(*files)[num_files++];
+        file->location = calloc(strlen(dir_location) + strlen(de->d_name) + 2, sizeof(char));
+        sprintf(file->location, "%s%s%s", dir_location, dir_location[strlen(dir_location)-1] == '/' ? "" : "/", de->d_name);
+        file->strain = file_strain(de->d_name);
+        file->excluded = excluded;
+    }
+    closedir(dr);
+    return num_files;
+}
+
+// files of a strain together, excluded subcontigs first, in name order, so the subcontigs of a genome always get the same ids
+static int compare_files(const void* a, const void* b){
+    const library_file* x = (const library_file*) a;
+    const library_file* y = (const library_file*) b;
+    int order = strcmp(x->strain, y->strain);
+    if(order != 0) return order;
+    if(x->excluded != y->excluded) return x->excluded ? -1 : 1;
+    return strcmp(x->location, y->location);
+}
+
+// open the set of every genome with subcontigs in the two directories, hashing and writing the sets the library does not have
+kmer_set** kmer_library_sets(char* library_location, char* exc_dir_location, char* dir_location, uint32_t kmer_size,
+                             uint32_t num_threads, uint32_t* num_sets, kmer_library_stats* stats){
+    uint32_t capacity = 1024;
+    library_file* files = malloc(capacity * sizeof(library_file));
+    uint32_t num_files = list_dir(exc_dir_location, true, &files, 0, &capacity);
+    num_files = list_dir(dir_location, false, &files, num_files, &capacity);
+    qsort(files, num_files, sizeof(library_file), compare_files);
+    memset(stats, 0, sizeof(kmer_library_stats));
+
+    uint32_t sets_capacity = 64;
+    kmer_set** sets = malloc(sets_capacity * sizeof(kmer_set*));
+    *num_sets = 0;
+    uint32_t slots_capacity = 64;
+    subcontig_slot* slots = calloc(slots_capacity, sizeof(subcontig_slot));
+    uint32_t start = 0;
+    while(start < num_files){
+        uint32_t end = start + 1;
+        while(end < num_files && strcmp(files[end].strain, files[start].strain) == 0) ++end;
+        if(end - start > slots_capacity){
+            slots = realloc(slots, (end - start) * sizeof(subcontig_slot));
+            memset(&slots[slots_capacity], 0, (end - start - slots_capacity) * sizeof(subcontig_slot));
+            slots_capacity = end - start;
+        }
+        // the digest covers everything the set depends on
+        uint64_t digest = (uint64_t) HASH_SEED ^ kmer_size;
+        for(uint32_t i=start; i<end; ++i){
+            subcontig_slot* slot = &slots[i-start];
+            subcontig_read_file(files[i].location, slot);
+            digest = MurmurHash64A(slot->name, strlen(slot->name), digest);
+            digest = MurmurHash64A(slot->seq, slot->len, digest + files[i].excluded);
+            stats->bytes_read += slot->len;
+        }
+        char* set_location = calloc(strlen(library_location) + strlen(files[start].strain) + 64, sizeof(char));
+        sprintf(set_location, "%s/%s.%016lx.kset", library_location, files[start].strain, digest);
+        if(access(set_location, R_OK) == 0){
+            ++stats->sets_reused;
+        }else{
+            kmer_sorter* sorter = kmer_sorter_create(kmer_size, end - start, num_threads);
+            for(uint32_t i=start; i<end; ++i){
+                kmer_sorter_add_subcontig(sorter, slots[i-start].name, slots[i-start].seq, slots[i-start].len, files[i].excluded);
+            }
+            kmer_sorter_sort(sorter);
+            stats->kmers_hashed += sorter->num_records;
+            // written under a name of its own and renamed once complete, so runs sharing the library never see half a set
+            char* partial_location = calloc(strlen(set_location) + 32, sizeof(char));
+            sprintf(partial_location, "%s.%d.partial", set_location, getpid());
+            if(!kmer_set_write(sorter, partial_location) || rename(partial_location, set_location) != 0){
+                fprintf(stderr, "Error: failed to write k-mer set %s\n", set_location);
+                exit(EXIT_FAILURE);
+            }
+            free(partial_location);
+            kmer_sorter_destroy(sorter);
+            ++stats->sets_built;
+        }
+        for(uint32_t i=start; i<end; ++i){
+            free(slots[i-start].name);
+            slots[i-start].name = NULL;
+        }
+        if(*num_sets == sets_capacity){
+            sets_capacity *= 2;
+            sets = realloc(sets, sets_capacity * sizeof(kmer_set*));
+        }
+        if((sets[(*num_sets)++] = kmer_set_open(set_location)) == NULL) exit(EXIT_FAILURE);
+        if(sets[*num_sets - 1]->kmer_size != kmer_size){
+            fprintf(stderr, "Error: k-mer set %s has a k-mer size of %d\n", set_location, sets[*num_sets - 1]->kmer_size);
+            exit(EXIT_FAILURE);
+        }
+        free(set_location);
+        start = end;
+    }
+
+    for(uint32_t i=0; i<slots_capacity; ++i) free(slots[i].seq);
+    free(slots);
+    for(uint32_t i=0; i<num_files; ++i){
+        free(files[i].location);
+        free(files[i].strain);
+    }
+    free(files);
+    return sets;
+}
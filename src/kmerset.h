@@ -0,0 +1,74 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kmersort.h"
+
+#define KMER_SET_MAGIC "SR2KSET1"
+#define KMER_SET_BLOCK 4096 // records per block, a merge can start reading a set at the start of any block
+#define KMER_SET_SHARED 0 // owner of a k-mer that occurs more than once in the genome or in an excluded subcontig
+
+/*
+ * A k-mer set holds every canonical k-mer hash of one genome's subcontigs, sorted, with the subcontig that owns it
+ * Sets are kept in a library directory shared by every community built from the same genomes, named
+ * <strain>.<digest>.kset where the digest covers the k-mer size and the names and sequences of the genome's subcontigs,
+ * so a set is reused exactly when its genome was cut into the same subcontigs (same -s and -e of PreProcessR)
+ * KmerContent.report of a community is then a merge of its genomes' sets: a k-mer is unique when one set has it and its owner
+ * there is a subcontig, the same rule as the hashtable and sort engines
+ * Layout: magic (8 bytes) | kmer_size (u32) | num_subcontigs (u32) | num_records (u64) | num_blocks (u32)
+ *         num_subcontigs NUL-terminated subcontig names, the position of a name is the subcontig's id in the set
+ *         num_blocks first hashes (u64) | num_blocks + 1 offsets (u64) of the blocks from the start of the data
+ *         the blocks, each KMER_SET_BLOCK records (the last one fewer) of the hash's difference from the one before (the first
+ *         from the block's first hash) and the owner (id + 1, or KMER_SET_SHARED), both as LEB128 varints
+ */
+
+typedef struct kmer_set{
+    char** subcontig_names;
+    uint64_t* block_hashes; // first hash of every block
+    uint64_t* block_offsets;
+    uint64_t num_records;
+    uint64_t data_start; // position of the first block in the file
+    uint32_t num_blocks;
+    uint32_t num_subcontigs;
+    uint32_t kmer_size;
+    int fd; // blocks are read with pread, so every merge thread can read the same set
+} kmer_set;
+
+typedef struct kmer_set_cursor{
+    kmer_set* set;
+    uint8_t* data; // the block being read
+    uint64_t data_capacity;
+    uint64_t position; // next byte of data
+    uint32_t block;
+    uint32_t remaining; // records of the block not read yet
+    uint64_t hash; // the record the cursor is on
+    uint32_t owner;
+} kmer_set_cursor;
+
+typedef struct merge_worker{
+    kmer_set** sets;
+    uint32_t num_sets;
+    uint32_t* first_ids; // id in the community of the first subcontig of every set
+    uint64_t start; // hashes from start up to and including end are merged by this worker
+    uint64_t end;
+    uint32_t* counts;
+    uint64_t distinct;
+} merge_worker;
+
+typedef struct kmer_library_stats{
+    uint32_t sets_built;
+    uint32_t sets_reused;
+    uint64_t kmers_hashed; // k-mers of the genomes whose sets were built
+    uint64_t bytes_read; // subcontig sequence read
+} kmer_library_stats;
+
+bool kmer_set_write(kmer_sorter* sorter, char* set_location);
+kmer_set* kmer_set_open(char* set_location);
+void kmer_set_close(kmer_set* set);
+kmer_set** kmer_library_sets(char* library_location, char* exc_dir_location, char* dir_location, uint32_t kmer_size,
+                             uint32_t num_threads, uint32_t* num_sets, kmer_library_stats* stats);
+uint64_t kmer_set_merge(kmer_set** sets, uint32_t num_sets, uint32_t num_threads, uint32_t* counts);
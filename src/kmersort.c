@@ -0,0 +1,334 @@
+#include "kmersort.h"
+
+/*
+ * Sort-based k-mer uniqueness engine (hashcounter -a sort)
+ * Subcontigs are collected in batches and their k-mers hashed into records by several threads at once, the records are then
+ * radix sorted 8 bits at a time from the lowest byte of the hash up
+ * Each radix pass has every thread count the buckets of its slice of the records, the counts are turned into the slice's
+ * starting position in each bucket, and every thread scatters its slice through one cache line of records per bucket so
+ * writes to the destination go out a whole line at a time
+ */
+
+// start num_threads threads running func, each on its own element of workers, and wait for all of them
+static void run_workers(void* (*func)(void*), void* workers, size_t worker_size, uint32_t num_threads){
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    for(uint32_t i=0; i<num_threads; ++i){
+        if(pthread_create(&threads[i], NULL, func, (char*) workers + i*worker_size) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(uint32_t i=0; i<num_threads; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+static subcontig_batch* subcontig_batch_create(){
+    subcontig_batch* batch = malloc(sizeof(subcontig_batch));
+    batch->seqs = calloc(SUBCONTIG_BATCH_SIZE, sizeof(char*));
+    batch->lens = calloc(SUBCONTIG_BATCH_SIZE, sizeof(uint32_t));
+    batch->capacity = calloc(SUBCONTIG_BATCH_SIZE, sizeof(uint32_t));
+    batch->ids = calloc(SUBCONTIG_BATCH_SIZE, sizeof(uint32_t));
+    batch->excluded = calloc(SUBCONTIG_BATCH_SIZE, sizeof(uint32_t));
+    batch->count = 0;
+    return batch;
+}
+
+static void subcontig_batch_destroy(subcontig_batch* batch){
+    for(uint32_t i=0; i<SUBCONTIG_BATCH_SIZE; ++i) free(batch->seqs[i]);
+    free(batch->seqs);
+    free(batch->lens);
+    free(batch->capacity);
+    free(batch->ids);
+    free(batch->excluded);
+    free(batch);
+}
+
+kmer_sorter* kmer_sorter_create(uint32_t kmer_size, uint32_t num_subconts, uint32_t num_threads){
+    kmer_sorter* sorter = malloc(sizeof(kmer_sorter));
+    sorter->records_capacity = INITIAL_RECORDS_CAPACITY;
+    sorter->records = malloc(sorter->records_capacity * sizeof(kmer_record));
+    sorter->num_records = 0;
+    sorter->batch = subcontig_batch_create();
+    sorter->workers = calloc(num_threads, sizeof(record_worker));
+    for(uint32_t i=0; i<num_threads; ++i) sorter->workers[i].sorter = sorter;
+    sorter->registry = subcontig_registry_create(num_subconts);
+    sorter->subcontig_counts = calloc(num_subconts, sizeof(uint32_t));
+    sorter->subcontigs_capacity = num_subconts;
+    sorter->curr_subcontig = 0;
+    sorter->bases_added = 0;
+    sorter->kmer_size = kmer_size;
+    sorter->num_threads = num_threads;
+    sorter->count = 0;
+    return sorter;
+}
+
+void kmer_sorter_destroy(kmer_sorter* sorter){
+    for(uint32_t i=0; i<sorter->num_threads; ++i) free(sorter->workers[i].hashes);
+    free(sorter->workers);
+    subcontig_batch_destroy(sorter->batch);
+    subcontig_registry_destroy(sorter->registry);
+    free(sorter->subcontig_counts);
+    free(sorter->records);
+    free(sorter);
+}
+
+// thread function hashing a slice of a batch into records
+// the order of records does not matter before sorting, so each subcontig's records go wherever the shared count points
+static void* add_records(void* worker){
+    record_worker* w = (record_worker*) worker;
+    subcontig_batch* batch = w->sorter->batch;
+    for(uint32_t i=w->start; i<w->end; ++i){
+        if(batch->lens[i] > w->hashes_capacity){
+            w->hashes_capacity = batch->lens[i];
+            w->hashes = realloc(w->hashes, w->hashes_capacity * sizeof(uint64_t));
+        }
+        uint32_t num_hashes = hash_canonical_kmers(batch->seqs[i], batch->lens[i], w->sorter->kmer_size, w->hashes);
+        uint64_t first = __atomic_fetch_add(&w->sorter->num_records, num_hashes, __ATOMIC_RELAXED);
+        kmer_record* records = &w->sorter->records[first];
+        for(uint32_t j=0; j<num_hashes; ++j){
+            records[j].hash = w->hashes[j];
+            records[j].subcontig_id = batch->ids[i];
+            records[j].excluded = batch->excluded[i];
+        }
+    }
+    return NULL;
+}
+
+// hash every subcontig waiting in the batch into records
+static void add_batch(kmer_sorter* sorter){
+    subcontig_batch* batch = sorter->batch;
+    record_worker* workers = sorter->workers;
+    // make room for every k-mer the batch could have before the threads start writing
+    uint64_t max_records = 0;
+    for(uint32_t i=0; i<batch->count; ++i){
+        if(batch->lens[i] >= sorter->kmer_size) max_records += batch->lens[i] - sorter->kmer_size + 1;
+    }
+    if(sorter->num_records + max_records > sorter->records_capacity){
+        while(sorter->num_records + max_records > sorter->records_capacity) sorter->records_capacity *= 2;
+        sorter->records = realloc(sorter->records, sorter->records_capacity * sizeof(kmer_record));
+        if(sorter->records == NULL){
+            fprintf(stderr, "Error: not enough memory for %ld k-mer records\n", sorter->records_capacity);
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint32_t slice = (batch->count + sorter->num_threads - 1) / sorter->num_threads;
+    for(uint32_t i=0; i<sorter->num_threads; ++i){
+        workers[i].start = i*slice < batch->count ? i*slice : batch->count;
+        workers[i].end = (i+1)*slice < batch->count ? (i+1)*slice : batch->count;
+    }
+    run_workers(add_records, workers, sizeof(record_worker), sorter->num_threads);
+    batch->count = 0;
+}
+
+// give a subcontig the next id and queue it to be hashed into records, name is copied into the registry, returns the id
+uint32_t kmer_sorter_add_subcontig(kmer_sorter* sorter, const char* name, char* seq, uint32_t seq_len, bool excluded){
+    if(sorter->curr_subcontig == sorter->subcontigs_capacity){
+        sorter->subcontigs_capacity *= 2;
+        sorter->subcontig_counts = realloc(sorter->subcontig_counts, sorter->subcontigs_capacity * sizeof(uint32_t));
+    }
+    uint32_t subcontig_id = sorter->curr_subcontig++;
+    subcontig_registry_add(sorter->registry, name);
+    sorter->subcontig_counts[subcontig_id] = 0;
+
+    subcontig_batch* batch = sorter->batch;
+    if(seq_len + 1 > batch->capacity[batch->count]){
+        batch->capacity[batch->count] = seq_len + 1;
+        batch->seqs[batch->count] = realloc(batch->seqs[batch->count], batch->capacity[batch->count]);
+    }
+    memcpy(batch->seqs[batch->count], seq, seq_len);
+    batch->seqs[batch->count][seq_len] = '\0';
+    batch->lens[batch->count] = seq_len;
+    batch->ids[batch->count] = subcontig_id;
+    batch->excluded[batch->count] = excluded;
+    ++batch->count;
+    sorter->bases_added += seq_len;
+    if(batch->count == SUBCONTIG_BATCH_SIZE) add_batch(sorter);
+    return subcontig_id;
+}
+
+// add a record for every k-mer of every subcontig in a directory
+void kmer_sorter_add_dir(kmer_sorter* sorter, char* dir_location, bool excluded, read_ahead_options* read_ahead){
+    subcontig_reader* reader = subcontig_reader_open(dir_location, read_ahead);
+    subcontig_slot* slot;
+    while((slot = subcontig_reader_next(reader)) != NULL){
+        kmer_sorter_add_subcontig(sorter, slot->name, slot->seq, slot->len, excluded);
+    }
+    subcontig_reader_close(reader);
+    // hash what is left so the directory's k-mers are all records (and their time spent) when this returns
+    if(sorter->batch->count > 0) add_batch(sorter);
+}
+
+// thread function counting how many records of a slice fall in each bucket of the current pass
+static void* radix_histogram(void* worker){
+    radix_worker* w = (radix_worker*) worker;
+    memset(w->offsets, 0, sizeof(w->offsets));
+    for(uint64_t i=w->start; i<w->end; ++i){
+        ++w->offsets[(w->src[i].hash >> w->shift) & (RADIX_BUCKETS-1)];
+    }
+    return NULL;
+}
+
+// thread function moving a slice of records to its positions in dst, keeping the order of records within a bucket
+static void* radix_scatter(void* worker){
+    radix_worker* w = (radix_worker*) worker;
+    kmer_record* lines = malloc(RADIX_BUCKETS * RADIX_LINE * sizeof(kmer_record));
+    uint32_t filled[RADIX_BUCKETS] = {0};
+    for(uint64_t i=w->start; i<w->end; ++i){
+        uint32_t bucket = (w->src[i].hash >> w->shift) & (RADIX_BUCKETS-1);
+        lines[bucket*RADIX_LINE + filled[bucket]] = w->src[i];
+        if(++filled[bucket] == RADIX_LINE){
+            memcpy(&w->dst[w->offsets[bucket]], &lines[bucket*RADIX_LINE], RADIX_LINE * sizeof(kmer_record));
+            w->offsets[bucket] += RADIX_LINE;
+            filled[bucket] = 0;
+        }
+    }
+    for(uint32_t bucket=0; bucket<RADIX_BUCKETS; ++bucket){
+        memcpy(&w->dst[w->offsets[bucket]], &lines[bucket*RADIX_LINE], filled[bucket] * sizeof(kmer_record));
+    }
+    free(lines);
+    return NULL;
+}
+
+// sort the records by hash
+void kmer_sorter_sort(kmer_sorter* sorter){
+    if(sorter->batch->count > 0) add_batch(sorter);
+    uint64_t num_records = sorter->num_records;
+    if(num_records == 0) return;
+    uint32_t num_threads = sorter->num_threads;
+    table_placement placement;
+    kmer_record* buffer = (kmer_record*) table_alloc(num_records * sizeof(kmer_record), num_threads, &placement);
+    radix_worker* workers = calloc(num_threads, sizeof(radix_worker));
+    uint64_t slice = (num_records + num_threads - 1) / num_threads;
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].start = i*slice < num_records ? i*slice : num_records;
+        workers[i].end = (i+1)*slice < num_records ? (i+1)*slice : num_records;
+    }
+
+    kmer_record* src = sorter->records;
+    kmer_record* dst = buffer;
+    for(uint32_t pass=0; pass<RADIX_PASSES; ++pass){
+        for(uint32_t i=0; i<num_threads; ++i){
+            workers[i].src = src;
+            workers[i].dst = dst;
+            workers[i].shift = pass * RADIX_BITS;
+        }
+        run_workers(radix_histogram, workers, sizeof(radix_worker), num_threads);
+        // bucket by bucket, each slice's part of a bucket follows the part of the slice before it
+        uint64_t position = 0;
+        for(uint32_t bucket=0; bucket<RADIX_BUCKETS; ++bucket){
+            for(uint32_t i=0; i<num_threads; ++i){
+                uint64_t bucket_size = workers[i].offsets[bucket];
+                workers[i].offsets[bucket] = position;
+                position += bucket_size;
+            }
+        }
+        run_workers(radix_scatter, workers, sizeof(radix_worker), num_threads);
+        kmer_record* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    free(workers);
+    table_free(buffer, num_records * sizeof(kmer_record));
+}
+
+// move position forward to the start of the next run of equal hashes if it is inside a run
+static uint64_t run_start(kmer_record* records, uint64_t num_records, uint64_t position){
+    while(position > 0 && position < num_records && records[position].hash == records[position-1].hash) ++position;
+    return position;
+}
+
+// thread function counting the unique k-mers of each subcontig in a slice of sorted records
+static void* scan_runs(void* worker){
+    scan_worker* w = (scan_worker*) worker;
+    uint64_t i = w->start;
+    while(i < w->end){
+        uint64_t j = i + 1;
+        while(j < w->end && w->records[j].hash == w->records[i].hash) ++j;
+        if(j == i + 1 && !w->records[i].excluded) ++w->counts[w->records[i].subcontig_id];
+        ++w->distinct;
+        i = j;
+    }
+    return NULL;
+}
+
+// count the unique k-mers of every subcontig, the records must be sorted
+void kmer_sorter_count(kmer_sorter* sorter){
+    uint32_t num_threads = sorter->num_threads;
+    scan_worker* workers = calloc(num_threads, sizeof(scan_worker));
+    uint64_t slice = (sorter->num_records + num_threads - 1) / num_threads;
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].records = sorter->records;
+        workers[i].start = run_start(sorter->records, sorter->num_records, i*slice < sorter->num_records ? i*slice : sorter->num_records);
+        workers[i].counts = calloc(sorter->curr_subcontig, sizeof(uint32_t));
+    }
+    // slices start at the beginning of a run, so no run is split between two threads
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].end = i+1 < num_threads ? workers[i+1].start : sorter->num_records;
+    }
+    run_workers(scan_runs, workers, sizeof(scan_worker), num_threads);
+
+    sorter->count = 0;
+    memset(sorter->subcontig_counts, 0, sorter->curr_subcontig * sizeof(uint32_t));
+    for(uint32_t i=0; i<num_threads; ++i){
+        for(uint32_t j=0; j<sorter->curr_subcontig; ++j) sorter->subcontig_counts[j] += workers[i].counts[j];
+        sorter->count += workers[i].distinct;
+        free(workers[i].counts);
+    }
+    free(workers);
+}
+
+// return the sum of all unique k-mers
+uint64_t kmer_sorter_unique_total(kmer_sorter* sorter){
+    uint64_t sum = 0;
+    for(uint32_t i=0; i<sorter->curr_subcontig; ++i){
+        sum += sorter->subcontig_counts[i];
+    }
+    return sum;
+}
+
+// return the first record of hash and the number of records it has, or NULL if it has none, the records must be sorted
+kmer_record* kmer_sorter_find(kmer_sorter* sorter, uint64_t hash, uint64_t* run_length){
+    uint64_t low = 0;
+    uint64_t high = sorter->num_records;
+    while(low < high){
+        uint64_t middle = low + (high - low) / 2;
+        if(sorter->records[middle].hash < hash){
+            low = middle + 1;
+        }else{
+            high = middle;
+        }
+    }
+    uint64_t end = low;
+    while(end < sorter->num_records && sorter->records[end].hash == hash) ++end;
+    *run_length = end - low;
+    return end > low ? &sorter->records[low] : NULL;
+}
+
+// write every unique k-mer and the subcontig it belongs to for use by readcounter, the k-mers are written in hash order
+void kmer_sorter_write_unique_kmers(kmer_sorter* sorter, char* index_location){
+    FILE* index = kmer_index_open_write(index_location, sorter->kmer_size, subcontig_registry_index_name, sorter->registry,
+                                        sorter->curr_subcontig, kmer_sorter_unique_total(sorter));
+    kmer_record* records = sorter->records;
+    uint64_t i = 0;
+    while(i < sorter->num_records){
+        uint64_t j = i + 1;
+        while(j < sorter->num_records && records[j].hash == records[i].hash) ++j;
+        if(j == i + 1 && !records[i].excluded) kmer_index_write_kmer(index, records[i].hash, records[i].subcontig_id);
+        i = j;
+    }
+    fclose(index);
+}
+
+// write every k-mer of the subcontigs and excluded subcontigs, unique or not, for readcounter to filter reads with
+bool kmer_sorter_write_kmer_filter(kmer_sorter* sorter, char* filter_location){
+    kmer_filter* filter = kmer_filter_create(sorter->kmer_size, sorter->count);
+    for(uint64_t i=0; i<sorter->num_records; ++i){
+        if(i == 0 || sorter->records[i].hash != sorter->records[i-1].hash) kmer_filter_add(filter, sorter->records[i].hash);
+    }
+    bool written = kmer_filter_write(filter, filter_location);
+    kmer_filter_destroy(filter);
+    return written;
+}
@@ -0,0 +1,96 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "kmerfilter.h"
+#include "kmerindex.h"
+#include "kmers.h"
+#include "subcontigreader.h"
+#include "subcontigregistry.h"
+#include "tablealloc.h"
+
+#define SUBCONTIG_BATCH_SIZE 4096 // subcontigs read in before being hashed by the threads
+#define INITIAL_RECORDS_CAPACITY 16777216 // 2^24 records, grows by doubling
+#define RADIX_BITS 8 // bits of the hash sorted on per pass
+#define RADIX_BUCKETS 256 // 2^RADIX_BITS
+#define RADIX_PASSES 8 // 64 / RADIX_BITS, even so the sorted records end up back in the original array
+#define RADIX_LINE 4 // records buffered per bucket before they are written out together, 4 records fill one 64 byte cache line
+
+/*
+ * Sort-based alternative to the hashtable (hashtable.c)
+ * Every k-mer of every subcontig becomes a (hash, subcontig id, excluded) record, the records are sorted by hash with a parallel
+ * LSD radix sort and uniqueness is resolved in a single linear scan of the runs of equal hashes
+ * A k-mer is unique exactly when its run has one record and that record is not excluded, which is the same rule the hashtable
+ * follows (a second occurrence anywhere, even in the same subcontig, makes a k-mer non-unique), so both give the same counts
+ * Every pass streams through memory instead of probing it at random, at the cost of holding every k-mer occurrence twice
+ */
+
+typedef struct kmer_record{
+    uint64_t hash;
+    uint32_t subcontig_id;
+    uint32_t excluded; // 1 if the k-mer comes from an excluded subcontig
+} kmer_record;
+
+typedef struct subcontig_batch{
+    char** seqs;
+    uint32_t* lens;
+    uint32_t* capacity;
+    uint32_t* ids;
+    uint32_t* excluded;
+    uint32_t count;
+} subcontig_batch;
+
+typedef struct record_worker{
+    struct kmer_sorter* sorter;
+    uint64_t* hashes;
+    uint32_t hashes_capacity;
+    uint32_t start;
+    uint32_t end;
+} record_worker;
+
+typedef struct kmer_sorter{
+    kmer_record* records;
+    uint64_t num_records;
+    uint64_t records_capacity;
+    subcontig_batch* batch; // subcontigs waiting to be hashed into records
+    record_worker* workers;
+    subcontig_registry* registry;
+    uint32_t* subcontig_counts;
+    uint32_t subcontigs_capacity;
+    uint32_t curr_subcontig; // number of subcontigs added so far
+    uint64_t bases_added;
+    uint32_t kmer_size;
+    uint32_t num_threads;
+    uint64_t count; // number of different k-mers, set by kmer_sorter_count
+} kmer_sorter;
+
+typedef struct radix_worker{
+    kmer_record* src;
+    kmer_record* dst;
+    uint64_t start;
+    uint64_t end;
+    uint32_t shift;
+    uint64_t offsets[RADIX_BUCKETS]; // size of each bucket in the slice, then where the slice's part of each bucket starts in dst
+} radix_worker;
+
+typedef struct scan_worker{
+    kmer_record* records;
+    uint64_t start; // first record of a run of equal hashes
+    uint64_t end;
+    uint32_t* counts;
+    uint64_t distinct;
+} scan_worker;
+
+kmer_sorter* kmer_sorter_create(uint32_t kmer_size, uint32_t num_subconts, uint32_t num_threads);
+void kmer_sorter_destroy(kmer_sorter* sorter);
+uint32_t kmer_sorter_add_subcontig(kmer_sorter* sorter, const char* name, char* seq, uint32_t seq_len, bool excluded);
+void kmer_sorter_add_dir(kmer_sorter* sorter, char* dir_location, bool excluded, read_ahead_options* read_ahead);
+void kmer_sorter_sort(kmer_sorter* sorter);
+void kmer_sorter_count(kmer_sorter* sorter);
+kmer_record* kmer_sorter_find(kmer_sorter* sorter, uint64_t hash, uint64_t* run_length);
+uint64_t kmer_sorter_unique_total(kmer_sorter* sorter);
+void kmer_sorter_write_unique_kmers(kmer_sorter* sorter, char* index_location);
+bool kmer_sorter_write_kmer_filter(kmer_sorter* sorter, char* filter_location);
@@ -0,0 +1,158 @@
+#include "readcounter.h"
+
+/*
+ * Early stopping for readcounter -e
+ * At checkpoints that double in read pairs counted, the abundance of every strain is estimated from the counts so far as
+ * Plot.R estimates it: the weighted percentile (weighted by unique k-mers) of the FUKMs of the strain's subcontigs left after
+ * the subcontig filter. Counting stops at the first checkpoint where no strain's estimate moved by more than the tolerance
+ * (relative to its previous estimate) since the checkpoint before, and the counts so far are written as if the reads had ended
+ */
+
+typedef struct subcontig_strain{
+    const char* name;
+    uint32_t id;
+} subcontig_strain;
+
+// strain of a subcontig is its name up to the first ;
+static int compare_strains(const void* a, const void* b){
+    const char* x = ((subcontig_strain*) a)->name;
+    const char* y = ((subcontig_strain*) b)->name;
+    size_t x_len = strcspn(x, ";");
+    size_t y_len = strcspn(y, ";");
+    int order = strncmp(x, y, x_len < y_len ? x_len : y_len);
+    if(order != 0) return order;
+    if(x_len != y_len) return x_len < y_len ? -1 : 1;
+    return ((subcontig_strain*) a)->id < ((subcontig_strain*) b)->id ? -1 : 1;
+}
+
+static int compare_doubles(const void* a, const void* b){
+    double x = *(double*) a;
+    double y = *(double*) b;
+    return x < y ? -1 : x > y;
+}
+
+// excluded subcontigs are left out of KmerContent.report by PreProcessR, so Plot.R never sees them
+static inline bool excluded_subcontig(const char* name){
+    const char* contig = strchr(name, ';');
+    return contig != NULL && strncmp(contig + 1, "EXCLUDED_", strlen("EXCLUDED_")) == 0;
+}
+
+// group the subcontigs of the index by strain and apply the subcontig filter, which only depends on unique k-mers
+early_stop* early_stop_create(kmer_index* index, double tolerance, double weighted_percentile, double subcontig_filter,
+                              uint64_t first_checkpoint, char* progress_location){
+    early_stop* stop = calloc(1, sizeof(early_stop));
+    stop->progress = fopen(progress_location, "w");
+    if(stop->progress == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", progress_location);
+        free(stop);
+        return NULL;
+    }
+    fprintf(stop->progress, "Checkpoint\tRead_Pairs\tInput_Fraction\tStrains\tStrains_Changed\tMax_Relative_Change\n");
+    stop->tolerance = tolerance;
+    stop->weighted_percentile = weighted_percentile;
+    stop->next_checkpoint = first_checkpoint;
+    stop->unique_kmers = calloc(index->num_subcontigs, sizeof(uint64_t));
+    for(uint64_t i=0; i<index->size; ++i){
+        if(index->items[i].subcontig_id != KMER_INDEX_NONE) ++stop->unique_kmers[index->items[i].subcontig_id];
+    }
+
+    subcontig_strain* strains = calloc(index->num_subcontigs, sizeof(subcontig_strain));
+    uint32_t num_kept = 0;
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        if(excluded_subcontig(index->subcontig_names[i])) continue;
+        strains[num_kept].name = index->subcontig_names[i];
+        strains[num_kept].id = i;
+        ++num_kept;
+    }
+    qsort(strains, num_kept, sizeof(subcontig_strain), compare_strains);
+
+    stop->members = calloc(num_kept + 1, sizeof(uint32_t));
+    stop->strain_starts = calloc(num_kept + 1, sizeof(uint32_t));
+    double* sorted_kmers = calloc(num_kept + 1, sizeof(double));
+    uint32_t start = 0;
+    while(start < num_kept){
+        uint32_t end = start + 1;
+        while(end < num_kept && strcspn(strains[end].name, ";") == strcspn(strains[start].name, ";") &&
+              strncmp(strains[end].name, strains[start].name, strcspn(strains[start].name, ";")) == 0) ++end;
+        // subcontigs with fewer unique k-mers than the filter's quantile of the strain are left out, as Plot.R -s does
+        for(uint32_t i=start; i<end; ++i) sorted_kmers[i-start] = stop->unique_kmers[strains[i].id];
+        qsort(sorted_kmers, end - start, sizeof(double), compare_doubles);
+        double threshold = quantile(sorted_kmers, end - start, subcontig_filter / 100);
+        stop->strain_starts[stop->num_strains] = stop->num_members;
+        for(uint32_t i=start; i<end; ++i){
+            if(stop->unique_kmers[strains[i].id] >= threshold) stop->members[stop->num_members++] = strains[i].id;
+        }
+        ++stop->num_strains;
+        start = end;
+    }
+    stop->strain_starts[stop->num_strains] = stop->num_members;
+    stop->abundances = calloc(stop->num_strains + 1, sizeof(double));
+    stop->values = calloc(stop->num_members + 1, sizeof(weighted_value));
+    free(sorted_kmers);
+    free(strains);
+    return stop;
+}
+
+void early_stop_destroy(early_stop* stop){
+    fclose(stop->progress);
+    free(stop->unique_kmers);
+    free(stop->members);
+    free(stop->strain_starts);
+    free(stop->abundances);
+    free(stop->values);
+    free(stop);
+}
+
+// weighted percentile of a strain's FUKMs, 0 when nothing has been assigned yet
+static double strain_abundance(early_stop* stop, uint32_t strain, uint64_t* frags, uint64_t assigned){
+    weighted_value* values = stop->values;
+    uint32_t count = 0;
+    for(uint32_t i=stop->strain_starts[strain]; i<stop->strain_starts[strain+1]; ++i){
+        uint32_t id = stop->members[i];
+        // subcontigs without unique k-mers have no weight, the percentile never lands on them
+        if(stop->unique_kmers[id] == 0) continue;
+        values[count].value = frags[id] / (stop->unique_kmers[id] / 1e3) / (assigned * 2 / 1e6);
+        values[count].weight = stop->unique_kmers[id];
+        ++count;
+    }
+    if(count == 0 || assigned == 0) return 0;
+    return weighted_percentile(values, count, stop->weighted_percentile);
+}
+
+// estimate every strain's abundance from counts, returns true once no estimate changed by more than the tolerance since the last
+// checkpoint, input_fraction is the part of the input read so far or negative if it is not known
+bool early_stop_checkpoint(early_stop* stop, fragment_counts* counts, double input_fraction){
+    uint32_t changed = 0;
+    double max_change = 0;
+    for(uint32_t strain=0; strain<stop->num_strains; ++strain){
+        double abundance = strain_abundance(stop, strain, counts->frags, counts->assigned);
+        double previous = stop->abundances[strain];
+        double change = previous == abundance ? 0 : previous == 0 ? INFINITY : fabs(abundance - previous) / previous;
+        if(change > stop->tolerance) ++changed;
+        if(change > max_change) max_change = change;
+        stop->abundances[strain] = abundance;
+    }
+    // the first checkpoint has nothing to compare to
+    bool converged = stop->checkpoints > 0 && changed == 0;
+    ++stop->checkpoints;
+    fprintf(stop->progress, "%d\t%ld\t", stop->checkpoints, counts->pairs);
+    if(input_fraction < 0){
+        fprintf(stop->progress, "NA\t");
+    }else{
+        fprintf(stop->progress, "%.4f\t", input_fraction);
+    }
+    fprintf(stop->progress, "%d\t%d\t", stop->num_strains, stop->checkpoints > 1 ? changed : stop->num_strains);
+    if(stop->checkpoints > 1){
+        fprintf(stop->progress, "%.6f\n", max_change);
+    }else{
+        fprintf(stop->progress, "NA\n");
+    }
+    fflush(stop->progress);
+    // batches can hold more pairs than a checkpoint, so the next one is at least double the pairs counted
+    while(stop->next_checkpoint <= counts->pairs) stop->next_checkpoint *= 2;
+    if(converged){
+        stop->converged = true;
+        stop->input_fraction = input_fraction;
+    }
+    return converged;
+}
@@ -0,0 +1,665 @@
+#include "readcounter.h"
+#include "kseq.h"
+
+/*
+ * Native alternative to mapping with BBMap for abundance estimation
+ * Every canonical k-mer of both reads in a pair is hashed the same way hashcounter hashes subcontigs and looked up in the
+ * unique k-mer table written by hashcounter -u
+ * A fragment is assigned to a subcontig when all of its unique k-mer hits belong to that subcontig, fragments hitting the
+ * unique k-mers of several subcontigs are tossed (as BBMap does with ambiguous=toss)
+ * Read pairs are read in batches which are split between threads, each thread keeps its own counts which are merged at the end
+ * With -f pairs are not counted but kept when every k-mer of both reads is in the reference filter written by hashcounter -f
+ * BBMap only maps a pair perfectly when both reads lie inside the reference, so the pairs dropped are pairs it could not map
+ */
+
+KSEQ_INIT(gzFile, gzread)
+
+read_batch* read_batch_create(){
+    read_batch* batch = malloc(sizeof(read_batch));
+    batch->forward = calloc(BATCH_SIZE, sizeof(char*));
+    batch->reverse = calloc(BATCH_SIZE, sizeof(char*));
+    batch->forward_lens = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->reverse_lens = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->forward_capacity = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->reverse_capacity = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->records = NULL;
+    batch->record_offsets = calloc(BATCH_SIZE + 1, sizeof(size_t));
+    batch->records_capacity = 0;
+    batch->keep = calloc(BATCH_SIZE, sizeof(bool));
+    batch->keep_records = false;
+    batch->count = 0;
+    return batch;
+}
+
+void read_batch_destroy(read_batch* batch){
+    for(uint32_t i=0; i<BATCH_SIZE; ++i){
+        free(batch->forward[i]);
+        free(batch->reverse[i]);
+    }
+    free(batch->forward);
+    free(batch->reverse);
+    free(batch->forward_lens);
+    free(batch->reverse_lens);
+    free(batch->forward_capacity);
+    free(batch->reverse_capacity);
+    free(batch->records);
+    free(batch->record_offsets);
+    free(batch->keep);
+    free(batch);
+}
+
+// copy a read into a batch slot, reusing the slot's buffer when it is large enough
+static inline void copy_read(char** slot, uint32_t* slot_len, uint32_t* slot_capacity, kseq_t* read){
+    if(read->seq.l + 1 > *slot_capacity){
+        *slot_capacity = read->seq.l + 1;
+        *slot = realloc(*slot, *slot_capacity);
+    }
+    memcpy(*slot, read->seq.s, read->seq.l + 1);
+    *slot_len = read->seq.l;
+}
+
+// append a read in FASTQ (or FASTA if it has no qualities) format to the batch's records
+static inline void append_record(read_batch* batch, kseq_t* read){
+    size_t needed = read->name.l + read->comment.l + read->seq.l + read->qual.l + 8;
+    size_t records_len = batch->record_offsets[batch->count+1];
+    if(records_len + needed > batch->records_capacity){
+        batch->records_capacity = (records_len + needed) * 2;
+        batch->records = realloc(batch->records, batch->records_capacity);
+    }
+    char* record = &batch->records[records_len];
+    if(read->qual.l > 0){
+        records_len += sprintf(record, "@%s%s%s\n%s\n+\n%s\n", read->name.s, read->comment.l > 0 ? " " : "", read->comment.l > 0 ?
+                               read->comment.s : "", read->seq.s, read->qual.s);
+    }else{
+        records_len += sprintf(record, ">%s%s%s\n%s\n", read->name.s, read->comment.l > 0 ? " " : "", read->comment.l > 0 ?
+                               read->comment.s : "", read->seq.s);
+    }
+    batch->record_offsets[batch->count+1] = records_len;
+}
+
+// fill a batch with up to BATCH_SIZE read pairs, returns the number of pairs read or -1 if the reads are not paired
+// forward and reverse are the same stream for interleaved reads
+static int32_t read_batch_fill(read_batch* batch, kseq_t* forward, kseq_t* reverse){
+    batch->count = 0;
+    while(batch->count < BATCH_SIZE){
+        batch->record_offsets[batch->count+1] = batch->record_offsets[batch->count];
+        int forward_status = kseq_read(forward);
+        if(forward_status >= 0){
+            copy_read(&batch->forward[batch->count], &batch->forward_lens[batch->count], &batch->forward_capacity[batch->count], forward);
+            if(batch->keep_records) append_record(batch, forward);
+        }
+        int reverse_status = kseq_read(reverse);
+        if(forward_status < 0 && reverse_status < 0) break;
+        if(forward_status < 0 || reverse_status < 0){
+            fprintf(stderr, "Error: forward and reverse reads are not paired (different number of reads or truncated file)\n");
+            return -1;
+        }
+        copy_read(&batch->reverse[batch->count], &batch->reverse_lens[batch->count], &batch->reverse_capacity[batch->count], reverse);
+        if(batch->keep_records) append_record(batch, reverse);
+        ++batch->count;
+    }
+    return batch->count;
+}
+
+fragment_counts* fragment_counts_create(uint32_t num_subcontigs){
+    fragment_counts* counts = malloc(sizeof(fragment_counts));
+    counts->frags = calloc(num_subcontigs, sizeof(uint64_t));
+    counts->bases = calloc(num_subcontigs, sizeof(uint64_t));
+    counts->pairs = 0;
+    counts->assigned = 0;
+    counts->ambiguous = 0;
+    counts->retained = 0;
+    counts->num_subcontigs = num_subcontigs;
+    return counts;
+}
+
+void fragment_counts_merge(fragment_counts* total, fragment_counts* counts){
+    for(uint32_t i=0; i<total->num_subcontigs; ++i){
+        total->frags[i] += counts->frags[i];
+        total->bases[i] += counts->bases[i];
+    }
+    total->pairs += counts->pairs;
+    total->assigned += counts->assigned;
+    total->ambiguous += counts->ambiguous;
+    total->retained += counts->retained;
+}
+
+void fragment_counts_destroy(fragment_counts* counts){
+    free(counts->frags);
+    free(counts->bases);
+    free(counts);
+}
+
+// look up the hashes of one read, returns false if the read hits more than one subcontig
+static inline bool lookup_read(kmer_index* index, uint64_t* hashes, uint32_t num_hashes, uint32_t* subcontig_id, uint32_t* hits){
+    for(uint32_t i=0; i<num_hashes; ++i){
+        uint32_t id = kmer_index_lookup(index, hashes[i]);
+        if(id == KMER_INDEX_NONE) continue;
+        if(*subcontig_id != KMER_INDEX_NONE && *subcontig_id != id) return false;
+        *subcontig_id = id;
+        ++*hits;
+    }
+    return true;
+}
+
+// returns the subcontig a read pair belongs to, KMER_INDEX_NONE if it has too few unique k-mer hits, or AMBIGUOUS_FRAGMENT
+// hashes is a scratch buffer that is grown as needed
+uint32_t assign_fragment(kmer_index* index, char* forward, uint32_t forward_len, char* reverse, uint32_t reverse_len, uint32_t min_hits,
+                         uint64_t** hashes, uint32_t* hashes_capacity){
+    uint32_t longest = forward_len > reverse_len ? forward_len : reverse_len;
+    if(longest > *hashes_capacity){
+        *hashes_capacity = longest;
+        *hashes = realloc(*hashes, longest * sizeof(uint64_t));
+    }
+    uint32_t subcontig_id = KMER_INDEX_NONE;
+    uint32_t hits = 0;
+    uint32_t num_hashes = hash_canonical_kmers(forward, forward_len, index->kmer_size, *hashes);
+    if(!lookup_read(index, *hashes, num_hashes, &subcontig_id, &hits)) return AMBIGUOUS_FRAGMENT;
+    num_hashes = hash_canonical_kmers(reverse, reverse_len, index->kmer_size, *hashes);
+    if(!lookup_read(index, *hashes, num_hashes, &subcontig_id, &hits)) return AMBIGUOUS_FRAGMENT;
+    if(hits < min_hits) return KMER_INDEX_NONE;
+    return subcontig_id;
+}
+
+// returns whether every k-mer of both reads of a pair is in the reference filter
+// the filter holds uppercased k-mers, so the reads are uppercased in place first and kept pairs are written uppercased
+bool in_reference(kmer_filter* filter, char* forward, uint32_t forward_len, char* reverse, uint32_t reverse_len, uint64_t** hashes,
+                  uint32_t* hashes_capacity){
+    uint32_t longest = forward_len > reverse_len ? forward_len : reverse_len;
+    if(longest > *hashes_capacity){
+        *hashes_capacity = longest;
+        *hashes = realloc(*hashes, longest * sizeof(uint64_t));
+    }
+    uppercase_bases(forward, forward_len);
+    uppercase_bases(reverse, reverse_len);
+    uint32_t num_hashes = hash_canonical_kmers(forward, forward_len, filter->kmer_size, *hashes);
+    for(uint32_t i=0; i<num_hashes; ++i){
+        if(!kmer_filter_contains(filter, (*hashes)[i])) return false;
+    }
+    num_hashes = hash_canonical_kmers(reverse, reverse_len, filter->kmer_size, *hashes);
+    for(uint32_t i=0; i<num_hashes; ++i){
+        if(!kmer_filter_contains(filter, (*hashes)[i])) return false;
+    }
+    return true;
+}
+
+// thread function marking which pairs in one slice of a batch lie inside the reference and are kept
+static void filter_batch(count_worker* w){
+    for(uint32_t i=w->start; i<w->end; ++i){
+        w->batch->keep[i] = in_reference(w->filter, w->batch->forward[i], w->batch->forward_lens[i], w->batch->reverse[i],
+                                         w->batch->reverse_lens[i], &w->hashes, &w->hashes_capacity);
+        ++w->counts->pairs;
+        w->counts->retained += w->batch->keep[i];
+    }
+}
+
+// thread function counting the fragments in one slice of a batch
+void* count_batch(void* worker){
+    count_worker* w = (count_worker*) worker;
+    if(w->batch->keep_records){
+        filter_batch(w);
+        return NULL;
+    }
+    for(uint32_t i=w->start; i<w->end; ++i){
+        uint32_t subcontig_id = assign_fragment(w->index, w->batch->forward[i], w->batch->forward_lens[i], w->batch->reverse[i],
+                                                w->batch->reverse_lens[i], w->min_hits, &w->hashes, &w->hashes_capacity);
+        ++w->counts->pairs;
+        if(subcontig_id == AMBIGUOUS_FRAGMENT){
+            ++w->counts->ambiguous;
+        }else if(subcontig_id != KMER_INDEX_NONE){
+            ++w->counts->assigned;
+            ++w->counts->frags[subcontig_id];
+            w->counts->bases[subcontig_id] += w->batch->forward_lens[i] + w->batch->reverse_lens[i];
+        }
+    }
+    return NULL;
+}
+
+// "-" reads from standard input
+static inline gzFile open_reads(char* location){
+    return strcmp(location, "-") == 0 ? gzdopen(fileno(stdin), "r") : gzopen(location, "r");
+}
+
+// stream both read files batch by batch and count assigned fragments into total, returns false if the reads could not be read
+// reads are interleaved in forward_location when reverse_location is NULL
+// if filtered is not NULL, pairs are not assigned but written interleaved to filtered when all their k-mers are in filter, index is
+// not used and may be NULL
+// if stop is not NULL, counting ends early once the strain abundances estimated at its checkpoints converge
+bool count_fragments(kmer_index* index, kmer_filter* filter, char* forward_location, char* reverse_location, fragment_counts* total,
+                     uint32_t num_threads, uint32_t min_hits, FILE* filtered, early_stop* stop){
+    gzFile forward_fp = open_reads(forward_location);
+    gzFile reverse_fp = reverse_location == NULL ? NULL : open_reads(reverse_location);
+    if(forward_fp == NULL || (reverse_location != NULL && reverse_fp == NULL)){
+        fprintf(stderr, "Error opening reads %s\n", forward_fp == NULL ? forward_location : reverse_location);
+        if(forward_fp != NULL) gzclose(forward_fp);
+        if(reverse_fp != NULL) gzclose(reverse_fp);
+        return false;
+    }
+    kseq_t* forward = kseq_init(forward_fp);
+    kseq_t* reverse = reverse_fp == NULL ? forward : kseq_init(reverse_fp);
+    read_batch* batch = read_batch_create();
+    batch->keep_records = filtered != NULL;
+    uint32_t num_subcontigs = index == NULL ? 0 : index->num_subcontigs;
+    fragment_counts* checkpoint = stop == NULL ? NULL : fragment_counts_create(num_subcontigs);
+    uint64_t input_bytes = telemetry_file_size(forward_location);
+    bool stopped = false;
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    count_worker* workers = calloc(num_threads, sizeof(count_worker));
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].index = index;
+        workers[i].filter = filter;
+        workers[i].batch = batch;
+        workers[i].counts = fragment_counts_create(num_subcontigs);
+        workers[i].min_hits = min_hits;
+    }
+
+    int32_t batch_size;
+    while((batch_size = read_batch_fill(batch, forward, reverse)) > 0){
+        uint32_t slice = (batch->count + num_threads - 1) / num_threads;
+        for(uint32_t i=0; i<num_threads; ++i){
+            workers[i].start = i*slice < batch->count ? i*slice : batch->count;
+            workers[i].end = (i+1)*slice < batch->count ? (i+1)*slice : batch->count;
+            if(pthread_create(&threads[i], NULL, count_batch, &workers[i]) != 0){
+                fprintf(stderr, "Error: failed to create thread\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for(uint32_t i=0; i<num_threads; ++i){
+            pthread_join(threads[i], NULL);
+        }
+        // kept pairs are written by this thread so their order is the same as the input's
+        if(filtered != NULL){
+            for(uint32_t i=0; i<batch->count; ++i){
+                if(batch->keep[i]){
+                    fwrite(&batch->records[batch->record_offsets[i]], sizeof(char), batch->record_offsets[i+1] - batch->record_offsets[i],
+                           filtered);
+                }
+            }
+        }
+        if(stop != NULL){
+            uint64_t pairs = 0;
+            for(uint32_t i=0; i<num_threads; ++i) pairs += workers[i].counts->pairs;
+            if(pairs >= stop->next_checkpoint){
+                memset(checkpoint->frags, 0, num_subcontigs * sizeof(uint64_t));
+                memset(checkpoint->bases, 0, num_subcontigs * sizeof(uint64_t));
+                checkpoint->pairs = checkpoint->assigned = checkpoint->ambiguous = checkpoint->retained = 0;
+                for(uint32_t i=0; i<num_threads; ++i) fragment_counts_merge(checkpoint, workers[i].counts);
+                // how far into the (possibly compressed) forward reads zlib has read, unknown for standard input
+                z_off_t offset = gzoffset(forward_fp);
+                double input_fraction = input_bytes == 0 || offset < 0 ? -1 : (double) offset / input_bytes;
+                if(early_stop_checkpoint(stop, checkpoint, input_fraction > 1 ? 1 : input_fraction)){
+                    stopped = true;
+                    break;
+                }
+            }
+        }
+    }
+    if(checkpoint != NULL) fragment_counts_destroy(checkpoint);
+
+    for(uint32_t i=0; i<num_threads; ++i){
+        fragment_counts_merge(total, workers[i].counts);
+        fragment_counts_destroy(workers[i].counts);
+        free(workers[i].hashes);
+    }
+    free(workers);
+    free(threads);
+    read_batch_destroy(batch);
+    if(reverse != forward){
+        kseq_destroy(reverse);
+        gzclose(reverse_fp);
+    }
+    kseq_destroy(forward);
+    gzclose(forward_fp);
+    return batch_size == 0 || stopped;
+}
+
+// subcontig length is the last field of a subcontig name
+static inline uint32_t subcontig_length(char* name){
+    char* length = strrchr(name, ';');
+    return length == NULL ? 0 : atoi(length+1);
+}
+
+// write counts in the same layout as the .rpkm file BBMap generates
+bool write_rpkm(char* rpkm_location, char* forward_location, kmer_index* index, fragment_counts* counts){
+    FILE* rpkm = fopen(rpkm_location, "w");
+    if(rpkm == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", rpkm_location);
+        return false;
+    }
+    uint64_t total_reads = counts->pairs * 2;
+    fprintf(rpkm, "#File\t%s\n#Reads\t%ld\n#Mapped\t%ld\n#RefSequences\t%d\n", forward_location, total_reads, counts->assigned * 2,
+            index->num_subcontigs);
+    fprintf(rpkm, "#Name\tLength\tBases\tCoverage\tReads\tRPKM\tFrags\tFPKM\n");
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        uint32_t length = subcontig_length(index->subcontig_names[i]);
+        double coverage = length == 0 ? 0 : (double)counts->bases[i] / length;
+        double rpkm_value = length == 0 || total_reads == 0 ? 0 : counts->frags[i] * 2 * 1e9 / ((double)length * total_reads);
+        double fpkm_value = length == 0 || counts->pairs == 0 ? 0 : counts->frags[i] * 1e9 / ((double)length * counts->pairs);
+        fprintf(rpkm, "%s\t%d\t%ld\t%.4f\t%ld\t%.4f\t%ld\t%.4f\n", index->subcontig_names[i], length, counts->bases[i], coverage,
+                counts->frags[i] * 2, rpkm_value, counts->frags[i], fpkm_value);
+    }
+    fclose(rpkm);
+    return true;
+}
+
+static kmer_index* sorted_names_index; // index whose names are being sorted, qsort has no context argument
+static pthread_mutex_t sorted_names_lock = PTHREAD_MUTEX_INITIALIZER; // guards sorted_names_index when jobs run concurrently
+
+static int compare_names(const void* a, const void* b){
+    return strcmp(sorted_names_index->subcontig_names[*(uint32_t*)a], sorted_names_index->subcontig_names[*(uint32_t*)b]);
+}
+
+static int compare_name_to_id(const void* name, const void* id){
+    return strcmp((char*)name, sorted_names_index->subcontig_names[*(uint32_t*)id]);
+}
+
+// pearson correlation between two count vectors
+static double correlation(uint64_t* x, uint64_t* y, uint32_t n){
+    double mean_x = 0, mean_y = 0;
+    for(uint32_t i=0; i<n; ++i){
+        mean_x += x[i];
+        mean_y += y[i];
+    }
+    mean_x /= n;
+    mean_y /= n;
+    double cov = 0, var_x = 0, var_y = 0;
+    for(uint32_t i=0; i<n; ++i){
+        cov += (x[i] - mean_x) * (y[i] - mean_y);
+        var_x += (x[i] - mean_x) * (x[i] - mean_x);
+        var_y += (y[i] - mean_y) * (y[i] - mean_y);
+    }
+    return var_x == 0 || var_y == 0 ? 0 : cov / sqrt(var_x * var_y);
+}
+
+// compare fragment counts to the ones BBMap reported for the same reads, writes one line per subcontig and prints a summary
+bool compare_rpkm(char* comparison_location, char* bbmap_location, kmer_index* index, fragment_counts* counts, FILE* log){
+    FILE* bbmap = fopen(bbmap_location, "r");
+    if(bbmap == NULL){
+        fprintf(stderr, "Error opening %s\n", bbmap_location);
+        return false;
+    }
+    uint32_t* sorted_ids = malloc(index->num_subcontigs * sizeof(uint32_t));
+    for(uint32_t i=0; i<index->num_subcontigs; ++i) sorted_ids[i] = i;
+    pthread_mutex_lock(&sorted_names_lock);
+    sorted_names_index = index;
+    qsort(sorted_ids, index->num_subcontigs, sizeof(uint32_t), compare_names);
+
+    uint64_t* bbmap_frags = calloc(index->num_subcontigs, sizeof(uint64_t));
+    char* line = NULL;
+    size_t max_len = 0;
+    while(getline(&line, &max_len, bbmap) != -1){
+        if(line[0] == '#') continue;
+        char* name = strtok(line, "\t");
+        uint32_t* id = bsearch(name, sorted_ids, index->num_subcontigs, sizeof(uint32_t), compare_name_to_id);
+        if(id == NULL){
+            fprintf(stderr, "Warning: %s is in %s but not in the k-mer index\n", name, bbmap_location);
+            continue;
+        }
+        char* field = NULL;
+        for(int i=0; i<6; ++i) field = strtok(NULL, "\t");
+        bbmap_frags[*id] = field == NULL ? 0 : strtoull(field, NULL, 10);
+    }
+    pthread_mutex_unlock(&sorted_names_lock);
+    free(line);
+    fclose(bbmap);
+
+    FILE* comparison = fopen(comparison_location, "w");
+    if(comparison == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", comparison_location);
+        free(bbmap_frags);
+        free(sorted_ids);
+        return false;
+    }
+    uint64_t kmer_total = 0, bbmap_total = 0;
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        kmer_total += counts->frags[i];
+        bbmap_total += bbmap_frags[i];
+    }
+    double proportion_difference = 0;
+    fprintf(comparison, "SubcontigID\tKmer_Frags\tBBMap_Frags\tKmer_Proportion\tBBMap_Proportion\n");
+    for(uint32_t i=0; i<index->num_subcontigs; ++i){
+        double kmer_proportion = kmer_total == 0 ? 0 : (double)counts->frags[i] / kmer_total;
+        double bbmap_proportion = bbmap_total == 0 ? 0 : (double)bbmap_frags[i] / bbmap_total;
+        proportion_difference += fabs(kmer_proportion - bbmap_proportion);
+        fprintf(comparison, "%s\t%ld\t%ld\t%.6g\t%.6g\n", index->subcontig_names[i], counts->frags[i], bbmap_frags[i], kmer_proportion,
+                bbmap_proportion);
+    }
+    fclose(comparison);
+
+    fprintf(log, "Comparison to BBMap: %ld fragments assigned by k-mers, %ld by BBMap\n", kmer_total, bbmap_total);
+    fprintf(log, "Correlation of fragments per subcontig: %.4f\n", correlation(counts->frags, bbmap_frags, index->num_subcontigs));
+    fprintf(log, "Total absolute difference of fragment proportions: %.4f\n", proportion_difference);
+
+    free(bbmap_frags);
+    free(sorted_ids);
+    return true;
+}
+
+// size of a job's read files, compressed if they are
+static uint64_t job_bytes_in(count_job* job){
+    return telemetry_file_size(job->forward_location) + (job->reverse_location != NULL ? telemetry_file_size(job->reverse_location) : 0);
+}
+
+// write the read pairs made of reference k-mers to job->filtered_location, progress is written to log
+static bool run_filter_job(kmer_filter* filter, count_job* job, FILE* log){
+    FILE* filtered = strcmp(job->filtered_location, "-") == 0 ? stdout : fopen(job->filtered_location, "w");
+    if(filtered == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", job->filtered_location);
+        return false;
+    }
+    fprintf(log, "Filtering read pairs that are not inside the reference\n");
+    telemetry_stage stage;
+    telemetry_begin(&stage, "readcounter", "filter", "reads");
+    fragment_counts* counts = fragment_counts_create(0);
+    bool success = count_fragments(NULL, filter, job->forward_location, job->reverse_location, counts, job->num_threads, job->min_hits,
+                                   filtered, NULL);
+    if(success){
+        fprintf(log, "%ld read pairs were processed\n%ld read pairs (%.2f%%) lay inside the reference and were kept\n", counts->pairs,
+                counts->retained, counts->pairs == 0 ? 0 : 100.0 * counts->retained / counts->pairs);
+    }
+    stage.items = counts->pairs * 2;
+    fragment_counts_destroy(counts);
+    if(filtered == stdout){
+        fflush(stdout);
+    }else{
+        fclose(filtered);
+        stage.bytes_out = telemetry_file_size(job->filtered_location);
+    }
+    stage.bytes_in = job_bytes_in(job);
+    if(success) telemetry_end(&stage);
+    return success;
+}
+
+// count the fragments of one pair of read files and write the results, progress is written to log
+bool run_count_job(kmer_index* index, count_job* job, FILE* log){
+    fprintf(log, "Assigning read pairs to subcontigs\n");
+    telemetry_stage stage;
+    telemetry_begin(&stage, "readcounter", "count", "reads");
+    early_stop* stop = NULL;
+    if(job->tolerance > 0){
+        char* progress_location = calloc(strlen(job->rpkm_location) + strlen(".progress") + 1, sizeof(char));
+        sprintf(progress_location, "%s.progress", job->rpkm_location);
+        stop = early_stop_create(index, job->tolerance, job->weighted_percentile, job->subcontig_filter, job->first_checkpoint,
+                                 progress_location);
+        free(progress_location);
+        if(stop == NULL) return false;
+    }
+    fragment_counts* counts = fragment_counts_create(index->num_subcontigs);
+    bool success = count_fragments(index, NULL, job->forward_location, job->reverse_location, counts, job->num_threads, job->min_hits,
+                                   NULL, stop);
+    if(success){
+        fprintf(log, "%ld read pairs were processed\n%ld were assigned to a subcontig and %ld were ambiguous\n", counts->pairs,
+                counts->assigned, counts->ambiguous);
+        if(stop != NULL && stop->converged && stop->input_fraction >= 0){
+            fprintf(log, "Strain abundances converged after %d checkpoints, about %.1f%% of the reads were used\n", stop->checkpoints,
+                    100 * stop->input_fraction);
+        }else if(stop != NULL && stop->converged){
+            fprintf(log, "Strain abundances converged after %d checkpoints\n", stop->checkpoints);
+        }else if(stop != NULL){
+            fprintf(log, "Strain abundances did not converge before the reads ran out, all reads were used\n");
+        }
+        success = write_rpkm(job->rpkm_location, job->forward_location, index, counts);
+    }
+    if(success){
+        stage.items = counts->pairs * 2;
+        stage.bytes_in = job_bytes_in(job);
+        stage.bytes_out = telemetry_file_size(job->rpkm_location);
+        telemetry_end(&stage);
+    }
+    if(success && job->bbmap_location != NULL){
+        char* comparison_location = calloc(strlen(job->rpkm_location) + strlen(".comparison") + 1, sizeof(char));
+        sprintf(comparison_location, "%s.comparison", job->rpkm_location);
+        success = compare_rpkm(comparison_location, job->bbmap_location, index, counts, log);
+        free(comparison_location);
+    }
+    if(success) fprintf(log, "Read pairs counted, the results can be found in %s\n", job->rpkm_location);
+    fragment_counts_destroy(counts);
+    if(stop != NULL) early_stop_destroy(stop);
+    return success;
+}
+
+int main(int argc, char **argv){
+    int opt;
+    char* index_location = NULL;
+    char* filter_location = NULL;
+    char* serve_location = NULL;
+    char* submit_location = NULL;
+    char* stop_location = NULL;
+    count_job job = {NULL, NULL, NULL, NULL, NULL, 1, 1, 0, FIRST_CHECKPOINT, 60, 0};
+    bool interleaved = false;
+    bool min_hits_given = false;
+
+    // parse options
+    while ((opt = getopt(argc, argv, "1:2:I:i:o:f:F:t:m:c:e:n:w:p:d:s:q:h")) != -1) {
+        switch (opt) {
+            case '1': {
+                job.forward_location = optarg;
+            } break;
+            case '2': {
+                job.reverse_location = optarg;
+            } break;
+            case 'I': {
+                job.forward_location = optarg;
+                interleaved = true;
+            } break;
+            case 'i': {
+                index_location = optarg;
+            } break;
+            case 'o': {
+                job.rpkm_location = optarg;
+            } break;
+            case 'f': {
+                job.filtered_location = optarg;
+            } break;
+            case 'F': {
+                filter_location = optarg;
+            } break;
+            case 't': {
+                job.num_threads = atoi(optarg);
+            } break;
+            case 'm': {
+                job.min_hits = atoi(optarg);
+                min_hits_given = true;
+            } break;
+            case 'c': {
+                job.bbmap_location = optarg;
+            } break;
+            case 'e': {
+                job.tolerance = atof(optarg);
+                if(job.tolerance <= 0){
+                    fprintf(stderr, "Error: the early stopping tolerance must be greater than 0\n");
+                    return EXIT_FAILURE;
+                }
+            } break;
+            case 'n': {
+                job.first_checkpoint = strtoull(optarg, NULL, 10);
+            } break;
+            case 'w': {
+                job.weighted_percentile = atof(optarg);
+            } break;
+            case 'p': {
+                job.subcontig_filter = atof(optarg);
+            } break;
+            case 'd': {
+                serve_location = optarg;
+            } break;
+            case 's': {
+                submit_location = optarg;
+            } break;
+            case 'q': {
+                stop_location = optarg;
+            } break;
+            case 'h': {
+                printf(USAGE);
+                return EXIT_SUCCESS;
+            }
+            default: {
+                printf(USAGE);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if(stop_location != NULL) return stop_server(stop_location);
+
+    // check validity of inputs
+    if(job.num_threads == 0 || job.min_hits == 0 || (serve_location == NULL && (job.forward_location == NULL ||
+       (job.reverse_location == NULL) != interleaved || (job.rpkm_location == NULL) == (job.filtered_location == NULL))) ||
+       (index_location == NULL && submit_location == NULL && job.filtered_location == NULL)) {
+        printf(USAGE);
+        return EXIT_FAILURE;
+    }
+
+    if((job.filtered_location != NULL) != (filter_location != NULL) || (job.filtered_location != NULL && serve_location != NULL)){
+        fprintf(stderr, "Error: reads are filtered with -f and the reference k-mer filter given with -F together\n");
+        return EXIT_FAILURE;
+    }
+    if(job.filtered_location != NULL && min_hits_given){
+        fprintf(stderr, "Error: -m only applies to counting, filtering keeps a pair when all of its k-mers are in the reference\n");
+        return EXIT_FAILURE;
+    }
+
+    if(job.tolerance > 0 && (job.filtered_location != NULL || submit_location != NULL || serve_location != NULL)){
+        fprintf(stderr, "Error: early stopping only applies to counting without a server\n");
+        return EXIT_FAILURE;
+    }
+    if(job.first_checkpoint == 0 || job.weighted_percentile < 0 || job.weighted_percentile > 100 || job.subcontig_filter < 0 ||
+       job.subcontig_filter > 100){
+        fprintf(stderr, "Error: the first checkpoint must be greater than 0, the weighted percentile and filter between 0 and 100\n");
+        return EXIT_FAILURE;
+    }
+
+    if(submit_location != NULL) return submit_count_job(submit_location, &job);
+
+    // progress goes to stderr when filtered reads are written to stdout
+    FILE* log = job.filtered_location != NULL && strcmp(job.filtered_location, "-") == 0 ? stderr : stdout;
+    telemetry_stage stage;
+    if(job.filtered_location != NULL){
+        fprintf(log, "Loading reference k-mer filter\n");
+        telemetry_begin(&stage, "readcounter", "filter_load", "kmers");
+        kmer_filter* filter = kmer_filter_load(filter_location);
+        stage.bytes_in = telemetry_file_size(filter_location);
+        telemetry_end(&stage);
+        int status = run_filter_job(filter, &job, log) ? EXIT_SUCCESS : EXIT_FAILURE;
+        kmer_filter_destroy(filter);
+        return status;
+    }
+
+    fprintf(log, "Loading unique k-mer table\n");
+    telemetry_begin(&stage, "readcounter", "index_load", "kmers");
+    kmer_index* index = kmer_index_load(index_location);
+    stage.items = index->count;
+    stage.bytes_in = telemetry_file_size(index_location);
+    telemetry_end(&stage);
+    fprintf(log, "Loaded %ld unique %d-mers from %d subcontigs\n", index->count, index->kmer_size, index->num_subcontigs);
+
+    int status;
+    if(serve_location != NULL){
+        status = serve_count_jobs(index, serve_location, job.num_threads);
+    }else{
+        status = run_count_job(index, &job, log) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    kmer_index_destroy(index);
+    return status;
+}
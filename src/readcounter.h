@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "abundance.h"
+#include "kmerfilter.h"
+#include "kmerindex.h"
+#include "kmers.h"
+#include "telemetry.h"
+
+#define BATCH_SIZE 65536 // read pairs read in before being split between threads
+#define AMBIGUOUS_FRAGMENT 0xFFFFFFFE // fragment hit the unique k-mers of more than one subcontig
+#define SERVER_BACKLOG 128 // pending connections to a server before clients are refused
+#define FIRST_CHECKPOINT 131072 // read pairs counted before abundances are first estimated when stopping early
+#define USAGE                                                                                                                                        \
+    "USAGE: readcounter -1 path/to/forward.fastq.gz -2 path/to/reverse.fastq.gz -i path/to/UniqueKmers.index -o path/to/out.rpkm [OPTIONS]\n"        \
+    "       readcounter -I path/to/interleaved.fastq.gz -i path/to/UniqueKmers.index -o path/to/out.rpkm [OPTIONS]\n"                                \
+    "       readcounter -1 path/to/forward.fastq.gz -2 path/to/reverse.fastq.gz -F path/to/ReferenceKmers.filter -f path/to/kept.fastq [OPTIONS]\n"  \
+    "       readcounter -i path/to/UniqueKmers.index -d path/to/socket [-t threads]\n"                                                               \
+    "       readcounter -1 path/to/forward.fastq.gz -2 path/to/reverse.fastq.gz -s path/to/socket -o path/to/out.rpkm [OPTIONS]\n"                   \
+    "readcounter assigns read pairs to subcontigs by their unique k-mers and writes a .rpkm table of fragments per subcontig\n"                      \
+    "\tRequired Arguments:\n"                                                                                                                        \
+    "\t\t-1 path/to/forward\t: path to forward reads (fastq, may be gzipped)\n"                                                                      \
+    "\t\t-2 path/to/reverse\t: path to reverse reads (fastq, may be gzipped)\n"                                                                      \
+    "\t\t-I path/to/interleaved\t: path to interleaved read pairs instead of -1 and -2, - reads from standard input\n"                               \
+    "\t\t-i path/to/index\t: unique k-mer table written by hashcounter -u (not needed when submitting to a server or filtering)\n"                   \
+    "\t\t-o path/to/out.rpkm\t: file to write fragment counts to\n"                                                                                  \
+    "\tOptional Arguments:\n"                                                                                                                        \
+    "\t\t-t number\t\t: number of threads, or the total thread budget shared by all jobs of a server [Default = 1]\n"                                \
+    "\t\t-f path/to/kept.fastq\t: instead of counting, write pairs made of reference k-mers interleaved to this file, - for standard output\n"       \
+    "\t\t-F path/to/filter\t: reference k-mer filter written by hashcounter -f, used instead of -i when filtering with -f\n"                         \
+    "\t\t-m number\t\t: minimum unique k-mer hits for a fragment to be assigned, counting only [Default = 1]\n"                                      \
+    "\t\t-c path/to/bbmap.rpkm\t: compare the counts against a .rpkm from BBMap, writes <out.rpkm>.comparison\n"                                     \
+    "\tEarly Stopping Arguments:\n"                                                                                                                  \
+    "\t\t-e number\t\t: stop once no strain's abundance changes by more than this fraction between checkpoints, writes <out.rpkm>.progress\n"        \
+    "\t\t-n number\t\t: read pairs counted before the first checkpoint, the pairs between checkpoints double [Default = 131072]\n"                   \
+    "\t\t-w number\t\t: weighted percentile of a strain's FUKMs used as its abundance, as StrainR -c [Default = 60]\n"                               \
+    "\t\t-p number\t\t: percentage of a strain's subcontigs filtered out by unique k-mers, as StrainR -s [Default = 0]\n"                            \
+    "\tServer Arguments:\n"                                                                                                                          \
+    "\t\t-d path/to/socket\t: keep the index loaded and run jobs submitted to this unix socket until stopped\n"                                      \
+    "\t\t-s path/to/socket\t: submit the job to the server listening on this socket instead of loading the index\n"                                  \
+    "\t\t-q path/to/socket\t: stop the server listening on this socket once its running jobs are done\n"                                             \
+    "\t\t-h\t\t\t: display this message again\n"
+
+typedef struct read_batch{
+    char** forward;
+    char** reverse;
+    uint32_t* forward_lens;
+    uint32_t* reverse_lens;
+    uint32_t* forward_capacity;
+    uint32_t* reverse_capacity;
+    char* records; // text of every read in the batch, only kept when filtering
+    size_t* record_offsets; // pair i's records span record_offsets[i] to record_offsets[i+1]
+    size_t records_capacity;
+    bool* keep; // pairs that passed the filter
+    bool keep_records;
+    uint32_t count;
+} read_batch;
+
+typedef struct fragment_counts{
+    uint64_t* frags; // indexed by subcontig id
+    uint64_t* bases;
+    uint64_t pairs;
+    uint64_t assigned;
+    uint64_t ambiguous;
+    uint64_t retained; // pairs kept when filtering
+    uint32_t num_subcontigs;
+} fragment_counts;
+
+typedef struct count_job{
+    char* forward_location;
+    char* reverse_location; // NULL if the reads are interleaved in forward_location
+    char* rpkm_location;
+    char* bbmap_location; // NULL unless comparing to a .rpkm from BBMap
+    char* filtered_location; // NULL unless filtering reads instead of counting them
+    uint32_t num_threads;
+    uint32_t min_hits;
+    double tolerance; // early stopping tolerance, counting never stops early when it is 0
+    uint64_t first_checkpoint;
+    double weighted_percentile;
+    double subcontig_filter;
+} count_job;
+
+typedef struct early_stop{
+    double tolerance;
+    double weighted_percentile;
+    uint64_t next_checkpoint; // read pairs counted when abundances are next estimated
+    uint32_t checkpoints;
+    uint64_t* unique_kmers; // of each subcontig, counted from the index
+    uint32_t* members; // subcontigs kept by the subcontig filter grouped by strain, strain i's span strain_starts[i] to strain_starts[i+1]
+    uint32_t* strain_starts;
+    uint32_t num_members;
+    uint32_t num_strains;
+    double* abundances; // estimate of each strain at the last checkpoint
+    weighted_value* values; // scratch for the weighted percentile
+    bool converged;
+    double input_fraction; // part of the input read when the estimates converged, negative if it is not known
+    FILE* progress;
+} early_stop;
+
+typedef struct read_server{
+    kmer_index* index;
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // signalled when threads are released or a job finishes
+    uint32_t thread_budget;
+    uint32_t threads_available;
+    uint32_t running_jobs;
+    int socket_fd;
+    bool stopping;
+} read_server;
+
+typedef struct server_connection{
+    read_server* server;
+    int fd;
+} server_connection;
+
+typedef struct count_worker{
+    kmer_index* index;
+    kmer_filter* filter; // reference k-mers, only when filtering
+    read_batch* batch;
+    fragment_counts* counts;
+    uint64_t* hashes;
+    uint32_t hashes_capacity;
+    uint32_t start;
+    uint32_t end;
+    uint32_t min_hits;
+} count_worker;
+
+read_batch* read_batch_create();
+void read_batch_destroy(read_batch* batch);
+fragment_counts* fragment_counts_create(uint32_t num_subcontigs);
+void fragment_counts_merge(fragment_counts* total, fragment_counts* counts);
+void fragment_counts_destroy(fragment_counts* counts);
+uint32_t assign_fragment(kmer_index* index, char* forward, uint32_t forward_len, char* reverse, uint32_t reverse_len, uint32_t min_hits,
+                         uint64_t** hashes, uint32_t* hashes_capacity);
+bool in_reference(kmer_filter* filter, char* forward, uint32_t forward_len, char* reverse, uint32_t reverse_len, uint64_t** hashes,
+                  uint32_t* hashes_capacity);
+void* count_batch(void* worker);
+bool count_fragments(kmer_index* index, kmer_filter* filter, char* forward_location, char* reverse_location, fragment_counts* total,
+                     uint32_t num_threads, uint32_t min_hits, FILE* filtered, early_stop* stop);
+bool write_rpkm(char* rpkm_location, char* forward_location, kmer_index* index, fragment_counts* counts);
+bool compare_rpkm(char* comparison_location, char* bbmap_location, kmer_index* index, fragment_counts* counts, FILE* log);
+bool run_count_job(kmer_index* index, count_job* job, FILE* log);
+// early stopping (progressive.c)
+early_stop* early_stop_create(kmer_index* index, double tolerance, double weighted_percentile, double subcontig_filter,
+                              uint64_t first_checkpoint, char* progress_location);
+void early_stop_destroy(early_stop* stop);
+bool early_stop_checkpoint(early_stop* stop, fragment_counts* counts, double input_fraction);
+// server mode (readserver.c)
+int serve_count_jobs(kmer_index* index, char* socket_location, uint32_t thread_budget);
+int submit_count_job(char* socket_location, count_job* job);
+int stop_server(char* socket_location);
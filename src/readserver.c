@@ -0,0 +1,234 @@
+#include "readcounter.h"
+
+/*
+ * Resident server mode for readcounter
+ * The server loads the unique k-mer table once and accepts jobs over a unix socket, so the index is not reloaded per sample
+ * Each connection is one request line followed by the job's progress lines and a final OK or FAILED line:
+ *     COUNT<TAB>forward<TAB>reverse or - if interleaved<TAB>out.rpkm<TAB>bbmap.rpkm or -<TAB>threads<TAB>min_hits
+ *     STOP
+ * Jobs run concurrently as long as the threads they ask for fit in the server's thread budget, otherwise they wait
+ */
+
+// block until num_threads threads of the budget are free and reserve them
+static void reserve_threads(read_server* server, uint32_t num_threads){
+    pthread_mutex_lock(&server->lock);
+    while(server->threads_available < num_threads) pthread_cond_wait(&server->changed, &server->lock);
+    server->threads_available -= num_threads;
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void release_threads(read_server* server, uint32_t num_threads){
+    pthread_mutex_lock(&server->lock);
+    server->threads_available += num_threads;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// split a COUNT request into a job, returns false if it is malformed
+static bool parse_count_request(char* request, count_job* job){
+    char* fields[7];
+    char* save = NULL;
+    fields[0] = strtok_r(request, "\t", &save);
+    for(int i=1; i<7; ++i){
+        if((fields[i] = strtok_r(NULL, "\t", &save)) == NULL) return false;
+    }
+    if(strcmp(fields[0], "COUNT") != 0) return false;
+    job->forward_location = fields[1];
+    job->reverse_location = strcmp(fields[2], "-") == 0 ? NULL : fields[2];
+    job->rpkm_location = fields[3];
+    job->bbmap_location = strcmp(fields[4], "-") == 0 ? NULL : fields[4];
+    job->num_threads = atoi(fields[5]);
+    job->min_hits = atoi(fields[6]);
+    job->filtered_location = NULL;
+    job->tolerance = 0;
+    return job->num_threads > 0 && job->min_hits > 0;
+}
+
+// thread function handling a single client connection
+static void* handle_connection(void* arg){
+    server_connection* connection = (server_connection*) arg;
+    read_server* server = connection->server;
+    FILE* in = fdopen(connection->fd, "r");
+    FILE* out = fdopen(dup(connection->fd), "w");
+    setvbuf(out, NULL, _IOLBF, 0);
+    char* request = NULL;
+    size_t max_len = 0;
+    ssize_t request_len = getline(&request, &max_len, in);
+    if(request_len > 0 && request[request_len-1] == '\n') request[request_len-1] = '\0';
+
+    count_job job;
+    if(request_len <= 0){
+        fprintf(out, "Empty request\nFAILED\n");
+    }else if(strcmp(request, "STOP") == 0){
+        printf("Stop requested, finishing running jobs\n");
+        pthread_mutex_lock(&server->lock);
+        server->stopping = true;
+        pthread_mutex_unlock(&server->lock);
+        shutdown(server->socket_fd, SHUT_RDWR);
+        fprintf(out, "Server is stopping\nOK\n");
+    }else if(parse_count_request(request, &job)){
+        // a job asking for more threads than the whole budget gets the whole budget
+        uint32_t num_threads = job.num_threads < server->thread_budget ? job.num_threads : server->thread_budget;
+        job.num_threads = num_threads;
+        printf("Queued %s\n", job.rpkm_location);
+        reserve_threads(server, num_threads);
+        printf("Running %s with %d threads\n", job.rpkm_location, num_threads);
+        bool success = run_count_job(server->index, &job, out);
+        release_threads(server, num_threads);
+        printf("%s %s\n", success ? "Finished" : "Failed", job.rpkm_location);
+        fprintf(out, success ? "OK\n" : "Job failed, see the server's log for details\nFAILED\n");
+    }else{
+        fprintf(out, "Malformed request\nFAILED\n");
+    }
+
+    free(request);
+    fclose(out);
+    fclose(in);
+    free(connection);
+    pthread_mutex_lock(&server->lock);
+    --server->running_jobs;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+static bool socket_address(char* socket_location, struct sockaddr_un* address){
+    if(strlen(socket_location) >= sizeof(address->sun_path)){
+        fprintf(stderr, "Error: socket path %s is too long\n", socket_location);
+        return false;
+    }
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_location);
+    return true;
+}
+
+// run jobs submitted to socket_location until a STOP request, returns an exit status
+int serve_count_jobs(kmer_index* index, char* socket_location, uint32_t thread_budget){
+    struct sockaddr_un address;
+    if(!socket_address(socket_location, &address)) return EXIT_FAILURE;
+    read_server server = {index, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, thread_budget, thread_budget, 0, -1, false};
+    server.socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server.socket_fd < 0 || bind(server.socket_fd, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+       listen(server.socket_fd, SERVER_BACKLOG) != 0){
+        fprintf(stderr, "Error: could not listen on %s (%s), if no server is running remove the file and try again\n", socket_location,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    // clients disconnecting mid-job must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("Listening on %s with a budget of %d threads\n", socket_location, thread_budget);
+
+    while(true){
+        int fd = accept(server.socket_fd, NULL, NULL);
+        pthread_mutex_lock(&server.lock);
+        bool stopping = server.stopping;
+        pthread_mutex_unlock(&server.lock);
+        if(stopping){
+            if(fd >= 0) close(fd);
+            break;
+        }
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Error: could not accept connection (%s)\n", strerror(errno));
+            break;
+        }
+        server_connection* connection = malloc(sizeof(server_connection));
+        connection->server = &server;
+        connection->fd = fd;
+        pthread_t thread;
+        pthread_mutex_lock(&server.lock);
+        ++server.running_jobs;
+        pthread_mutex_unlock(&server.lock);
+        if(pthread_create(&thread, NULL, handle_connection, connection) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+
+    pthread_mutex_lock(&server.lock);
+    while(server.running_jobs > 0) pthread_cond_wait(&server.changed, &server.lock);
+    pthread_mutex_unlock(&server.lock);
+    close(server.socket_fd);
+    unlink(socket_location);
+    printf("Server stopped\n");
+    return EXIT_SUCCESS;
+}
+
+// send one request and print the server's reply, returns an exit status based on the reply's final line
+static int send_request(char* socket_location, char* request){
+    struct sockaddr_un address;
+    if(!socket_address(socket_location, &address)) return EXIT_FAILURE;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0){
+        fprintf(stderr, "Error: could not connect to a server on %s (%s)\n", socket_location, strerror(errno));
+        if(fd >= 0) close(fd);
+        return EXIT_FAILURE;
+    }
+    FILE* in = fdopen(fd, "r+");
+    fprintf(in, "%s\n", request);
+    fflush(in);
+
+    int status = EXIT_FAILURE;
+    char* line = NULL;
+    size_t max_len = 0;
+    while(getline(&line, &max_len, in) != -1){
+        if(strcmp(line, "OK\n") == 0){
+            status = EXIT_SUCCESS;
+        }else if(strcmp(line, "FAILED\n") != 0){
+            fputs(line, stdout);
+        }
+    }
+    free(line);
+    fclose(in);
+    return status;
+}
+
+// the server may run from another directory, so relative paths are resolved against ours
+static char* absolute_path(char* path){
+    if(path[0] == '/') return strdup(path);
+    char* cwd = getcwd(NULL, 0);
+    char* absolute = calloc(strlen(cwd) + strlen(path) + 2, sizeof(char));
+    sprintf(absolute, "%s/%s", cwd, path);
+    free(cwd);
+    return absolute;
+}
+
+int submit_count_job(char* socket_location, count_job* job){
+    if(job->filtered_location != NULL){
+        fprintf(stderr, "Error: reads can not be filtered by a server\n");
+        return EXIT_FAILURE;
+    }
+    if(strcmp(job->forward_location, "-") == 0){
+        fprintf(stderr, "Error: reads from standard input can not be submitted to a server\n");
+        return EXIT_FAILURE;
+    }
+    char* locations[4] = {job->forward_location, job->reverse_location, job->rpkm_location, job->bbmap_location};
+    for(int i=0; i<4; ++i){
+        if(locations[i] == NULL){
+            locations[i] = strdup("-");
+            continue;
+        }
+        if(strpbrk(locations[i], "\t\n") != NULL){
+            fprintf(stderr, "Error: paths submitted to a server can not contain tabs or newlines\n");
+            return EXIT_FAILURE;
+        }
+        locations[i] = absolute_path(locations[i]);
+    }
+    size_t needed = snprintf(NULL, 0, "COUNT\t%s\t%s\t%s\t%s\t%d\t%d", locations[0], locations[1], locations[2], locations[3],
+                             job->num_threads, job->min_hits) + 1;
+    char* request = calloc(needed, sizeof(char));
+    sprintf(request, "COUNT\t%s\t%s\t%s\t%s\t%d\t%d", locations[0], locations[1], locations[2], locations[3], job->num_threads,
+            job->min_hits);
+    int status = send_request(socket_location, request);
+    free(request);
+    for(int i=0; i<4; ++i) free(locations[i]);
+    return status;
+}
+
+int stop_server(char* socket_location){
+    char request[] = "STOP";
+    return send_request(socket_location, request);
+}
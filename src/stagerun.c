@@ -0,0 +1,152 @@
+#include "stagerun.h"
+
+// size of a file, or of every file under a directory such as a bbmap index, 0 if it does not exist
+static uint64_t path_bytes(const char* location){
+    struct stat st;
+    if(lstat(location, &st) != 0) return 0;
+    if(!S_ISDIR(st.st_mode)) return S_ISREG(st.st_mode) ? st.st_size : 0;
+    DIR* dr = opendir(location);
+    if(dr == NULL) return 0;
+    uint64_t bytes = 0;
+    struct dirent* de;
+    while((de = readdir(dr)) != NULL){
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        char* entry = malloc(strlen(location) + strlen(de->d_name) + 2);
+        sprintf(entry, "%s/%s", location, de->d_name);
+        bytes += path_bytes(entry);
+        free(entry);
+    }
+    closedir(dr);
+    return bytes;
+}
+
+// run a command, wait for it, and save its measurement, returns the command's exit status
+static int measure(char* measurement_location, char** command){
+    struct timespec start;
+    clock_gettime(CLOCK_REALTIME, &start);
+    double start_wall = telemetry_wall_time();
+    pid_t pid = fork();
+    if(pid < 0){
+        fprintf(stderr, "Error: failed to start %s\n", command[0]);
+        return EXIT_FAILURE;
+    }
+    if(pid == 0){
+        execvp(command[0], command);
+        fprintf(stderr, "Error: failed to run %s: %s\n", command[0], strerror(errno));
+        _exit(127);
+    }
+    // the usage of the child includes every descendant it waited for, which is how bbmap.sh's java is counted
+    int status;
+    struct rusage usage;
+    while(wait4(pid, &status, 0, &usage) < 0){
+        if(errno != EINTR){
+            fprintf(stderr, "Error: failed to wait for %s\n", command[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    double wall = telemetry_wall_time() - start_wall;
+    double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    FILE* fp = fopen(measurement_location, "w");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", measurement_location);
+    }else{
+        fprintf(fp, "%.3f\t%.3f\t%.3f\t%ld\n", start.tv_sec + start.tv_nsec / 1e9, wall, cpu, usage.ru_maxrss);
+        fclose(fp);
+    }
+    if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+// write the telemetry record of a measured stage
+static int record(char* measurement_location, char* tool, char* stage, const char* unit, uint64_t items, char** inputs, uint32_t num_inputs,
+                  char** outputs, uint32_t num_outputs){
+    FILE* fp = fopen(measurement_location, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open %s\n", measurement_location);
+        return EXIT_FAILURE;
+    }
+    double start, wall, cpu;
+    long peak_rss_kb;
+    int fields = fscanf(fp, "%lf %lf %lf %ld", &start, &wall, &cpu, &peak_rss_kb);
+    fclose(fp);
+    if(fields != 4){
+        fprintf(stderr, "Error: %s is not a measurement written by stagerun -m\n", measurement_location);
+        return EXIT_FAILURE;
+    }
+    uint64_t bytes_in = 0, bytes_out = 0;
+    for(uint32_t i=0; i<num_inputs; ++i) bytes_in += path_bytes(inputs[i]);
+    for(uint32_t i=0; i<num_outputs; ++i) bytes_out += path_bytes(outputs[i]);
+    telemetry_write(tool, stage, start, wall, cpu, peak_rss_kb, bytes_in, bytes_out, items, unit);
+    remove(measurement_location);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv){
+    int opt;
+    char* measure_location = NULL;
+    char* record_location = NULL;
+    char* tool = NULL;
+    char* stage = NULL;
+    const char* unit = "reads";
+    uint64_t items = 0;
+    char* inputs[MAX_PATHS];
+    char* outputs[MAX_PATHS];
+    uint32_t num_inputs = 0;
+    uint32_t num_outputs = 0;
+
+    // parse options, the leading + stops at the command so its own options are left alone
+    while ((opt = getopt(argc, argv, "+m:r:t:s:u:n:i:o:h")) != -1) {
+        switch (opt) {
+            case 'm': {
+                measure_location = optarg;
+            } break;
+            case 'r': {
+                record_location = optarg;
+            } break;
+            case 't': {
+                tool = optarg;
+            } break;
+            case 's': {
+                stage = optarg;
+            } break;
+            case 'u': {
+                unit = optarg;
+            } break;
+            case 'n': {
+                items = strtoull(optarg, NULL, 10);
+            } break;
+            case 'i': {
+                if(num_inputs == MAX_PATHS){
+                    fprintf(stderr, "Error: at most %d inputs can be given\n", MAX_PATHS);
+                    return EXIT_FAILURE;
+                }
+                inputs[num_inputs++] = optarg;
+            } break;
+            case 'o': {
+                if(num_outputs == MAX_PATHS){
+                    fprintf(stderr, "Error: at most %d outputs can be given\n", MAX_PATHS);
+                    return EXIT_FAILURE;
+                }
+                outputs[num_outputs++] = optarg;
+            } break;
+            case 'h': {
+                printf(USAGE);
+                return EXIT_SUCCESS;
+            }
+            default: {
+                printf(USAGE);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if(measure_location != NULL && record_location == NULL && optind < argc){
+        return measure(measure_location, &argv[optind]);
+    }
+    if(record_location != NULL && measure_location == NULL && tool != NULL && stage != NULL && optind == argc){
+        return record(record_location, tool, stage, unit, items, inputs, num_inputs, outputs, num_outputs);
+    }
+    printf(USAGE);
+    return EXIT_FAILURE;
+}
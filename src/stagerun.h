@@ -0,0 +1,30 @@
+#include <errno.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "telemetry.h"
+
+#define MAX_PATHS 256 // files given with -i or -o
+#define USAGE                                                                                                                                        \
+    "USAGE: stagerun -m path/to/measurement -- command [ARGUMENTS]\n"                                                                                \
+    "       stagerun -r path/to/measurement -t tool -s stage [OPTIONS]\n"                                                                            \
+    "stagerun adds the stages of tools outside StrainR (fastp, bbmap, samtools...) to the telemetry log set by STRAINR_TELEMETRY\n"                  \
+    "\tMeasuring Arguments:\n"                                                                                                                       \
+    "\t\t-m path/to/measurement\t: run the command and save its start, wall time, CPU time, and peak RSS (of it and the processes it waited for)\n"  \
+    "\tRecording Arguments:\n"                                                                                                                       \
+    "\t\t-r path/to/measurement\t: measurement saved by stagerun -m, removed once recorded\n"                                                        \
+    "\t\t-t tool\t\t\t: name of the tool\n"                                                                                                          \
+    "\t\t-s stage\t\t: name of the stage\n"                                                                                                          \
+    "\t\t-u unit\t\t\t: what the items counted are [Default = reads]\n"                                                                              \
+    "\t\t-n number\t\t: items processed [Default = 0]\n"                                                                                             \
+    "\t\t-i path/to/input\t: file read by the stage, may be given more than once, directories count every file under them\n"                         \
+    "\t\t-o path/to/output\t: file written by the stage, may be given more than once, directories count every file under them\n"                     \
+    "\t\t-h\t\t\t: display this message again\n"
+
+/*
+ * Measuring and recording are separate steps so the items a stage processed can be taken from what it wrote, such as the
+ * reads of a fastp report or of an rpkm file, before its record is written
+ * Measurement file: one line with the start (seconds since the epoch), wall seconds, CPU seconds, and peak RSS in kB
+ * The command's exit status is passed on, a failed command is measured but it is up to the caller whether to record it
+ */
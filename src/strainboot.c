@@ -0,0 +1,313 @@
+#include "strainboot.h"
+
+/*
+ * Bootstrap confidence intervals of the abundances StrainR reports, see strainboot.h
+ * Plot.R only gives a point estimate per strain, resampling thousands of subcontigs a thousand times over is left to this
+ */
+
+static int compare_doubles(const void* a, const void* b){
+    double x = *(double*) a;
+    double y = *(double*) b;
+    return x < y ? -1 : x > y;
+}
+
+static int compare_strain_names(const void* a, const void* b){
+    return strcmp(((strain_subcontigs*) a)->name, ((strain_subcontigs*) b)->name);
+}
+
+static inline uint64_t mix64(uint64_t z){
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// splitmix64, a generator with 64 bits of state is plenty to draw subcontig indices and cheap to seed per replicate
+static inline uint64_t next_random(uint64_t* state){
+    return mix64(*state += 0x9E3779B97F4A7C15ULL);
+}
+
+// return the subcontigs of strain_name, adding an empty strain if it does not exist yet
+static strain_subcontigs* find_strain(abundance_table* table, char* strain_name){
+    for(uint32_t i=table->num_strains; i>0; --i){
+        // the subcontigs of a strain are next to each other in the table, so the search starts from the last strain
+        if(strcmp(table->strains[i-1].name, strain_name) == 0) return &table->strains[i-1];
+    }
+    if(table->num_strains == table->strains_capacity){
+        table->strains_capacity *= 2;
+        table->strains = realloc(table->strains, table->strains_capacity * sizeof(strain_subcontigs));
+    }
+    strain_subcontigs* strain = &table->strains[table->num_strains++];
+    strain->name = strdup(strain_name);
+    strain->capacity = 64;
+    strain->subcontigs = malloc(strain->capacity * sizeof(weighted_value));
+    strain->count = 0;
+    return strain;
+}
+
+// split a line into its tab separated fields in place, returns the number of fields
+static uint32_t split_fields(char* line, char** fields, uint32_t max_fields){
+    uint32_t count = 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    while(count < max_fields){
+        fields[count++] = line;
+        char* tab = strchr(line, '\t');
+        if(tab == NULL) break;
+        *tab = '\0';
+        line = tab + 1;
+    }
+    return count;
+}
+
+static int32_t find_column(char** fields, uint32_t num_fields, const char* column){
+    for(uint32_t i=0; i<num_fields; ++i){
+        if(strcmp(fields[i], column) == 0) return i;
+    }
+    return -1;
+}
+
+// read the StrainID, Unique_Kmers, and FUKM of every subcontig, subcontigs with an FUKM of NA are dropped as Plot.R drops them
+abundance_table* abundance_table_read(char* abundances_location){
+    FILE* fp = fopen(abundances_location, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open abundances %s\n", abundances_location);
+        return NULL;
+    }
+    char* line = NULL;
+    size_t max_len = 0;
+    char* fields[64];
+    if(getline(&line, &max_len, fp) == -1){
+        fprintf(stderr, "Error: abundances %s are empty\n", abundances_location);
+        free(line);
+        fclose(fp);
+        return NULL;
+    }
+    uint32_t num_columns = split_fields(line, fields, 64);
+    int32_t strain_column = find_column(fields, num_columns, "StrainID");
+    int32_t kmers_column = find_column(fields, num_columns, "Unique_Kmers");
+    int32_t fukm_column = find_column(fields, num_columns, "FUKM");
+    if(strain_column < 0 || kmers_column < 0 || fukm_column < 0){
+        fprintf(stderr, "Error: %s has no StrainID, Unique_Kmers, and FUKM columns\n", abundances_location);
+        free(line);
+        fclose(fp);
+        return NULL;
+    }
+
+    abundance_table* table = malloc(sizeof(abundance_table));
+    table->strains_capacity = 16;
+    table->strains = calloc(table->strains_capacity, sizeof(strain_subcontigs));
+    table->num_strains = 0;
+    table->max_subcontigs = 0;
+    table->num_subcontigs = 0;
+    while(getline(&line, &max_len, fp) != -1){
+        if(split_fields(line, fields, 64) != num_columns){
+            fprintf(stderr, "Error: a line of %s does not have %d columns\n", abundances_location, num_columns);
+            abundance_table_destroy(table);
+            table = NULL;
+            break;
+        }
+        strain_subcontigs* strain = find_strain(table, fields[strain_column]);
+        char* end;
+        double fukm = strtod(fields[fukm_column], &end);
+        if(end == fields[fukm_column] || *end != '\0' || isnan(fukm)) continue;
+        if(strain->count == strain->capacity){
+            strain->capacity *= 2;
+            strain->subcontigs = realloc(strain->subcontigs, strain->capacity * sizeof(weighted_value));
+        }
+        strain->subcontigs[strain->count].value = fukm;
+        strain->subcontigs[strain->count].weight = strtoull(fields[kmers_column], NULL, 10);
+        ++strain->count;
+        if(strain->count > table->max_subcontigs) table->max_subcontigs = strain->count;
+        ++table->num_subcontigs;
+    }
+    free(line);
+    fclose(fp);
+    // strains are reported in the order of the abundance summary Plot.R writes
+    if(table != NULL) qsort(table->strains, table->num_strains, sizeof(strain_subcontigs), compare_strain_names);
+    return table;
+}
+
+void abundance_table_destroy(abundance_table* table){
+    for(uint32_t i=0; i<table->num_strains; ++i){
+        free(table->strains[i].name);
+        free(table->strains[i].subcontigs);
+    }
+    free(table->strains);
+    free(table);
+}
+
+// run a worker's replicates, every strain of a replicate is resampled with the replicate's own generator
+static void* run_replicates(void* arg){
+    boot_worker* worker = (boot_worker*) arg;
+    abundance_table* table = worker->table;
+    weighted_value* resample = malloc((table->max_subcontigs + 1) * sizeof(weighted_value));
+    for(uint32_t replicate=worker->first_replicate; replicate<worker->first_replicate+worker->num_replicates; ++replicate){
+        // mixed rather than counted up from the seed, so the draws of neighbouring replicates do not overlap
+        uint64_t state = mix64(worker->seed ^ mix64((uint64_t) replicate + 1));
+        double total = 0;
+        for(uint32_t strain=0; strain<table->num_strains; ++strain){
+            strain_subcontigs* subcontigs = &table->strains[strain];
+            for(uint32_t i=0; i<subcontigs->count; ++i){
+                resample[i] = subcontigs->subcontigs[next_random(&state) % subcontigs->count];
+            }
+            double abundance = weighted_percentile(resample, subcontigs->count, worker->weighted_percentile);
+            worker->abundances[(uint64_t) strain * worker->total_replicates + replicate] = abundance;
+            if(!isnan(abundance)) total += abundance;
+        }
+        for(uint32_t strain=0; strain<table->num_strains; ++strain){
+            double abundance = worker->abundances[(uint64_t) strain * worker->total_replicates + replicate];
+            worker->percents[(uint64_t) strain * worker->total_replicates + replicate] = total > 0 ? abundance / total * 100 : NAN;
+        }
+    }
+    free(resample);
+    return NULL;
+}
+
+// sort the replicates of a strain, NAN last, and return how many are not NAN
+static uint32_t sort_replicates(double* replicates, uint32_t num_replicates){
+    uint32_t count = 0;
+    for(uint32_t i=0; i<num_replicates; ++i){
+        if(!isnan(replicates[i])) replicates[count++] = replicates[i];
+    }
+    qsort(replicates, count, sizeof(double), compare_doubles);
+    return count;
+}
+
+static void print_value(FILE* out, double value, const char* separator){
+    if(isnan(value)){
+        fprintf(out, "NA%s", separator);
+    }else{
+        fprintf(out, "%.15g%s", value, separator);
+    }
+}
+
+int main(int argc, char **argv){
+    int opt;
+    char* abundances_location = NULL;
+    char* out_location = NULL;
+    double percentile = 60;
+    double level = 95;
+    uint32_t num_replicates = 1000;
+    uint64_t seed = 1;
+    uint32_t num_threads = 1;
+
+    // parse options
+    while ((opt = getopt(argc, argv, "i:o:c:b:l:s:t:h")) != -1) {
+        switch (opt) {
+            case 'i': {
+                abundances_location = optarg;
+            } break;
+            case 'o': {
+                out_location = optarg;
+            } break;
+            case 'c': {
+                percentile = atof(optarg);
+            } break;
+            case 'b': {
+                num_replicates = atoi(optarg);
+            } break;
+            case 'l': {
+                level = atof(optarg);
+            } break;
+            case 's': {
+                seed = strtoull(optarg, NULL, 10);
+            } break;
+            case 't': {
+                num_threads = atoi(optarg);
+            } break;
+            case 'h': {
+                printf(USAGE);
+                return EXIT_SUCCESS;
+            }
+            default: {
+                printf(USAGE);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if(abundances_location == NULL || out_location == NULL || num_replicates == 0 || num_threads == 0) {
+        printf(USAGE);
+        return EXIT_FAILURE;
+    }
+    if(percentile <= 0 || percentile > 100 || level <= 0 || level >= 100){
+        fprintf(stderr, "Error: the weighted percentile must be above 0 and at most 100, the confidence level between 0 and 100\n");
+        return EXIT_FAILURE;
+    }
+
+    telemetry_stage stage;
+    telemetry_begin(&stage, "strainboot", "bootstrap", "subcontigs");
+    abundance_table* table = abundance_table_read(abundances_location);
+    if(table == NULL) return EXIT_FAILURE;
+    if(num_threads > num_replicates) num_threads = num_replicates;
+
+    double* abundances = malloc(((uint64_t) table->num_strains * num_replicates + 1) * sizeof(double));
+    double* percents = malloc(((uint64_t) table->num_strains * num_replicates + 1) * sizeof(double));
+    boot_worker* workers = calloc(num_threads, sizeof(boot_worker));
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    uint32_t first = 0;
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].table = table;
+        workers[i].weighted_percentile = percentile;
+        workers[i].seed = seed;
+        workers[i].first_replicate = first;
+        workers[i].num_replicates = num_replicates / num_threads + (i < num_replicates % num_threads);
+        workers[i].total_replicates = num_replicates;
+        workers[i].abundances = abundances;
+        workers[i].percents = percents;
+        first += workers[i].num_replicates;
+        if(pthread_create(&threads[i], NULL, run_replicates, &workers[i]) != 0){
+            fprintf(stderr, "Error: failed to start bootstrap thread\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for(uint32_t i=0; i<num_threads; ++i) pthread_join(threads[i], NULL);
+
+    // the abundances of the sample itself, as in the abundance summary
+    double* estimates = calloc(table->num_strains + 1, sizeof(double));
+    double total = 0;
+    for(uint32_t strain=0; strain<table->num_strains; ++strain){
+        estimates[strain] = weighted_percentile(table->strains[strain].subcontigs, table->strains[strain].count, percentile);
+        if(!isnan(estimates[strain])) total += estimates[strain];
+    }
+
+    FILE* out = fopen(out_location, "w");
+    if(out == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", out_location);
+        return EXIT_FAILURE;
+    }
+    double lower = (100 - level) / 200;
+    double upper = 1 - lower;
+    fprintf(out, "StrainID\tweighted_percentile_FUKM\tFUKM_lower\tFUKM_upper\tpercent_abundance\tpercent_abundance_lower\t"
+                 "percent_abundance_upper\tsubcontigs\treplicates\n");
+    for(uint32_t strain=0; strain<table->num_strains; ++strain){
+        double* strain_abundances = &abundances[(uint64_t) strain * num_replicates];
+        double* strain_percents = &percents[(uint64_t) strain * num_replicates];
+        uint32_t abundance_count = sort_replicates(strain_abundances, num_replicates);
+        uint32_t percent_count = sort_replicates(strain_percents, num_replicates);
+        fprintf(out, "%s\t", table->strains[strain].name);
+        print_value(out, estimates[strain], "\t");
+        print_value(out, quantile(strain_abundances, abundance_count, lower), "\t");
+        print_value(out, quantile(strain_abundances, abundance_count, upper), "\t");
+        print_value(out, total > 0 ? estimates[strain] / total * 100 : NAN, "\t");
+        print_value(out, quantile(strain_percents, percent_count, lower), "\t");
+        print_value(out, quantile(strain_percents, percent_count, upper), "\t");
+        fprintf(out, "%d\t%d\n", table->strains[strain].count, abundance_count);
+    }
+    bool written = !ferror(out);
+    if(fclose(out) != 0 || !written){
+        fprintf(stderr, "Error: failed to write %s\n", out_location);
+        return EXIT_FAILURE;
+    }
+    stage.bytes_in = telemetry_file_size(abundances_location);
+    stage.bytes_out = telemetry_file_size(out_location);
+    stage.items = (uint64_t) num_replicates * table->num_subcontigs;
+    telemetry_end(&stage);
+
+    printf("%d strains resampled %d times, the intervals can be found in %s\n", table->num_strains, num_replicates, out_location);
+    free(estimates);
+    free(abundances);
+    free(percents);
+    free(workers);
+    free(threads);
+    abundance_table_destroy(table);
+}
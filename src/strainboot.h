@@ -0,0 +1,60 @@
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry.h"
+#include "abundance.h"
+
+#define USAGE                                                                                                                                        \
+    "USAGE: strainboot -i path/to/prefix.abundances -o path/to/out.tsv [OPTIONS]\n"                                                                  \
+    "strainboot estimates confidence intervals of strain abundances by resampling the subcontigs of each strain\n"                                   \
+    "\tRequired Arguments:\n"                                                                                                                        \
+    "\t\t-i path/to/abundances\t: .abundances table written by Plot.R\n"                                                                             \
+    "\t\t-o path/to/out.tsv\t: file to write the abundance and interval of each strain to\n"                                                         \
+    "\tOptional Arguments:\n"                                                                                                                        \
+    "\t\t-c number\t\t: weighted percentile of a strain's FUKMs used as its abundance, as StrainR -c [Default = 60]\n"                               \
+    "\t\t-b number\t\t: number of bootstrap resamples [Default = 1000]\n"                                                                            \
+    "\t\t-l number\t\t: confidence level of the intervals in percent [Default = 95]\n"                                                               \
+    "\t\t-s number\t\t: seed of the resampling, the same seed gives the same intervals whatever the number of threads [Default = 1]\n"              \
+    "\t\t-t number\t\t: number of threads [Default = 1]\n"                                                                                           \
+    "\t\t-h\t\t\t: display this message again\n"
+
+/*
+ * The abundance of a strain is the weighted percentile of its subcontigs' FUKMs, weighted by unique k-mers, as in Plot.R
+ * A resample draws as many subcontigs as the strain has from its subcontigs with replacement, and every strain is resampled
+ * in every replicate, so the percent abundances of a replicate add up to 100 like those of the sample
+ * Replicates are split between threads, and each replicate draws from its own generator seeded by the seed and its number
+ */
+
+typedef struct strain_subcontigs{
+    char* name;
+    weighted_value* subcontigs; // FUKM and unique k-mers of every subcontig with an FUKM
+    uint32_t count;
+    uint32_t capacity;
+} strain_subcontigs;
+
+typedef struct abundance_table{
+    strain_subcontigs* strains;
+    uint32_t num_strains;
+    uint32_t strains_capacity;
+    uint32_t max_subcontigs; // subcontigs of the largest strain, the size of a resample
+    uint64_t num_subcontigs;
+} abundance_table;
+
+typedef struct boot_worker{
+    abundance_table* table;
+    double weighted_percentile;
+    uint64_t seed;
+    uint32_t first_replicate;
+    uint32_t num_replicates;
+    uint32_t total_replicates;
+    double* abundances; // abundances[strain * total_replicates + replicate], shared, each worker fills its own replicates
+    double* percents;
+} boot_worker;
+
+abundance_table* abundance_table_read(char* abundances_location);
+void abundance_table_destroy(abundance_table* table);
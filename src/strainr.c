@@ -0,0 +1,268 @@
+#include "strainr.h"
+#include "hashtable.h"
+#include "subcontigsplit.h"
+
+/*
+ * libstrainr's API over the hashtable (hashtable.c), the sort engine (kmersort.c), and genome splitting (subcontigsplit.c)
+ * hashcounter and subcontig are built on these same calls
+ */
+
+// only one of ht and sorter is used, depending on the engine
+struct strainr_table{
+    strainr_options options;
+    read_ahead_options read_ahead;
+    hashtable* ht;
+    kmer_sorter* sorter;
+    bool finished;
+};
+
+typedef struct split_callback{
+    strainr_subcontig_func func;
+    void* context;
+} split_callback;
+
+void strainr_options_init(strainr_options* options, uint32_t kmer_size){
+    options->kmer_size = kmer_size;
+    options->num_threads = 1;
+    options->engine = STRAINR_HASHTABLE;
+    options->incremental_resize = false;
+    options->memory_efficient = false;
+    options->expected_subcontigs = REGISTRY_INITIAL_SUBCONTIGS;
+    options->reader_threads = READ_AHEAD_THREADS;
+    options->read_ahead_depth = READ_AHEAD_DEPTH;
+    options->read_ahead_bytes = (size_t) READ_AHEAD_MEMORY << 20;
+}
+
+static bool readable(const char* location){
+    FILE* fp = fopen(location, "r");
+    if(fp == NULL) return false;
+    fclose(fp);
+    return true;
+}
+
+int strainr_genome_n50(const char* genome_location, int min_subcontig_size){
+    if(!readable(genome_location)) return STRAINR_ERROR;
+    return genomeN50((char*) genome_location, min_subcontig_size);
+}
+
+static void split_to_callback(void* context, char* header, char* file_name, char* seq, int length, bool excluded){
+    split_callback* callback = (split_callback*) context;
+    callback->func(callback->context, header, seq, length, excluded);
+}
+
+int strainr_split_genome(const char* genome_location, const char* strain_id, int max_subcontig_size, int min_subcontig_size,
+                         strainr_subcontig_func func, void* context){
+    if(!readable(genome_location) || max_subcontig_size <= 0) return STRAINR_ERROR;
+    split_callback callback = {func, context};
+    int* contig_lengths = getContigLengths((char*) genome_location, min_subcontig_size, NULL);
+    splitGenome((char*) genome_location, (char*) strain_id, contig_lengths, max_subcontig_size, min_subcontig_size, split_to_callback,
+                &callback);
+    free(contig_lengths);
+    return STRAINR_OK;
+}
+
+strainr_table* strainr_table_create(const strainr_options* options){
+    if(options->kmer_size < STRAINR_MIN_KMER_SIZE || options->num_threads == 0 || options->reader_threads == 0 || options->read_ahead_depth == 0) return NULL;
+    if(options->memory_efficient && options->engine != STRAINR_HASHTABLE) return NULL;
+    strainr_table* table = malloc(sizeof(strainr_table));
+    table->options = *options;
+    if(table->options.expected_subcontigs == 0) table->options.expected_subcontigs = 1;
+    table->read_ahead.num_threads = options->reader_threads;
+    table->read_ahead.depth = options->read_ahead_depth;
+    table->read_ahead.max_bytes = options->read_ahead_bytes;
+    table->ht = NULL;
+    table->sorter = NULL;
+    if(options->engine == STRAINR_SORT){
+        table->sorter = kmer_sorter_create(options->kmer_size, table->options.expected_subcontigs, options->num_threads);
+    }else{
+        table->ht = hashtable_create(options->kmer_size, options->memory_efficient, table->options.expected_subcontigs,
+                                     options->num_threads, options->incremental_resize);
+    }
+    table->finished = false;
+    return table;
+}
+
+void strainr_table_destroy(strainr_table* table){
+    if(table->ht != NULL) hashtable_destroy(table->ht);
+    if(table->sorter != NULL) kmer_sorter_destroy(table->sorter);
+    free(table);
+}
+
+int64_t strainr_table_add(strainr_table* table, const char* name, const char* seq, bool excluded){
+    if(table->finished) return STRAINR_ERROR;
+    if(table->ht != NULL) return hashtable_add_subcontig(table->ht, name, (char*) seq, excluded);
+    return kmer_sorter_add_subcontig(table->sorter, name, (char*) seq, strlen(seq), excluded);
+}
+
+int strainr_table_add_dir(strainr_table* table, const char* dir_location, bool excluded){
+    if(table->finished) return STRAINR_ERROR;
+    DIR* dr = opendir(dir_location);
+    if(dr == NULL) return STRAINR_ERROR;
+    closedir(dr);
+    // file names are appended to the directory as is
+    char* dir = calloc(strlen(dir_location) + 2, sizeof(char));
+    strcpy(dir, dir_location);
+    if(dir[strlen(dir)-1] != '/') strcat(dir, "/");
+    if(table->ht != NULL){
+        hash_and_insert(table->ht, dir, excluded, &table->read_ahead);
+    }else{
+        kmer_sorter_add_dir(table->sorter, dir, excluded, &table->read_ahead);
+    }
+    free(dir);
+    return STRAINR_OK;
+}
+
+static void add_to_table(void* context, const char* header, const char* seq, uint32_t length, bool excluded){
+    strainr_table_add((strainr_table*) context, header, seq, excluded);
+}
+
+int strainr_table_add_genome(strainr_table* table, const char* genome_location, const char* strain_id, int max_subcontig_size,
+                             int min_subcontig_size){
+    if(table->finished) return STRAINR_ERROR;
+    return strainr_split_genome(genome_location, strain_id, max_subcontig_size, min_subcontig_size, add_to_table, table);
+}
+
+void strainr_table_finish(strainr_table* table){
+    if(table->finished) return;
+    if(table->ht != NULL){
+        hashtable_finish_resize(table->ht);
+    }else{
+        kmer_sorter_sort(table->sorter);
+        kmer_sorter_count(table->sorter);
+    }
+    table->finished = true;
+}
+
+// return a copy of the lexicographically smaller of the first kmer_size bases of kmer and their reverse complement
+static char* canonical_kmer(const char* kmer, uint32_t kmer_size){
+    char* forward = calloc(kmer_size + 1, sizeof(char));
+    memcpy(forward, kmer, kmer_size);
+    char* reverse = reverse_complement(forward);
+    if(strncmp(forward, reverse, kmer_size) < 0){
+        free(reverse);
+        return forward;
+    }
+    free(forward);
+    return reverse;
+}
+
+uint64_t strainr_kmer_hash(const char* kmer, uint32_t kmer_size){
+    char* canonical = canonical_kmer(kmer, kmer_size);
+    uint64_t hash = MurmurHash64A(canonical, kmer_size, (uint64_t)HASH_SEED);
+    free(canonical);
+    return hash;
+}
+
+strainr_kmer_status strainr_table_query(strainr_table* table, const char* kmer, uint32_t* subcontig_id){
+    uint32_t kmer_size = table->options.kmer_size;
+    if(strnlen(kmer, kmer_size) < kmer_size || memchr(kmer, 'N', kmer_size) != NULL) return STRAINR_ABSENT;
+    if(table->ht != NULL && table->ht->is_small){
+        strainr_table_finish(table);
+        char* canonical = canonical_kmer(kmer, kmer_size);
+        ht_element_small* item = hashtable_find_small(table->ht, MurmurHash3_x86_32(canonical, kmer_size, (uint32_t)HASH_SEED));
+        free(canonical);
+        if(item == NULL) return STRAINR_ABSENT;
+        if((item->value >> 30) != UNIQUE) return STRAINR_NON_UNIQUE;
+        if(subcontig_id != NULL) *subcontig_id = item->value & 0x3FFFFFFF;
+        return STRAINR_UNIQUE;
+    }
+    return strainr_table_query_hash(table, strainr_kmer_hash(kmer, kmer_size), subcontig_id);
+}
+
+strainr_kmer_status strainr_table_query_hash(strainr_table* table, uint64_t hash, uint32_t* subcontig_id){
+    strainr_table_finish(table);
+    uint32_t owner;
+    bool unique;
+    if(table->ht != NULL){
+        if(table->ht->is_small) return STRAINR_ABSENT;
+        ht_element* item = hashtable_find(table->ht, hash);
+        if(item == NULL) return STRAINR_ABSENT;
+        owner = item->subcontig_id;
+        unique = item->status == UNIQUE;
+    }else{
+        uint64_t run_length;
+        kmer_record* record = kmer_sorter_find(table->sorter, hash, &run_length);
+        if(record == NULL) return STRAINR_ABSENT;
+        owner = record->subcontig_id;
+        unique = run_length == 1 && !record->excluded;
+    }
+    if(!unique) return STRAINR_NON_UNIQUE;
+    if(subcontig_id != NULL) *subcontig_id = owner;
+    return STRAINR_UNIQUE;
+}
+
+uint32_t strainr_table_num_subcontigs(strainr_table* table){
+    return table->ht != NULL ? table->ht->curr_subcontig : table->sorter->curr_subcontig;
+}
+
+const char* strainr_table_subcontig_name(strainr_table* table, uint32_t subcontig_id){
+    if(subcontig_id >= strainr_table_num_subcontigs(table)) return NULL;
+    return subcontig_registry_name(table->ht != NULL ? table->ht->registry : table->sorter->registry, subcontig_id);
+}
+
+uint32_t strainr_table_unique_count(strainr_table* table, uint32_t subcontig_id){
+    strainr_table_finish(table);
+    if(subcontig_id >= strainr_table_num_subcontigs(table)) return 0;
+    return table->ht != NULL ? table->ht->subcontig_counts[subcontig_id] : table->sorter->subcontig_counts[subcontig_id];
+}
+
+uint64_t strainr_table_distinct_kmers(strainr_table* table){
+    strainr_table_finish(table);
+    return table->ht != NULL ? table->ht->count : table->sorter->count;
+}
+
+uint64_t strainr_table_unique_kmers(strainr_table* table){
+    strainr_table_finish(table);
+    return table->ht != NULL ? sum_unique_hahses(table->ht) : kmer_sorter_unique_total(table->sorter);
+}
+
+void strainr_table_foreach_count(strainr_table* table, strainr_count_func func, void* context){
+    strainr_table_finish(table);
+    for(uint32_t i=0; i<strainr_table_num_subcontigs(table); ++i){
+        func(context, i, strainr_table_subcontig_name(table, i), strainr_table_unique_count(table, i));
+    }
+}
+
+void strainr_table_get_stats(strainr_table* table, strainr_table_stats* stats){
+    stats->subcontigs = strainr_table_num_subcontigs(table);
+    stats->bases = table->ht != NULL ? table->ht->bases_added : table->sorter->bases_added;
+    stats->kmers = table->ht != NULL ? table->ht->kmers_added : table->sorter->num_records;
+}
+
+// write tsv of unique hashes file
+int strainr_table_write_report(strainr_table* table, const char* report_location){
+    strainr_table_finish(table);
+    bool written;
+    if(table->ht != NULL){
+        written = subcontig_registry_write_report(table->ht->registry, table->ht->subcontig_counts, report_location);
+    }else{
+        written = subcontig_registry_write_report(table->sorter->registry, table->sorter->subcontig_counts, report_location);
+    }
+    return written ? STRAINR_OK : STRAINR_ERROR;
+}
+
+int strainr_table_write_index(strainr_table* table, const char* index_location){
+    if(table->ht != NULL && table->ht->is_small) return STRAINR_ERROR;
+    strainr_table_finish(table);
+    FILE* fp = fopen(index_location, "wb");
+    if(fp == NULL) return STRAINR_ERROR;
+    fclose(fp);
+    if(table->ht != NULL){
+        write_unique_kmers(table->ht, (char*) index_location);
+    }else{
+        kmer_sorter_write_unique_kmers(table->sorter, (char*) index_location);
+    }
+    return STRAINR_OK;
+}
+
+int strainr_table_write_filter(strainr_table* table, const char* filter_location){
+    if(table->ht != NULL && table->ht->is_small) return STRAINR_ERROR;
+    strainr_table_finish(table);
+    bool written;
+    if(table->ht != NULL){
+        written = write_kmer_filter(table->ht, (char*) filter_location);
+    }else{
+        written = kmer_sorter_write_kmer_filter(table->sorter, (char*) filter_location);
+    }
+    return written ? STRAINR_OK : STRAINR_ERROR;
+}
@@ -0,0 +1,110 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STRAINR_API_VERSION 2 // raised whenever a declaration below changes in a way that breaks existing callers
+#define STRAINR_OK 0
+#define STRAINR_ERROR -1
+#define STRAINR_MIN_KMER_SIZE 8 // the k-mer hash only takes the last of the bases after its 8 byte blocks, shorter k-mers hash alike
+
+/*
+ * libstrainr: the splitting and unique k-mer counting behind subcontig and hashcounter, for use without going through files
+ * A table is built from subcontigs (given as sequences, read from a directory of .subcontig files, or cut straight from a
+ * genome fasta), then queried for the uniqueness and owning subcontig of any k-mer and for the unique k-mer count of every
+ * subcontig. Writing KmerContent.report or UniqueKmers.index is optional
+ * A k-mer is unique when it occurs exactly once over every subcontig added and that subcontig is not excluded
+ * Functions returning int return STRAINR_OK or STRAINR_ERROR. Running out of memory, or input files that disappear or can
+ * not be read partway through, still end the process with an error message as the command line tools do
+ * A table may only be used by one thread at a time, the table uses its own threads internally
+ */
+
+typedef enum strainr_engine{
+    STRAINR_HASHTABLE = 0, // k-mers are inserted into a hashtable as they are added
+    STRAINR_SORT = 1 // k-mers are collected and radix sorted when the table is finished, uses more memory but scales with threads
+} strainr_engine;
+
+typedef enum strainr_kmer_status{
+    STRAINR_ABSENT = 0,
+    STRAINR_UNIQUE = 1,
+    STRAINR_NON_UNIQUE = 2
+} strainr_kmer_status;
+
+// k-mers hash every base when kmer_size is a multiple of 8 or one more, otherwise k-mers differing only in the bases after the
+// last multiple of 8, but not in the last base, share a hash (hashcounter's default of 301 leaves out 4 of every 301 bases)
+typedef struct strainr_options{
+    uint32_t kmer_size; // at least STRAINR_MIN_KMER_SIZE
+    uint32_t num_threads;
+    strainr_engine engine;
+    bool incremental_resize; // hashtable engine: move entries one chunk per subcontig when growing instead of all at once
+    bool memory_efficient; // hashtable engine: store 32 bit hashes, half the memory but distinct k-mers may collide
+    uint32_t expected_subcontigs; // initial room for subcontigs, the table grows past it as needed
+    uint32_t reader_threads; // threads reading subcontig files ahead of the hashing in strainr_table_add_dir
+    uint32_t read_ahead_depth; // subcontig files that may be read ahead
+    size_t read_ahead_bytes; // sequence that may be read ahead
+} strainr_options;
+
+// the table is opaque so its layout can change without breaking programs built against the library
+typedef struct strainr_table strainr_table;
+
+// what has gone into a table so far
+typedef struct strainr_table_stats{
+    uint32_t subcontigs;
+    uint64_t bases;
+    uint64_t kmers; // k-mers hashed, those with an N are skipped (sort engine: subcontigs added one at a time are hashed in batches)
+} strainr_table_stats;
+
+// called by strainr_split_genome for each subcontig, header is the subcontig's fasta header without the >
+typedef void (*strainr_subcontig_func)(void* context, const char* header, const char* seq, uint32_t length, bool excluded);
+// called by strainr_table_foreach_count for each subcontig in the order they were added
+typedef void (*strainr_count_func)(void* context, uint32_t subcontig_id, const char* name, uint32_t num_unique);
+
+// fill options with the defaults of hashcounter for the given k-mer size
+void strainr_options_init(strainr_options* options, uint32_t kmer_size);
+
+// splitting
+// N50 of a genome's contigs longer than min_subcontig_size (subcontig uses the smallest over all genomes as maximum size)
+int strainr_genome_n50(const char* genome_location, int min_subcontig_size);
+// cut a genome fasta into subcontigs as subcontig does and pass each to func
+int strainr_split_genome(const char* genome_location, const char* strain_id, int max_subcontig_size, int min_subcontig_size,
+                         strainr_subcontig_func func, void* context);
+
+// building a table
+// returns NULL when the options are invalid, such as a kmer_size below STRAINR_MIN_KMER_SIZE
+strainr_table* strainr_table_create(const strainr_options* options);
+void strainr_table_destroy(strainr_table* table);
+// add one subcontig, returns its id (ids count up from 0 in the order subcontigs are added) or STRAINR_ERROR once finished
+int64_t strainr_table_add(strainr_table* table, const char* name, const char* seq, bool excluded);
+// add every .subcontig file in a directory (as written by subcontig) in directory order
+int strainr_table_add_dir(strainr_table* table, const char* dir_location, bool excluded);
+// cut a genome into subcontigs and add them, without writing any files
+int strainr_table_add_genome(strainr_table* table, const char* genome_location, const char* strain_id, int max_subcontig_size,
+                             int min_subcontig_size);
+// settle every k-mer's uniqueness, no subcontigs can be added afterwards
+// called by the functions below if it has not been already
+void strainr_table_finish(strainr_table* table);
+
+// querying a table
+// hash of the canonical form of the first kmer_size bases of kmer, as stored in UniqueKmers.index
+uint64_t strainr_kmer_hash(const char* kmer, uint32_t kmer_size);
+// status of the first kmer_size bases of kmer, subcontig_id (may be NULL) is set to its owner when it is unique
+strainr_kmer_status strainr_table_query(strainr_table* table, const char* kmer, uint32_t* subcontig_id);
+// same as strainr_table_query given strainr_kmer_hash of the k-mer, not available for memory-efficient tables
+strainr_kmer_status strainr_table_query_hash(strainr_table* table, uint64_t hash, uint32_t* subcontig_id);
+uint32_t strainr_table_num_subcontigs(strainr_table* table);
+// name of a subcontig, or NULL if there is no subcontig with that id, the string belongs to the table and is only valid until the
+// next call (names are kept as their fields and put back together on request)
+const char* strainr_table_subcontig_name(strainr_table* table, uint32_t subcontig_id);
+uint32_t strainr_table_unique_count(strainr_table* table, uint32_t subcontig_id);
+uint64_t strainr_table_distinct_kmers(strainr_table* table);
+uint64_t strainr_table_unique_kmers(strainr_table* table);
+void strainr_table_foreach_count(strainr_table* table, strainr_count_func func, void* context);
+void strainr_table_get_stats(strainr_table* table, strainr_table_stats* stats);
+
+// writing a table
+// KmerContent.report as written by hashcounter, without the subcontigs of excluded contigs
+int strainr_table_write_report(strainr_table* table, const char* report_location);
+// UniqueKmers.index as written by hashcounter -u, not available for memory-efficient tables
+int strainr_table_write_index(strainr_table* table, const char* index_location);
+// filter of every k-mer in the table, not available for memory-efficient tables
+// k-mers are hashed with their bases as added, hashcounter -f instead rereads the subcontigs uppercased for ReferenceKmers.filter
+int strainr_table_write_filter(strainr_table* table, const char* filter_location);
@@ -0,0 +1,481 @@
+#include "strainscreen.h"
+#include "kseq.h"
+
+/*
+ * Presence screening of strains before mapping
+ * PreProcessR sketches every strain of the reference once, a sample is screened by hashing its reads the same way and
+ * marking which sketch hashes they contain
+ * Hashes found in only one strain's sketch decide whether that strain is present, since hashes shared with a present
+ * relative would make an absent strain look present
+ * Reads are read in batches which are split between threads, threads only ever set seen flags so they need no locking
+ */
+
+KSEQ_INIT(gzFile, gzread)
+
+static uint64_t max_sketch_hash(uint32_t scale){
+    return UINT64_MAX / scale;
+}
+
+static int compare_hashes(const void* a, const void* b){
+    uint64_t first = *(const uint64_t*) a;
+    uint64_t second = *(const uint64_t*) b;
+    return (first > second) - (first < second);
+}
+
+// return the sketch of strain_name, adding an empty one if it does not exist yet
+static strain_sketch* find_strain(sketch_set* sketches, char* strain_name){
+    for(uint32_t i=sketches->num_strains; i>0; --i){
+        // subcontigs of a strain are mostly next to each other, so the search starts from the last strain
+        if(strcmp(sketches->strains[i-1].name, strain_name) == 0) return &sketches->strains[i-1];
+    }
+    if(sketches->num_strains == sketches->strains_capacity){
+        sketches->strains_capacity *= 2;
+        sketches->strains = realloc(sketches->strains, sketches->strains_capacity * sizeof(strain_sketch));
+    }
+    strain_sketch* strain = &sketches->strains[sketches->num_strains++];
+    strain->name = strdup(strain_name);
+    strain->capacity = 1024;
+    strain->hashes = malloc(strain->capacity * sizeof(uint64_t));
+    strain->count = 0;
+    return strain;
+}
+
+static sketch_set* sketch_set_create(uint32_t kmer_size, uint32_t scale){
+    sketch_set* sketches = malloc(sizeof(sketch_set));
+    sketches->strains_capacity = 16;
+    sketches->strains = calloc(sketches->strains_capacity, sizeof(strain_sketch));
+    sketches->num_strains = 0;
+    sketches->kmer_size = kmer_size;
+    sketches->scale = scale;
+    return sketches;
+}
+
+sketch_set* sketch_reference(char* reference_location, uint32_t kmer_size, uint32_t scale){
+    gzFile fp = gzopen(reference_location, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Error opening reference %s\n", reference_location);
+        return NULL;
+    }
+    kseq_t* seq = kseq_init(fp);
+    sketch_set* sketches = sketch_set_create(kmer_size, scale);
+    uint64_t max_hash = max_sketch_hash(scale);
+    uint64_t* hashes = NULL;
+    uint32_t hashes_capacity = 0;
+
+    while(kseq_read(seq) >= 0){
+        char* separator = strchr(seq->name.s, ';');
+        if(separator != NULL) *separator = '\0';
+        strain_sketch* strain = find_strain(sketches, seq->name.s);
+        if(seq->seq.l > hashes_capacity){
+            hashes_capacity = seq->seq.l;
+            hashes = realloc(hashes, hashes_capacity * sizeof(uint64_t));
+        }
+        // soft-masked bases are uppercased, as reads come uppercase and BBMap maps to them all the same
+        uppercase_bases(seq->seq.s, seq->seq.l);
+        uint32_t num_hashes = hash_canonical_sketch_kmers(seq->seq.s, seq->seq.l, kmer_size, hashes);
+        for(uint32_t i=0; i<num_hashes; ++i){
+            if(hashes[i] > max_hash) continue;
+            if(strain->count == strain->capacity){
+                strain->capacity *= 2;
+                strain->hashes = realloc(strain->hashes, strain->capacity * sizeof(uint64_t));
+            }
+            strain->hashes[strain->count++] = hashes[i];
+        }
+    }
+
+    // sort and remove duplicates
+    for(uint32_t i=0; i<sketches->num_strains; ++i){
+        strain_sketch* strain = &sketches->strains[i];
+        qsort(strain->hashes, strain->count, sizeof(uint64_t), compare_hashes);
+        uint64_t distinct = 0;
+        for(uint64_t j=0; j<strain->count; ++j){
+            if(distinct == 0 || strain->hashes[distinct-1] != strain->hashes[j]) strain->hashes[distinct++] = strain->hashes[j];
+        }
+        strain->count = distinct;
+    }
+
+    free(hashes);
+    kseq_destroy(seq);
+    gzclose(fp);
+    return sketches;
+}
+
+void sketch_set_write(sketch_set* sketches, char* sketch_location){
+    FILE* fp = fopen(sketch_location, "wb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", sketch_location);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(SKETCH_MAGIC, sizeof(char), strlen(SKETCH_MAGIC), fp);
+    fwrite(&sketches->kmer_size, sizeof(uint32_t), 1, fp);
+    fwrite(&sketches->scale, sizeof(uint32_t), 1, fp);
+    fwrite(&sketches->num_strains, sizeof(uint32_t), 1, fp);
+    for(uint32_t i=0; i<sketches->num_strains; ++i){
+        fwrite(sketches->strains[i].name, sizeof(char), strlen(sketches->strains[i].name)+1, fp);
+        fwrite(&sketches->strains[i].count, sizeof(uint64_t), 1, fp);
+        fwrite(sketches->strains[i].hashes, sizeof(uint64_t), sketches->strains[i].count, fp);
+    }
+    fclose(fp);
+}
+
+// read a NUL-terminated string from fp
+static char* read_name(FILE* fp){
+    uint32_t capacity = 128;
+    uint32_t len = 0;
+    char* name = malloc(capacity);
+    int c;
+    while((c = fgetc(fp)) != EOF && c != '\0'){
+        if(len+1 == capacity){
+            capacity *= 2;
+            name = realloc(name, capacity);
+        }
+        name[len++] = c;
+    }
+    if(c == EOF){
+        free(name);
+        return NULL;
+    }
+    name[len] = '\0';
+    return name;
+}
+
+sketch_set* sketch_set_load(char* sketch_location){
+    FILE* fp = fopen(sketch_location, "rb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open sketches %s\n", sketch_location);
+        exit(EXIT_FAILURE);
+    }
+    char magic[sizeof(SKETCH_MAGIC)] = {0};
+    uint32_t kmer_size, scale, num_strains;
+    if(fread(magic, sizeof(char), strlen(SKETCH_MAGIC), fp) != strlen(SKETCH_MAGIC) || strcmp(magic, SKETCH_MAGIC) != 0 ||
+       fread(&kmer_size, sizeof(uint32_t), 1, fp) != 1 || fread(&scale, sizeof(uint32_t), 1, fp) != 1 ||
+       fread(&num_strains, sizeof(uint32_t), 1, fp) != 1){
+        fprintf(stderr, "Error: %s is not a sketch file generated by strainscreen\n", sketch_location);
+        exit(EXIT_FAILURE);
+    }
+    sketch_set* sketches = sketch_set_create(kmer_size, scale);
+    for(uint32_t i=0; i<num_strains; ++i){
+        char* name = read_name(fp);
+        strain_sketch* strain = name == NULL ? NULL : find_strain(sketches, name);
+        free(name);
+        if(strain == NULL || fread(&strain->count, sizeof(uint64_t), 1, fp) != 1){
+            fprintf(stderr, "Error: sketch file %s is truncated\n", sketch_location);
+            exit(EXIT_FAILURE);
+        }
+        strain->capacity = strain->count > 0 ? strain->count : 1;
+        strain->hashes = realloc(strain->hashes, strain->capacity * sizeof(uint64_t));
+        if(fread(strain->hashes, sizeof(uint64_t), strain->count, fp) != strain->count){
+            fprintf(stderr, "Error: sketch file %s is truncated\n", sketch_location);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(fp);
+    return sketches;
+}
+
+void sketch_set_destroy(sketch_set* sketches){
+    for(uint32_t i=0; i<sketches->num_strains; ++i){
+        free(sketches->strains[i].name);
+        free(sketches->strains[i].hashes);
+    }
+    free(sketches->strains);
+    free(sketches);
+}
+
+screen_table* screen_table_create(sketch_set* sketches){
+    uint64_t total_hashes = 0;
+    for(uint32_t i=0; i<sketches->num_strains; ++i) total_hashes += sketches->strains[i].count;
+    screen_table* table = malloc(sizeof(screen_table));
+    table->size = 1;
+    while(table->size < 2*total_hashes) table->size <<= 1;
+    table->entry_bitmask = table->size - 1;
+    table->items = malloc(table->size * sizeof(screen_element));
+    for(uint64_t i=0; i<table->size; ++i){
+        table->items[i].key = 0;
+        table->items[i].owner = EMPTY_SLOT;
+        table->items[i].seen = 0;
+    }
+
+    for(uint32_t strain_id=0; strain_id<sketches->num_strains; ++strain_id){
+        strain_sketch* strain = &sketches->strains[strain_id];
+        for(uint64_t i=0; i<strain->count; ++i){
+            uint64_t key = strain->hashes[i];
+            screen_element* current_item = &(table->items[key & table->entry_bitmask]);
+            while(current_item->owner != EMPTY_SLOT && current_item->key != key){
+                ++current_item;
+                // reset to beginning of table if end is reached
+                if((uint64_t)(current_item - table->items) == table->size) current_item = table->items;
+            }
+            if(current_item->owner == EMPTY_SLOT){
+                current_item->key = key;
+                current_item->owner = strain_id;
+            }else if(current_item->owner != strain_id){
+                current_item->owner = SHARED_HASH;
+            }
+        }
+    }
+    return table;
+}
+
+void screen_table_destroy(screen_table* table){
+    free(table->items);
+    free(table);
+}
+
+// return the element holding key, or NULL if key is in no sketch
+screen_element* screen_table_find(screen_table* table, uint64_t key){
+    screen_element* current_item = &(table->items[key & table->entry_bitmask]);
+    while(current_item->owner != EMPTY_SLOT){
+        if(current_item->key == key) return current_item;
+        ++current_item;
+        if((uint64_t)(current_item - table->items) == table->size) current_item = table->items;
+    }
+    return NULL;
+}
+
+static sequence_batch* sequence_batch_create(){
+    sequence_batch* batch = malloc(sizeof(sequence_batch));
+    batch->reads = calloc(BATCH_SIZE, sizeof(char*));
+    batch->lens = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->capacity = calloc(BATCH_SIZE, sizeof(uint32_t));
+    batch->count = 0;
+    return batch;
+}
+
+static void sequence_batch_destroy(sequence_batch* batch){
+    for(uint32_t i=0; i<BATCH_SIZE; ++i) free(batch->reads[i]);
+    free(batch->reads);
+    free(batch->lens);
+    free(batch->capacity);
+    free(batch);
+}
+
+// fill a batch with up to max_reads reads, returns the number of reads read or -1 if the file is malformed
+static int32_t sequence_batch_fill(sequence_batch* batch, kseq_t* seq, uint32_t max_reads){
+    int status = 0;
+    batch->count = 0;
+    while(batch->count < max_reads && (status = kseq_read(seq)) >= 0){
+        if(seq->seq.l + 1 > batch->capacity[batch->count]){
+            batch->capacity[batch->count] = seq->seq.l + 1;
+            batch->reads[batch->count] = realloc(batch->reads[batch->count], batch->capacity[batch->count]);
+        }
+        memcpy(batch->reads[batch->count], seq->seq.s, seq->seq.l + 1);
+        batch->lens[batch->count] = seq->seq.l;
+        ++batch->count;
+    }
+    return status < -1 ? -1 : (int32_t) batch->count;
+}
+
+// thread function marking the sketch hashes found in one slice of a batch
+void* screen_batch(void* worker){
+    screen_worker* w = (screen_worker*) worker;
+    for(uint32_t i=w->start; i<w->end; ++i){
+        if(w->batch->lens[i] > w->hashes_capacity){
+            w->hashes_capacity = w->batch->lens[i];
+            w->hashes = realloc(w->hashes, w->hashes_capacity * sizeof(uint64_t));
+        }
+        uppercase_bases(w->batch->reads[i], w->batch->lens[i]);
+        uint32_t num_hashes = hash_canonical_sketch_kmers(w->batch->reads[i], w->batch->lens[i], w->kmer_size, w->hashes);
+        for(uint32_t j=0; j<num_hashes; ++j){
+            if(w->hashes[j] > w->max_hash) continue;
+            screen_element* element = screen_table_find(w->table, w->hashes[j]);
+            if(element != NULL && !__atomic_load_n(&element->seen, __ATOMIC_RELAXED)) __atomic_store_n(&element->seen, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// mark the sketch hashes contained in up to max_reads reads (all reads if 0) of read_location
+bool screen_reads(sketch_set* sketches, screen_table* table, char* read_location, uint32_t num_threads, uint64_t max_reads,
+                  uint64_t* reads_screened){
+    gzFile fp = gzopen(read_location, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Error opening reads %s\n", read_location);
+        return false;
+    }
+    kseq_t* seq = kseq_init(fp);
+    sequence_batch* batch = sequence_batch_create();
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    screen_worker* workers = calloc(num_threads, sizeof(screen_worker));
+    for(uint32_t i=0; i<num_threads; ++i){
+        workers[i].table = table;
+        workers[i].batch = batch;
+        workers[i].kmer_size = sketches->kmer_size;
+        workers[i].max_hash = max_sketch_hash(sketches->scale);
+    }
+
+    uint64_t remaining = max_reads == 0 ? UINT64_MAX : max_reads;
+    int32_t batch_size = 0;
+    while(remaining > 0 && (batch_size = sequence_batch_fill(batch, seq, remaining < BATCH_SIZE ? remaining : BATCH_SIZE)) > 0){
+        remaining -= batch->count;
+        *reads_screened += batch->count;
+        uint32_t slice = (batch->count + num_threads - 1) / num_threads;
+        for(uint32_t i=0; i<num_threads; ++i){
+            workers[i].start = i*slice < batch->count ? i*slice : batch->count;
+            workers[i].end = (i+1)*slice < batch->count ? (i+1)*slice : batch->count;
+            if(pthread_create(&threads[i], NULL, screen_batch, &workers[i]) != 0){
+                fprintf(stderr, "Error: failed to create thread\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for(uint32_t i=0; i<num_threads; ++i){
+            pthread_join(threads[i], NULL);
+        }
+    }
+    if(batch_size < 0) fprintf(stderr, "Error: %s is not a valid fastq file\n", read_location);
+
+    for(uint32_t i=0; i<num_threads; ++i) free(workers[i].hashes);
+    free(workers);
+    free(threads);
+    sequence_batch_destroy(batch);
+    kseq_destroy(seq);
+    gzclose(fp);
+    return batch_size >= 0;
+}
+
+// write the containment of every strain, a strain is absent when enough of its own sketch hashes were looked for and too few were found
+bool write_screen(char* screen_location, sketch_set* sketches, screen_table* table, double min_containment){
+    FILE* fp = fopen(screen_location, "w");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open %s for writing\n", screen_location);
+        return false;
+    }
+    fprintf(fp, "StrainID\tSketch_Hashes\tFound_Hashes\tContainment\tSpecific_Hashes\tFound_Specific_Hashes\tSpecific_Containment\tCall\n");
+    uint32_t absent = 0, unresolved = 0;
+    for(uint32_t strain_id=0; strain_id<sketches->num_strains; ++strain_id){
+        strain_sketch* strain = &sketches->strains[strain_id];
+        uint64_t found = 0, specific = 0, found_specific = 0;
+        for(uint64_t i=0; i<strain->count; ++i){
+            screen_element* element = screen_table_find(table, strain->hashes[i]);
+            found += element->seen;
+            if(element->owner == strain_id){
+                ++specific;
+                found_specific += element->seen;
+            }
+        }
+        double containment = strain->count == 0 ? 0 : (double) found / strain->count;
+        double specific_containment = specific == 0 ? 0 : (double) found_specific / specific;
+        const char* call = "present";
+        if(specific < MIN_SPECIFIC_HASHES){
+            call = "unresolved";
+            ++unresolved;
+        }else if(specific_containment < min_containment){
+            call = "absent";
+            ++absent;
+        }
+        fprintf(fp, "%s\t%ld\t%ld\t%.6f\t%ld\t%ld\t%.6f\t%s\n", strain->name, strain->count, found, containment, specific, found_specific,
+                specific_containment, call);
+    }
+    fclose(fp);
+    printf("%d of %d strains are absent, %d could not be resolved from their sketches\n", absent, sketches->num_strains, unresolved);
+    return true;
+}
+
+int main(int argc, char **argv){
+    int opt;
+    char* reference_location = NULL;
+    char* sketch_location = NULL;
+    char* forward_location = NULL;
+    char* reverse_location = NULL;
+    char* out_location = NULL;
+    uint32_t kmer_size = 31;
+    uint32_t scale = 1000;
+    uint32_t num_threads = 1;
+    uint64_t max_reads = 0;
+    double min_containment = 0.01;
+
+    // parse options
+    while ((opt = getopt(argc, argv, "r:i:1:2:o:k:s:c:n:t:h")) != -1) {
+        switch (opt) {
+            case 'r': {
+                reference_location = optarg;
+            } break;
+            case 'i': {
+                sketch_location = optarg;
+            } break;
+            case '1': {
+                forward_location = optarg;
+            } break;
+            case '2': {
+                reverse_location = optarg;
+            } break;
+            case 'o': {
+                out_location = optarg;
+            } break;
+            case 'k': {
+                kmer_size = atoi(optarg);
+            } break;
+            case 's': {
+                scale = atoi(optarg);
+            } break;
+            case 'c': {
+                min_containment = atof(optarg);
+            } break;
+            case 'n': {
+                max_reads = strtoull(optarg, NULL, 10);
+            } break;
+            case 't': {
+                num_threads = atoi(optarg);
+            } break;
+            case 'h': {
+                printf(USAGE);
+                return EXIT_SUCCESS;
+            }
+            default: {
+                printf(USAGE);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if(out_location == NULL || (reference_location == NULL) == (sketch_location == NULL) ||
+       (sketch_location != NULL && forward_location == NULL)) {
+        printf(USAGE);
+        return EXIT_FAILURE;
+    }
+    if(kmer_size == 0 || scale == 0 || num_threads == 0){
+        fprintf(stderr, "Error: k-mer size, scale, and threads must be greater than 0\n");
+        return EXIT_FAILURE;
+    }
+    if(kmer_size < MIN_SKETCH_KMER){
+        fprintf(stderr, "Error: the k-mer size must be at least %d for sketches to tell strains apart\n", MIN_SKETCH_KMER);
+        return EXIT_FAILURE;
+    }
+
+    if(reference_location != NULL){
+        printf("Sketching strains in %s\n", reference_location);
+        telemetry_stage stage;
+        telemetry_begin(&stage, "strainscreen", "sketch", "strains");
+        sketch_set* sketches = sketch_reference(reference_location, kmer_size, scale);
+        if(sketches == NULL) return EXIT_FAILURE;
+        sketch_set_write(sketches, out_location);
+        printf("Sketched %d strains\n", sketches->num_strains);
+        stage.items = sketches->num_strains;
+        stage.bytes_in = telemetry_file_size(reference_location);
+        stage.bytes_out = telemetry_file_size(out_location);
+        telemetry_end(&stage);
+        sketch_set_destroy(sketches);
+        return EXIT_SUCCESS;
+    }
+
+    telemetry_stage stage;
+    telemetry_begin(&stage, "strainscreen", "screen", "reads");
+    sketch_set* sketches = sketch_set_load(sketch_location);
+    screen_table* table = screen_table_create(sketches);
+    uint64_t reads_screened = 0;
+    bool success = screen_reads(sketches, table, forward_location, num_threads, max_reads, &reads_screened) &&
+                   (reverse_location == NULL || screen_reads(sketches, table, reverse_location, num_threads, max_reads, &reads_screened));
+    if(success){
+        printf("Screened %ld reads against %d strain sketches\n", reads_screened, sketches->num_strains);
+        success = write_screen(out_location, sketches, table, min_containment);
+    }
+    if(success){
+        stage.items = reads_screened;
+        stage.bytes_in = telemetry_file_size(forward_location) + (reverse_location != NULL ? telemetry_file_size(reverse_location) : 0);
+        stage.bytes_out = telemetry_file_size(out_location);
+        telemetry_end(&stage);
+    }
+    screen_table_destroy(table);
+    sketch_set_destroy(sketches);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,103 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "kmers.h"
+#include "telemetry.h"
+
+#define SKETCH_MAGIC "SR2SKCH3" // raised when sketches started hashing every base of a k-mer, then uppercased bases
+#define BATCH_SIZE 65536 // reads read in before being split between threads
+#define EMPTY_SLOT 0xFFFFFFFF // owner of an empty slot in a screen table
+#define SHARED_HASH 0xFFFFFFFE // owner of a sketch hash found in more than one strain
+#define MIN_SPECIFIC_HASHES 10 // strains with fewer sketch hashes of their own than this can not be called absent
+#define MIN_SKETCH_KMER 16 // shorter k-mers are so few (4^k) that unrelated strains share much of their sketches by chance
+#define USAGE                                                                                                                                        \
+    "USAGE: strainscreen -r path/to/reference.fasta -o path/to/out.sketch [OPTIONS]\n"                                                               \
+    "       strainscreen -i path/to/reference.sketch -1 path/to/forward.fastq.gz -2 path/to/reverse.fastq.gz -o path/to/out.screen [OPTIONS]\n"      \
+    "strainscreen sketches the k-mers of each strain and estimates which strains are present from how much of each sketch a sample's reads contain\n" \
+    "\tSketching Arguments:\n"                                                                                                                       \
+    "\t\t-r path/to/reference\t: fasta of every subcontig, the strain of a sequence is its header up to the first ;\n"                               \
+    "\t\t-o path/to/out.sketch\t: file to write the sketches to\n"                                                                                   \
+    "\t\t-k number\t\t: k-mer size, at least 16 [Default = 31]\n"                                                                                    \
+    "\t\t-s number\t\t: keep 1 in this many k-mer hashes in a sketch [Default = 1000]\n"                                                             \
+    "\tScreening Arguments:\n"                                                                                                                       \
+    "\t\t-i path/to/sketch\t: sketches written by strainscreen -r\n"                                                                                 \
+    "\t\t-1 path/to/forward\t: path to forward reads (fastq, may be gzipped)\n"                                                                      \
+    "\t\t-2 path/to/reverse\t: path to reverse reads (fastq, may be gzipped), optional\n"                                                            \
+    "\t\t-o path/to/out.screen\t: file to write the containment of each strain to\n"                                                                 \
+    "\t\t-c number\t\t: minimum containment of a strain's own sketch hashes for it to be present [Default = 0.01]\n"                                 \
+    "\t\t-n number\t\t: only screen this many reads from each file, 0 screens all of them [Default = 0]\n"                                           \
+    "\t\t-t number\t\t: number of threads [Default = 1]\n"                                                                                           \
+    "\t\t-h\t\t\t: display this message again\n"
+
+/*
+ * A sketch keeps every canonical k-mer hash of a strain below UINT64_MAX / scale (FracMinHash), so sketches of different
+ * sizes stay comparable and containment can be estimated from them directly
+ * Layout: magic (8 bytes) | kmer_size (u32) | scale (u32) | num_strains (u32)
+ *         then for each strain: NUL-terminated strain name | num_hashes (u64) | num_hashes sorted hashes (u64)
+ */
+
+typedef struct strain_sketch{
+    char* name;
+    uint64_t* hashes;
+    uint64_t count;
+    uint64_t capacity;
+} strain_sketch;
+
+typedef struct sketch_set{
+    strain_sketch* strains;
+    uint32_t num_strains;
+    uint32_t strains_capacity;
+    uint32_t kmer_size;
+    uint32_t scale;
+} sketch_set;
+
+typedef struct screen_element{
+    uint64_t key; // key is a sketch hash
+    uint32_t owner; // strain id of a hash in one strain's sketch, SHARED_HASH, or EMPTY_SLOT
+    uint8_t seen; // set once the hash is found in a read
+} screen_element;
+
+// open addressing table (linear probe) of every sketch hash, only the seen flags change while screening
+typedef struct screen_table{
+    screen_element* items;
+    uint64_t size;
+    uint64_t entry_bitmask;
+} screen_table;
+
+typedef struct sequence_batch{
+    char** reads;
+    uint32_t* lens;
+    uint32_t* capacity;
+    uint32_t count;
+} sequence_batch;
+
+typedef struct screen_worker{
+    screen_table* table;
+    sequence_batch* batch;
+    uint64_t* hashes;
+    uint32_t hashes_capacity;
+    uint32_t kmer_size;
+    uint64_t max_hash;
+    uint32_t start;
+    uint32_t end;
+} screen_worker;
+
+// sketching
+sketch_set* sketch_reference(char* reference_location, uint32_t kmer_size, uint32_t scale);
+void sketch_set_write(sketch_set* sketches, char* sketch_location);
+sketch_set* sketch_set_load(char* sketch_location);
+void sketch_set_destroy(sketch_set* sketches);
+
+// screening
+screen_table* screen_table_create(sketch_set* sketches);
+void screen_table_destroy(screen_table* table);
+screen_element* screen_table_find(screen_table* table, uint64_t key);
+void* screen_batch(void* worker);
+bool screen_reads(sketch_set* sketches, screen_table* table, char* read_location, uint32_t num_threads, uint64_t max_reads,
+                  uint64_t* reads_screened);
+bool write_screen(char* screen_location, sketch_set* sketches, screen_table* table, double min_containment);
@@ -1,5 +1,6 @@
 #include <dirent.h>
 #include <getopt.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,8 +8,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "subcontigsplit.h"
+#include "telemetry.h"
 
-#define OVERLAP_LENGTH 500
 #define USAGE                                                                                                                                        \
     "USAGE: subcontig -i path/to/in [OPTIONS]\n"                                                                                                     \
     "subcontig splits input genomes into smaller parts and save to .subcontig files\n"                                                               \
@@ -20,15 +22,15 @@
     "\t\t-e number\t: exclude subcontig size (minimum subcontig size) [Default = 10000]\n"                                                           \
     "\t\t-h\t\t: display this message again\n"
 
-// save a sequence and appropriate header information to outdir (or excludedSubcontigs if it is less than minSubcontigSize)
-void saveSubcontig(char *outdir, char *subcontigName, char *strainID, char *subcontigSeq, int start, int length, char *overlap);
-// subcontig a genome and write the sequences to outdir
-void writeSubcontigs(char *outdir, char *excludeDir, char *genomeLocation, char *strainID, int *contigLengths, int maxSubcontigSize,
-                     int minSubcontigSize);
-// returns array of contig lengths for a given genome and passes array size to contigLengthsSize
-int *getContigLengths(char *genomeLocation, int minSubcontigSize, int *contigLengthsSize);
-// compare function for qsort
-int compare(const void *a, const void *b);
+typedef struct subcontig_dirs {
+    char *outdir;
+    char *excludeDir;
+    uint64_t basesWritten;
+    uint64_t bytesWritten;
+} subcontig_dirs;
+
+// save a subcontig to outdir (or excludeDir if it is excluded), the sink splitGenome is given
+void saveSubcontig(void *context, char *header, char *fileName, char *seq, int length, bool excluded);
 
 int main(int argc, char **argv) {
 
@@ -115,6 +117,7 @@ int main(int argc, char **argv) {
 
     mkdir(outdir, 0777);
     mkdir(excludeDir, 0777);
+    subcontig_dirs dirs = {outdir, excludeDir, 0, 0};
 
     // check indir exists
     struct dirent *de;
@@ -132,8 +135,10 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Warning: It is strongly recommended not to set Minimum subcontig size to be smaller than 5000 to ensure multi-copy elements are not present\n");
     }
 
+    telemetry_stage stage;
     if(maxSubcontigSize==0){
         // calculate lowest N50
+        telemetry_begin(&stage, "subcontig", "n50_scan", "genomes");
         int smallestN50 = 0;
         char* smallestN50_genome = calloc(1,1);
         while (((de = readdir(dr)) != NULL)) {
@@ -144,25 +149,9 @@ int main(int argc, char **argv) {
                 genomeLocation = calloc(strlen(indir) + strlen(de->d_name) + 1, sizeof(char));
                 sprintf(genomeLocation, "%s%s", indir, de->d_name);
 
-                int numContigs = 0;
-                int *contigLengths = getContigLengths(genomeLocation, minSubcontigSize, &numContigs);
-                // find N50
-                qsort(contigLengths, numContigs, sizeof(int), compare);
-                int sum = 0;
-                for (int i = 0; i < numContigs; ++i) {
-                    if(contigLengths[i] > minSubcontigSize){
-                        sum += contigLengths[i];
-                    }
-                }
-                int i = 0;
-                int contigSum = 0;
-                while (contigSum < sum / 2) {
-                    if(contigLengths[i] > minSubcontigSize){
-                        contigSum += contigLengths[i];
-                    }
-                    ++i;
-                }
-                int N50 = i!=0 ? contigLengths[i-1] : contigLengths[0];
+                int N50 = genomeN50(genomeLocation, minSubcontigSize);
+                stage.bytes_in += telemetry_file_size(genomeLocation);
+                ++stage.items;
                 // see if that N50 is the smallest one
                 if(N50 < smallestN50 || smallestN50 == 0){
                     smallestN50 = N50;
@@ -170,7 +159,6 @@ int main(int argc, char **argv) {
                     strcpy(smallestN50_genome, genomeLocation);
                 }
 
-                free(contigLengths);
                 free(genomeLocation);
             }
         }
@@ -178,6 +166,7 @@ int main(int argc, char **argv) {
             fprintf(stderr, "No valid files found in input directory (in .fasta or .fna format)\n");
             return EXIT_FAILURE;
         }
+        telemetry_end(&stage);
         maxSubcontigSize = smallestN50;
         printf("Smallest N50 is %d, which belongs to %s\n", maxSubcontigSize, smallestN50_genome);
         free(smallestN50_genome);
@@ -200,6 +189,7 @@ int main(int argc, char **argv) {
     }
 
     // write subcontigs
+    telemetry_begin(&stage, "subcontig", "subcontig_write", "bases");
     while (((de = readdir(dr)) != NULL)) {
         if ((strlen(de->d_name) >= 4 && strcmp(&de->d_name[strlen(de->d_name) - 4], ".fna") == 0) ||
             (strlen(de->d_name) >= 6 && strcmp(&de->d_name[strlen(de->d_name) - 6], ".fasta") == 0)) {
@@ -209,12 +199,16 @@ int main(int argc, char **argv) {
             sprintf(genomeLocation, "%s%s", indir, de->d_name);
 
             int *contigLengths = getContigLengths(genomeLocation, minSubcontigSize, NULL);
-            writeSubcontigs(outdir, excludeDir, genomeLocation, strtok(de->d_name, "."), contigLengths, maxSubcontigSize, minSubcontigSize);
+            splitGenome(genomeLocation, strtok(de->d_name, "."), contigLengths, maxSubcontigSize, minSubcontigSize, saveSubcontig, &dirs);
             free(contigLengths);
+            stage.bytes_in += telemetry_file_size(genomeLocation);
             free(genomeLocation);
         }
     }
     closedir(dr);
+    stage.items = dirs.basesWritten;
+    stage.bytes_out = dirs.bytesWritten;
+    telemetry_end(&stage);
     free(indir);
     free(outdir);
     free(excludeDir);
@@ -222,198 +216,36 @@ int main(int argc, char **argv) {
     return EXIT_SUCCESS;
 }
 
-// split contigs into subcontigs and write the sequences to outdir
-void writeSubcontigs(char *outdir, char *excludeDir, char *genomeLocation, char *strainID, int *contigLengths, int maxSubcontigSize,
-                     int minSubcontigSize) {
-    FILE *genome = fopen(genomeLocation, "r");
-    char *line = NULL;
-    size_t maxLen = 0;
-    ssize_t lineLen = -1;
-    char *subcontigName;
-    char *subcontigSeq;
-    char *overlapBuff;
-    int seqIndex = 0;
-    int contigIndex = 0;
-    int subcontigLengths = 0;
-    subcontigLengths = contigLengths[contigIndex] / (contigLengths[contigIndex] / (maxSubcontigSize+1) + 1);
-    int start = 1;
-
-    if (genome == NULL) {
-        fprintf(stderr, "Error opening %s\n\n", genomeLocation);
-        exit(EXIT_FAILURE);
-    }
-
-    lineLen = getline(&line, &maxLen, genome);
-    subcontigName = calloc(lineLen - 1, sizeof(char));
-    strncpy(subcontigName, &line[1], lineLen - 2);
-    subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
-    overlapBuff = calloc(OVERLAP_LENGTH + 1, sizeof(char));
-
-    // read genome files line by line 
-    while ((lineLen = getline(&line, &maxLen, genome)) != -1) {
-
-        if (line[0] == '>') {
-            free(overlapBuff);
-            overlapBuff = NULL;
-            if (seqIndex >= minSubcontigSize) {
-                saveSubcontig(outdir, subcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
-            } else if (seqIndex >= OVERLAP_LENGTH) {
-                char *excludedSubcontigName = calloc(strlen(subcontigName) + 10, sizeof(char));
-                sprintf(excludedSubcontigName, "EXCLUDED_%s", subcontigName);
-                saveSubcontig(excludeDir, excludedSubcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
-                free(excludedSubcontigName);
-            }
-            overlapBuff = calloc(OVERLAP_LENGTH + 1, sizeof(char));
-            start += seqIndex;
-            ++contigIndex;
-            seqIndex = 0;
-            free(subcontigSeq);
-            free(subcontigName);
-            subcontigLengths = contigLengths[contigIndex] / (contigLengths[contigIndex] / (maxSubcontigSize+1) + 1);
-            subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
-            subcontigName = calloc(lineLen - 1, sizeof(char));
-            strncpy(subcontigName, &line[1], lineLen - 2);
-
-        } else if (seqIndex + lineLen - 1 <= subcontigLengths) {
-            strncpy(&subcontigSeq[seqIndex], line, lineLen - 1);
-            seqIndex += lineLen - 1;
-        } else {
-            strncpy(&subcontigSeq[seqIndex], line, subcontigLengths - seqIndex);
-            saveSubcontig(outdir, subcontigName, strainID, subcontigSeq, start, subcontigLengths, overlapBuff);
-            strcpy(overlapBuff, &subcontigSeq[strlen(subcontigSeq) - OVERLAP_LENGTH]);
-            free(subcontigSeq);
-
-            // handle the case where a line is larger than the subcontig size
-            int i = 1;
-            while(lineLen - (subcontigLengths*i - seqIndex) > subcontigLengths){
-                subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
-                strncpy(subcontigSeq, &line[subcontigLengths*i + seqIndex], subcontigLengths);
-                start += subcontigLengths;
-                saveSubcontig(outdir, subcontigName, strainID, subcontigSeq, start, subcontigLengths, overlapBuff);
-                strcpy(overlapBuff, &subcontigSeq[strlen(subcontigSeq) - OVERLAP_LENGTH]);
-                free(subcontigSeq);
-                ++i;
-            }
-
-            subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
-            line[strlen(line)-1] = '\0';
-            strcpy(subcontigSeq, &line[subcontigLengths*i - seqIndex]);
-            start += subcontigLengths;
-            seqIndex = strlen(subcontigSeq);
-        }
-    }
-
-    if (seqIndex >= minSubcontigSize) {
-        saveSubcontig(outdir, subcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
-    } else if (seqIndex >= OVERLAP_LENGTH) {
-        char *excludedSubcontigName = calloc(strlen(subcontigName) + 10, sizeof(char));
-        sprintf(excludedSubcontigName, "EXCLUDED_%s", subcontigName);
-        saveSubcontig(excludeDir, excludedSubcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
-        free(excludedSubcontigName);
-    }
-
-    free(subcontigSeq);
-    free(overlapBuff);
-    free(line);
-    free(subcontigName);
-    fclose(genome);
-}
-
 // save a sequence and appropriate header information to outdir (or excludedSubcontigs if it is less than minSubcontigSize)
-// (called from by writeSubcontigs)
-void saveSubcontig(char *outdir, char *subcontigName, char *strainID, char *subcontigSeq, int start, int length, char *overlap) {
-    FILE *fptr = NULL;
-    char *seq = NULL;
-    int overlapLen = 0;
-
-    if (overlap == NULL) {
-        seq = calloc(length + 1, sizeof(char));
-        strcpy(seq, subcontigSeq);
-    } else {
-        seq = calloc(length + strlen(overlap) + 1, sizeof(char));
-        strcpy(seq, overlap);
-        strcpy(&seq[strlen(overlap)], subcontigSeq);
-        overlapLen = strlen(overlap);
-    }
-
-    size_t needed = snprintf(NULL, 0, ">%s;%s;%d_%d;%d", strainID, subcontigName, start - overlapLen, start + length - 1, length + overlapLen) + 1;
-    char *savedSubcontigName = calloc(needed, sizeof(char));
-    sprintf(savedSubcontigName, ">%s;%s;%d_%d;%d", strainID, subcontigName, start - overlapLen, start + length - 1, length + overlapLen);
-
-    needed = snprintf(NULL, 0, "%s/%s_%d_%d.subcontig", outdir, strainID, start - overlapLen, start + length - 1) + 1;
+// (called from by splitGenome)
+void saveSubcontig(void *context, char *header, char *fileName, char *seq, int length, bool excluded) {
+    subcontig_dirs *dirs = (subcontig_dirs *)context;
+    char *dir = excluded ? dirs->excludeDir : dirs->outdir;
+    size_t needed = snprintf(NULL, 0, "%s/%s", dir, fileName) + 1;
     char *subcontigLocation = calloc(needed, sizeof(char));
-    sprintf(subcontigLocation, "%s/%s_%d_%d.subcontig", outdir, strainID, start - overlapLen, start + length - 1);
+    sprintf(subcontigLocation, "%s/%s", dir, fileName);
 
-    fptr = fopen(subcontigLocation, "w");
+    FILE *fptr = fopen(subcontigLocation, "w");
     if (fptr == NULL) {
         fprintf(stderr, "Error writing %s\n\n", subcontigLocation);
         exit(EXIT_FAILURE);
     }
 
-    fprintf(fptr, "%s\n", savedSubcontigName);
+    fprintf(fptr, ">%s\n", header);
     int subcontigIndex = 0;
     char *newLine;
     newLine = calloc(81, sizeof(char));
 
     // write subcontig files line by line
-    while (subcontigIndex < length + overlapLen) {
+    while (subcontigIndex < length) {
         strncpy(newLine, &seq[subcontigIndex], 80);
         subcontigIndex += 80;
         fprintf(fptr, "%s\n", newLine);
     }
 
+    dirs->basesWritten += length;
+    dirs->bytesWritten += ftell(fptr);
     free(newLine);
     free(subcontigLocation);
-    free(savedSubcontigName);
-    free(seq);
     fclose(fptr);
 }
-
-// returns array of contig lengths for a given genome and passes array size to contigLengthsSize
-int *getContigLengths(char *genomeLocation, int minSubcontigSize, int *contigLengthsSize) {
-    FILE *genome = fopen(genomeLocation, "r");
-    ssize_t lineLen = -1;
-    size_t maxLen = 0;
-    int contigIndex = 0;
-    char *line = NULL;
-    int *contigLengths = calloc(100, sizeof(int));
-    int maxContigs = 100;
-    int contigLength = 0;
-
-    if (genome == NULL) {
-        fprintf(stderr, "Error opening %s\n\n", genomeLocation);
-        exit(EXIT_FAILURE);
-    }
-
-    lineLen = getline(&line, &maxLen, genome);
-
-    while ((lineLen = getline(&line, &maxLen, genome)) != -1) {
-        if (line[0] == '>') {
-            if (maxContigs == contigIndex) {
-                contigLengths = realloc(contigLengths, (maxContigs + 100) * sizeof(int));
-                maxContigs += 100;
-            }
-            contigLengths[contigIndex] = contigLength;
-            ++contigIndex;
-            contigLength = 0;
-        } else {
-            contigLength += lineLen - 1;
-        }
-    }
-    contigLengths[contigIndex] = contigLength;
-    contigLengths = realloc(contigLengths, (contigIndex + 1) * sizeof(int));
-
-    free(line);
-    fclose(genome);
-    if (contigLengthsSize != NULL) {
-        *contigLengthsSize = contigIndex + 1;
-    }
-    return contigLengths;
-}
-
-// compare function used in sorting subcontig sizes and finding N50
-int compare(const void *a, const void *b) {
-    int *x = (int *)a;
-    int *y = (int *)b;
-    return *x - *y;
-}
\ No newline at end of file
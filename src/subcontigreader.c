@@ -0,0 +1,187 @@
+#include "subcontigreader.h"
+#include "kseq.h"
+
+/*
+ * Reader threads claim files in directory order and read file i into slot i % depth once the caller is done with file
+ * i - depth, the caller takes file i from that slot once it is ready
+ * Stall times show which side limits throughput: a caller waiting on subcontigs is limited by I/O and decompression (add
+ * reader threads), readers waiting on buffers are ahead of the hashing (more depth or memory will not help)
+ */
+
+KSEQ_INIT(gzFile, gzread)
+
+static double seconds_now(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// read the subcontig file at subcont_location into a slot, the slot's buffers are reused
+void subcontig_read_file(char* subcont_location, subcontig_slot* slot){
+    gzFile fp = gzopen(subcont_location, "r");
+    if(fp == NULL){
+        fprintf(stderr, "Error opening %s\n", subcont_location);
+        exit(EXIT_FAILURE);
+    }
+    kseq_t* seq = kseq_init(fp);
+    if(kseq_read(seq) < 0){
+        fprintf(stderr, "Error reading %s\n", subcont_location);
+        exit(EXIT_FAILURE);
+    }
+    if(seq->comment.s != NULL){
+        slot->name = calloc(strlen(seq->name.s)+strlen(seq->comment.s)+2, sizeof(char));
+        memcpy(slot->name, seq->name.s, strlen(seq->name.s));
+        slot->name[strlen(seq->name.s)] = ' ';
+        strcat(slot->name, seq->comment.s);
+    } else {
+        slot->name = calloc(strlen(seq->name.s)+1, sizeof(char));
+        memcpy(slot->name, seq->name.s, strlen(seq->name.s));
+    }
+    if(seq->seq.l + 1 > slot->capacity){
+        slot->capacity = seq->seq.l + 1;
+        slot->seq = realloc(slot->seq, slot->capacity);
+    }
+    memcpy(slot->seq, seq->seq.s, seq->seq.l + 1);
+    slot->len = seq->seq.l;
+    gzclose(fp);
+    kseq_destroy(seq);
+}
+
+// read one subcontig file of the reader's directory into a slot
+static void read_subcontig(subcontig_reader* reader, subcontig_slot* slot, char* file_name){
+    char* subcont_location = calloc(strlen(reader->dir_location)+strlen(file_name)+1, sizeof(char));
+    strcpy(subcont_location, reader->dir_location);
+    strcat(subcont_location, file_name);
+    subcontig_read_file(subcont_location, slot);
+    free(subcont_location);
+}
+
+// thread function reading files until every file has been claimed
+static void* read_ahead(void* arg){
+    subcontig_reader* reader = (subcontig_reader*) arg;
+    pthread_mutex_lock(&reader->lock);
+    while(true){
+        double wait_start = seconds_now();
+        // a file is always read when nothing is waiting to be hashed, so the memory limit can not stall the caller
+        while(reader->next_claim < reader->num_files && (reader->next_claim >= reader->next_consume + reader->depth ||
+              (reader->buffered_bytes > 0 && reader->buffered_bytes >= reader->max_bytes))){
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+        reader->reader_stall += seconds_now() - wait_start;
+        if(reader->next_claim >= reader->num_files) break;
+        uint32_t index = reader->next_claim++;
+        pthread_mutex_unlock(&reader->lock);
+
+        subcontig_slot* slot = &reader->slots[index % reader->depth];
+        read_subcontig(reader, slot, reader->file_names[index]);
+
+        pthread_mutex_lock(&reader->lock);
+        slot->ready = true;
+        reader->buffered_bytes += slot->len;
+        reader->bytes_read += slot->len;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+// list the subcontigs of a directory and start reading them
+subcontig_reader* subcontig_reader_open(char* dir_location, read_ahead_options* options){
+    struct dirent *de;
+    DIR *dr = opendir(dir_location);
+    if(dr == NULL) {
+        fprintf(stderr, "Could not open subcontigs directory\n\n");
+        exit(EXIT_FAILURE);
+    }
+    subcontig_reader* reader = malloc(sizeof(subcontig_reader));
+    uint32_t files_capacity = 1024;
+    reader->file_names = malloc(files_capacity * sizeof(char*));
+    reader->num_files = 0;
+    while (((de = readdir(dr)) != NULL)) {
+        if(!(strlen(de->d_name) >= 10 && strcmp(&de->d_name[strlen(de->d_name) - 10], ".subcontig") == 0)) continue;
+        if(reader->num_files == files_capacity){
+            files_capacity *= 2;
+            reader->file_names = realloc(reader->file_names, files_capacity * sizeof(char*));
+        }
+        reader->file_names[reader->num_files++] = strdup(de->d_name);
+    }
+    closedir(dr);
+
+    reader->dir_location = dir_location;
+    reader->depth = options->depth;
+    reader->slots = calloc(reader->depth, sizeof(subcontig_slot));
+    reader->max_bytes = options->max_bytes;
+    reader->buffered_bytes = 0;
+    reader->next_claim = 0;
+    reader->next_consume = 0;
+    reader->holding = false;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    reader->bytes_read = 0;
+    reader->reader_stall = 0;
+    reader->consumer_stall = 0;
+    reader->num_threads = options->num_threads;
+    reader->threads = calloc(reader->num_threads, sizeof(pthread_t));
+    for(uint32_t i=0; i<reader->num_threads; ++i){
+        if(pthread_create(&reader->threads[i], NULL, read_ahead, reader) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return reader;
+}
+
+// hand out the next subcontig in directory order, or NULL once all have been handed out
+// the slot returned by the previous call goes back to the readers, so it must not be used anymore
+subcontig_slot* subcontig_reader_next(subcontig_reader* reader){
+    pthread_mutex_lock(&reader->lock);
+    if(reader->holding){
+        subcontig_slot* previous = &reader->slots[reader->next_consume % reader->depth];
+        free(previous->name);
+        previous->name = NULL;
+        previous->ready = false;
+        reader->buffered_bytes -= previous->len;
+        ++reader->next_consume;
+        reader->holding = false;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    if(reader->next_consume >= reader->num_files){
+        pthread_mutex_unlock(&reader->lock);
+        return NULL;
+    }
+    subcontig_slot* slot = &reader->slots[reader->next_consume % reader->depth];
+    double wait_start = seconds_now();
+    while(!slot->ready) pthread_cond_wait(&reader->changed, &reader->lock);
+    reader->consumer_stall += seconds_now() - wait_start;
+    reader->holding = true;
+    pthread_mutex_unlock(&reader->lock);
+    return slot;
+}
+
+// wait for the readers, print how long each side waited on the other, and free the reader
+void subcontig_reader_close(subcontig_reader* reader){
+    // stop readers early if the caller did not take every subcontig
+    uint32_t num_listed = reader->num_files;
+    pthread_mutex_lock(&reader->lock);
+    reader->num_files = reader->next_claim;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    for(uint32_t i=0; i<reader->num_threads; ++i){
+        pthread_join(reader->threads[i], NULL);
+    }
+    printf("Read %d subcontigs (%.1f MiB) with %d reader threads, hashing waited %.2f s for subcontigs and readers waited %.2f s for "
+           "free buffers\n", reader->next_consume, (double) reader->bytes_read / (1 << 20), reader->num_threads, reader->consumer_stall,
+           reader->reader_stall);
+
+    for(uint32_t i=0; i<reader->depth; ++i){
+        free(reader->slots[i].name);
+        free(reader->slots[i].seq);
+    }
+    free(reader->slots);
+    for(uint32_t i=0; i<num_listed; ++i) free(reader->file_names[i]);
+    free(reader->file_names);
+    free(reader->threads);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+    free(reader);
+}
@@ -0,0 +1,61 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#define READ_AHEAD_THREADS 2 // reader threads opening and inflating subcontigs
+#define READ_AHEAD_DEPTH 64 // subcontigs that may be read ahead of the one being hashed
+#define READ_AHEAD_MEMORY 256 // MiB of sequence readers may hold ahead of the hashing before they wait
+
+/*
+ * Read-ahead for the subcontig files of a directory
+ * Reader threads open and inflate upcoming subcontigs into a ring of buffers while the caller hashes the current one, so
+ * per-file latency (high on network storage) and decompression overlap with hashing instead of adding to it
+ * Subcontigs are always handed out in directory order, whatever order the readers finish them in, so subcontig ids are the
+ * same as when the files are read one after another
+ */
+
+typedef struct read_ahead_options{
+    uint32_t num_threads;
+    uint32_t depth; // number of buffers in the ring
+    size_t max_bytes; // readers do not start another file while this much read sequence is waiting to be hashed
+} read_ahead_options;
+
+typedef struct subcontig_slot{
+    char* name; // header of the subcontig, ownership passes to whoever takes it and sets this to NULL
+    char* seq;
+    uint32_t len;
+    uint32_t capacity;
+    bool ready;
+} subcontig_slot;
+
+typedef struct subcontig_reader{
+    char* dir_location;
+    char** file_names;
+    uint32_t num_files;
+    subcontig_slot* slots;
+    uint32_t depth;
+    size_t max_bytes;
+    size_t buffered_bytes; // sequence in ready slots that has not been handed out yet
+    uint32_t next_claim; // next file a reader thread will read
+    uint32_t next_consume; // next file handed to the caller
+    bool holding; // the caller still has the slot of next_consume - 1
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t* threads;
+    uint32_t num_threads;
+    // stats
+    uint64_t bytes_read;
+    double reader_stall; // seconds reader threads spent waiting for a free buffer, summed over the threads
+    double consumer_stall; // seconds the caller spent waiting for the next subcontig to be read
+} subcontig_reader;
+
+subcontig_reader* subcontig_reader_open(char* dir_location, read_ahead_options* options);
+subcontig_slot* subcontig_reader_next(subcontig_reader* reader);
+void subcontig_reader_close(subcontig_reader* reader);
+void subcontig_read_file(char* subcont_location, subcontig_slot* slot);
@@ -0,0 +1,178 @@
+#include "subcontigregistry.h"
+#include "kmers.h"
+
+/*
+ * Registry of subcontig names for the hashtable (hashtable.c) and the sort engine (kmersort.c), see subcontigregistry.h
+ * KmerContent.report is written straight from the registry's fields in one pass
+ */
+
+subcontig_registry* subcontig_registry_create(uint32_t expected_subcontigs){
+    subcontig_registry* registry = malloc(sizeof(subcontig_registry));
+    registry->capacity = expected_subcontigs > 0 ? expected_subcontigs : REGISTRY_INITIAL_SUBCONTIGS;
+    registry->records = malloc(registry->capacity * sizeof(subcontig_record));
+    registry->count = 0;
+    registry->arena_capacity = REGISTRY_INITIAL_ARENA;
+    registry->arena = malloc(registry->arena_capacity);
+    registry->arena_size = 0;
+    registry->interned_size = REGISTRY_INITIAL_INTERNED;
+    registry->interned = malloc(registry->interned_size * sizeof(uint64_t));
+    memset(registry->interned, 0xFF, registry->interned_size * sizeof(uint64_t));
+    registry->interned_count = 0;
+    registry->name = NULL;
+    registry->name_capacity = 0;
+    return registry;
+}
+
+void subcontig_registry_destroy(subcontig_registry* registry){
+    free(registry->records);
+    free(registry->arena);
+    free(registry->interned);
+    free(registry->name);
+    free(registry);
+}
+
+// copy len bytes of str into the arena as a NUL-terminated string, returns its offset
+static uint64_t arena_store(subcontig_registry* registry, const char* str, size_t len){
+    if(registry->arena_size + len + 1 > registry->arena_capacity){
+        while(registry->arena_size + len + 1 > registry->arena_capacity) registry->arena_capacity *= 2;
+        registry->arena = realloc(registry->arena, registry->arena_capacity);
+        if(registry->arena == NULL){
+            fprintf(stderr, "Error: not enough memory for %ld bytes of subcontig names\n", registry->arena_capacity);
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint64_t offset = registry->arena_size;
+    memcpy(&registry->arena[offset], str, len);
+    registry->arena[offset + len] = '\0';
+    registry->arena_size += len + 1;
+    return offset;
+}
+
+static void intern_table_grow(subcontig_registry* registry){
+    uint64_t old_size = registry->interned_size;
+    uint64_t* old = registry->interned;
+    registry->interned_size *= 2;
+    registry->interned = malloc(registry->interned_size * sizeof(uint64_t));
+    memset(registry->interned, 0xFF, registry->interned_size * sizeof(uint64_t));
+    for(uint64_t i=0; i<old_size; ++i){
+        if(old[i] == REGISTRY_NONE) continue;
+        const char* str = &registry->arena[old[i]];
+        uint64_t slot = MurmurHash64A(str, strlen(str), (uint64_t)HASH_SEED) & (registry->interned_size - 1);
+        while(registry->interned[slot] != REGISTRY_NONE) slot = (slot + 1) & (registry->interned_size - 1);
+        registry->interned[slot] = old[i];
+    }
+    free(old);
+}
+
+// offset of the one copy of the first len bytes of str in the arena, stored on first use
+static uint64_t intern(subcontig_registry* registry, const char* str, size_t len){
+    if(2 * (registry->interned_count + 1) > registry->interned_size) intern_table_grow(registry);
+    uint64_t slot = MurmurHash64A(str, len, (uint64_t)HASH_SEED) & (registry->interned_size - 1);
+    while(registry->interned[slot] != REGISTRY_NONE){
+        const char* stored = &registry->arena[registry->interned[slot]];
+        if(strncmp(stored, str, len) == 0 && stored[len] == '\0') return registry->interned[slot];
+        slot = (slot + 1) & (registry->interned_size - 1);
+    }
+    registry->interned[slot] = arena_store(registry, str, len);
+    ++registry->interned_count;
+    return registry->interned[slot];
+}
+
+// give a subcontig the next id, its name is copied so the caller keeps it
+// the contig header may itself hold a ;, so the strain ends at the first ; and the range and length are the last two fields
+uint32_t subcontig_registry_add(subcontig_registry* registry, const char* name){
+    if(registry->count == registry->capacity){
+        registry->capacity *= 2;
+        registry->records = realloc(registry->records, registry->capacity * sizeof(subcontig_record));
+    }
+    subcontig_record* record = &registry->records[registry->count];
+    const char* strain_end = strchr(name, ';');
+    const char* length_start = strrchr(name, ';');
+    const char* range_start = NULL;
+    if(strain_end != NULL && length_start != strain_end){
+        for(const char* c = length_start - 1; c > strain_end; --c){
+            if(*c == ';'){
+                range_start = c;
+                break;
+            }
+        }
+    }
+    // a length with leading zeros or past 32 bits would not be written back the same, so the name is kept whole
+    size_t digits = range_start == NULL ? 0 : strspn(length_start + 1, "0123456789");
+    unsigned long length = digits == 0 ? 0 : strtoul(length_start + 1, NULL, 10);
+    if(digits == 0 || length_start[digits + 1] != '\0' || digits > 10 || length > UINT32_MAX || (length_start[1] == '0' && digits > 1)){
+        record->strain = REGISTRY_NONE;
+        record->contig = REGISTRY_NONE;
+        record->range = arena_store(registry, name, strlen(name));
+        record->length = 0;
+    }else{
+        record->strain = intern(registry, name, strain_end - name);
+        record->contig = intern(registry, strain_end + 1, range_start - strain_end - 1);
+        record->range = arena_store(registry, range_start + 1, length_start - range_start - 1);
+        record->length = length;
+    }
+    return registry->count++;
+}
+
+// full name of a subcontig, the string belongs to the registry and is only valid until the next call
+const char* subcontig_registry_name(subcontig_registry* registry, uint32_t subcontig_id){
+    subcontig_record* record = &registry->records[subcontig_id];
+    if(record->strain == REGISTRY_NONE) return &registry->arena[record->range];
+    const char* strain = &registry->arena[record->strain];
+    const char* contig = &registry->arena[record->contig];
+    const char* range = &registry->arena[record->range];
+    // 10 digits of the length, 3 ; and the NUL
+    uint64_t needed = strlen(strain) + strlen(contig) + strlen(range) + 14;
+    if(needed > registry->name_capacity){
+        registry->name_capacity = needed;
+        registry->name = realloc(registry->name, registry->name_capacity);
+    }
+    sprintf(registry->name, "%s;%s;%s;%u", strain, contig, range, record->length);
+    return registry->name;
+}
+
+// subcontig_registry_name as called by kmer_index_open_write
+const char* subcontig_registry_index_name(void* registry, uint32_t subcontig_id){
+    return subcontig_registry_name((subcontig_registry*) registry, subcontig_id);
+}
+
+// subcontigs of contigs shorter than the exclude size are named <strain>;EXCLUDED_<contig header>;... by subcontig
+bool subcontig_registry_excluded(subcontig_registry* registry, uint32_t subcontig_id){
+    subcontig_record* record = &registry->records[subcontig_id];
+    if(record->strain == REGISTRY_NONE){
+        const char* contig = strchr(&registry->arena[record->range], ';');
+        return contig != NULL && strncmp(contig + 1, "EXCLUDED_", strlen("EXCLUDED_")) == 0;
+    }
+    return strncmp(&registry->arena[record->contig], "EXCLUDED_", strlen("EXCLUDED_")) == 0;
+}
+
+// write KmerContent.report, excluded subcontigs only serve to make k-mers non-unique and are left out
+bool subcontig_registry_write_report(subcontig_registry* registry, uint32_t* unique_counts, const char* report_location){
+    FILE* report = fopen(report_location, "w");
+    if(report == NULL) return false;
+    setvbuf(report, NULL, _IOFBF, REPORT_BUFFER_SIZE);
+    fprintf(report, "SubcontigID\tStrainID\tContigID\tStart_Stop\tLength\tNunique\n");
+    for(uint32_t i=0; i<registry->count; ++i){
+        if(subcontig_registry_excluded(registry, i)) continue;
+        subcontig_record* record = &registry->records[i];
+        if(record->strain == REGISTRY_NONE){
+            // a name without the usual fields gets its first four ;-separated parts, empty where it has fewer
+            const char* field = &registry->arena[record->range];
+            fprintf(report, "%s", field);
+            for(int j=0; j<4; ++j){
+                size_t len = field == NULL ? 0 : strcspn(field, ";");
+                fprintf(report, "\t%.*s", (int) len, field == NULL ? "" : field);
+                field = field == NULL || field[len] == '\0' ? NULL : &field[len + 1];
+            }
+            fprintf(report, "\t%u\n", unique_counts[i]);
+            continue;
+        }
+        const char* strain = &registry->arena[record->strain];
+        const char* contig = &registry->arena[record->contig];
+        const char* range = &registry->arena[record->range];
+        fprintf(report, "%s;%s;%s;%u\t%s\t%s\t%s\t%u\t%u\n", strain, contig, range, record->length, strain, contig, range, record->length,
+                unique_counts[i]);
+    }
+    bool written = !ferror(report);
+    return fclose(report) == 0 && written;
+}
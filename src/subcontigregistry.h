@@ -0,0 +1,49 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGISTRY_INITIAL_SUBCONTIGS 1024 // subcontigs the registry has room for before it first grows, grows by doubling
+#define REGISTRY_INITIAL_ARENA 65536 // bytes of names the arena has room for before it first grows, grows by doubling
+#define REGISTRY_INITIAL_INTERNED 4096 // slots of the intern table, kept at a load factor <= 0.5
+#define REGISTRY_NONE UINT64_MAX // arena offset of a field a subcontig name did not have
+#define REPORT_BUFFER_SIZE 1048576 // bytes of the report buffered before they are written out
+
+/*
+ * Names of the subcontigs added to a table, in the order they were added (the position of a subcontig is its id)
+ * A name written by subcontig is <strain>;<contig header>;<start>_<stop>;<length>. Rather than a copy of every full name, the
+ * registry keeps the fields: the strain and contig header are interned, so every subcontig of a strain or contig points at
+ * one copy of them (contig headers often carry long descriptions and are shared by every subcontig cut from the contig), the
+ * range is kept once per subcontig and the length as a number. Names that do not have these fields are kept whole
+ * Every string lives in one growing arena and is referred to by its offset, so growing the arena never invalidates a record
+ */
+
+typedef struct subcontig_record{
+    uint64_t strain; // arena offset of the interned strain, REGISTRY_NONE if the name is kept whole
+    uint64_t contig; // arena offset of the interned contig header
+    uint64_t range; // arena offset of <start>_<stop>, or of the whole name
+    uint32_t length;
+} subcontig_record;
+
+typedef struct subcontig_registry{
+    subcontig_record* records;
+    uint32_t count;
+    uint32_t capacity;
+    char* arena;
+    uint64_t arena_size;
+    uint64_t arena_capacity;
+    uint64_t* interned; // open addressing table (linear probe) of the arena offsets of interned strings
+    uint64_t interned_size;
+    uint64_t interned_count;
+    char* name; // the last name put back together by subcontig_registry_name
+    uint64_t name_capacity;
+} subcontig_registry;
+
+subcontig_registry* subcontig_registry_create(uint32_t expected_subcontigs);
+void subcontig_registry_destroy(subcontig_registry* registry);
+uint32_t subcontig_registry_add(subcontig_registry* registry, const char* name);
+const char* subcontig_registry_name(subcontig_registry* registry, uint32_t subcontig_id);
+const char* subcontig_registry_index_name(void* registry, uint32_t subcontig_id);
+bool subcontig_registry_excluded(subcontig_registry* registry, uint32_t subcontig_id);
+bool subcontig_registry_write_report(subcontig_registry* registry, uint32_t* unique_counts, const char* report_location);
@@ -0,0 +1,212 @@
+#include "subcontigsplit.h"
+
+/*
+ * Splitting of genomes into subcontigs, shared by subcontig (which writes each one to a file) and libstrainr (which can hash
+ * them straight into a table)
+ * Contigs are cut into pieces of near equal size no larger than the maximum subcontig size, each piece after the first of a
+ * contig also carries the last OVERLAP_LENGTH bases of the piece before it so k-mers spanning a cut are not lost
+ * Contigs shorter than the minimum subcontig size (but at least OVERLAP_LENGTH long) are passed on as excluded
+ */
+
+// split contigs into subcontigs and pass each one to sink
+void splitGenome(char *genomeLocation, char *strainID, int *contigLengths, int maxSubcontigSize, int minSubcontigSize,
+                 subcontig_sink sink, void *context) {
+    FILE *genome = fopen(genomeLocation, "r");
+    char *line = NULL;
+    size_t maxLen = 0;
+    ssize_t lineLen = -1;
+    char *subcontigName;
+    char *subcontigSeq;
+    char *overlapBuff;
+    int seqIndex = 0;
+    int contigIndex = 0;
+    int subcontigLengths = 0;
+    subcontigLengths = contigLengths[contigIndex] / (contigLengths[contigIndex] / (maxSubcontigSize+1) + 1);
+    int start = 1;
+
+    if (genome == NULL) {
+        fprintf(stderr, "Error opening %s\n\n", genomeLocation);
+        exit(EXIT_FAILURE);
+    }
+
+    lineLen = getline(&line, &maxLen, genome);
+    subcontigName = calloc(lineLen - 1, sizeof(char));
+    strncpy(subcontigName, &line[1], lineLen - 2);
+    subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
+    overlapBuff = calloc(OVERLAP_LENGTH + 1, sizeof(char));
+
+    // read genome files line by line 
+    while ((lineLen = getline(&line, &maxLen, genome)) != -1) {
+
+        if (line[0] == '>') {
+            free(overlapBuff);
+            overlapBuff = NULL;
+            if (seqIndex >= minSubcontigSize) {
+                emitSubcontig(sink, context, false, subcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
+            } else if (seqIndex >= OVERLAP_LENGTH) {
+                char *excludedSubcontigName = calloc(strlen(subcontigName) + 10, sizeof(char));
+                sprintf(excludedSubcontigName, "EXCLUDED_%s", subcontigName);
+                emitSubcontig(sink, context, true, excludedSubcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
+                free(excludedSubcontigName);
+            }
+            overlapBuff = calloc(OVERLAP_LENGTH + 1, sizeof(char));
+            start += seqIndex;
+            ++contigIndex;
+            seqIndex = 0;
+            free(subcontigSeq);
+            free(subcontigName);
+            subcontigLengths = contigLengths[contigIndex] / (contigLengths[contigIndex] / (maxSubcontigSize+1) + 1);
+            subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
+            subcontigName = calloc(lineLen - 1, sizeof(char));
+            strncpy(subcontigName, &line[1], lineLen - 2);
+
+        } else if (seqIndex + lineLen - 1 <= subcontigLengths) {
+            strncpy(&subcontigSeq[seqIndex], line, lineLen - 1);
+            seqIndex += lineLen - 1;
+        } else {
+            strncpy(&subcontigSeq[seqIndex], line, subcontigLengths - seqIndex);
+            emitSubcontig(sink, context, false, subcontigName, strainID, subcontigSeq, start, subcontigLengths, overlapBuff);
+            strcpy(overlapBuff, &subcontigSeq[strlen(subcontigSeq) - OVERLAP_LENGTH]);
+            free(subcontigSeq);
+
+            // handle the case where a line is larger than the subcontig size
+            int i = 1;
+            while(lineLen - (subcontigLengths*i - seqIndex) > subcontigLengths){
+                subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
+                strncpy(subcontigSeq, &line[subcontigLengths*i + seqIndex], subcontigLengths);
+                start += subcontigLengths;
+                emitSubcontig(sink, context, false, subcontigName, strainID, subcontigSeq, start, subcontigLengths, overlapBuff);
+                strcpy(overlapBuff, &subcontigSeq[strlen(subcontigSeq) - OVERLAP_LENGTH]);
+                free(subcontigSeq);
+                ++i;
+            }
+
+            subcontigSeq = calloc(subcontigLengths + 1, sizeof(char));
+            line[strlen(line)-1] = '\0';
+            strcpy(subcontigSeq, &line[subcontigLengths*i - seqIndex]);
+            start += subcontigLengths;
+            seqIndex = strlen(subcontigSeq);
+        }
+    }
+
+    if (seqIndex >= minSubcontigSize) {
+        emitSubcontig(sink, context, false, subcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
+    } else if (seqIndex >= OVERLAP_LENGTH) {
+        char *excludedSubcontigName = calloc(strlen(subcontigName) + 10, sizeof(char));
+        sprintf(excludedSubcontigName, "EXCLUDED_%s", subcontigName);
+        emitSubcontig(sink, context, true, excludedSubcontigName, strainID, subcontigSeq, start, seqIndex, overlapBuff);
+        free(excludedSubcontigName);
+    }
+
+    free(subcontigSeq);
+    free(overlapBuff);
+    free(line);
+    free(subcontigName);
+    fclose(genome);
+}
+
+// build the header and file name of a subcontig (with the overlap from the previous subcontig in front) and pass it to sink
+// (called from by splitGenome)
+void emitSubcontig(subcontig_sink sink, void *context, bool excluded, char *subcontigName, char *strainID, char *subcontigSeq, int start,
+                   int length, char *overlap) {
+    char *seq = NULL;
+    int overlapLen = 0;
+
+    if (overlap == NULL) {
+        seq = calloc(length + 1, sizeof(char));
+        strcpy(seq, subcontigSeq);
+    } else {
+        seq = calloc(length + strlen(overlap) + 1, sizeof(char));
+        strcpy(seq, overlap);
+        strcpy(&seq[strlen(overlap)], subcontigSeq);
+        overlapLen = strlen(overlap);
+    }
+
+    size_t needed = snprintf(NULL, 0, "%s;%s;%d_%d;%d", strainID, subcontigName, start - overlapLen, start + length - 1, length + overlapLen) + 1;
+    char *savedSubcontigName = calloc(needed, sizeof(char));
+    sprintf(savedSubcontigName, "%s;%s;%d_%d;%d", strainID, subcontigName, start - overlapLen, start + length - 1, length + overlapLen);
+
+    needed = snprintf(NULL, 0, "%s_%d_%d.subcontig", strainID, start - overlapLen, start + length - 1) + 1;
+    char *fileName = calloc(needed, sizeof(char));
+    sprintf(fileName, "%s_%d_%d.subcontig", strainID, start - overlapLen, start + length - 1);
+
+    sink(context, savedSubcontigName, fileName, seq, length + overlapLen, excluded);
+
+    free(fileName);
+    free(savedSubcontigName);
+    free(seq);
+}
+
+// returns array of contig lengths for a given genome and passes array size to contigLengthsSize
+int *getContigLengths(char *genomeLocation, int minSubcontigSize, int *contigLengthsSize) {
+    FILE *genome = fopen(genomeLocation, "r");
+    ssize_t lineLen = -1;
+    size_t maxLen = 0;
+    int contigIndex = 0;
+    char *line = NULL;
+    int *contigLengths = calloc(100, sizeof(int));
+    int maxContigs = 100;
+    int contigLength = 0;
+
+    if (genome == NULL) {
+        fprintf(stderr, "Error opening %s\n\n", genomeLocation);
+        exit(EXIT_FAILURE);
+    }
+
+    lineLen = getline(&line, &maxLen, genome);
+
+    while ((lineLen = getline(&line, &maxLen, genome)) != -1) {
+        if (line[0] == '>') {
+            if (maxContigs == contigIndex) {
+                contigLengths = realloc(contigLengths, (maxContigs + 100) * sizeof(int));
+                maxContigs += 100;
+            }
+            contigLengths[contigIndex] = contigLength;
+            ++contigIndex;
+            contigLength = 0;
+        } else {
+            contigLength += lineLen - 1;
+        }
+    }
+    contigLengths[contigIndex] = contigLength;
+    contigLengths = realloc(contigLengths, (contigIndex + 1) * sizeof(int));
+
+    free(line);
+    fclose(genome);
+    if (contigLengthsSize != NULL) {
+        *contigLengthsSize = contigIndex + 1;
+    }
+    return contigLengths;
+}
+
+// compare function used in sorting subcontig sizes and finding N50
+int compare(const void *a, const void *b) {
+    int *x = (int *)a;
+    int *y = (int *)b;
+    return *x - *y;
+}
+
+// returns the N50 of a genome's contigs, counting only contigs longer than minSubcontigSize
+int genomeN50(char *genomeLocation, int minSubcontigSize) {
+    int numContigs = 0;
+    int *contigLengths = getContigLengths(genomeLocation, minSubcontigSize, &numContigs);
+    // find N50
+    qsort(contigLengths, numContigs, sizeof(int), compare);
+    int sum = 0;
+    for (int i = 0; i < numContigs; ++i) {
+        if(contigLengths[i] > minSubcontigSize){
+            sum += contigLengths[i];
+        }
+    }
+    int i = 0;
+    int contigSum = 0;
+    while (contigSum < sum / 2) {
+        if(contigLengths[i] > minSubcontigSize){
+            contigSum += contigLengths[i];
+        }
+        ++i;
+    }
+    int N50 = i!=0 ? contigLengths[i-1] : contigLengths[0];
+    free(contigLengths);
+    return N50;
+}
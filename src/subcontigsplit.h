@@ -0,0 +1,24 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define OVERLAP_LENGTH 500
+
+// receives each subcontig cut from a genome: its fasta header (without the >), the file name subcontig saves it under,
+// its sequence, and whether it is excluded for being shorter than the minimum subcontig size
+typedef void (*subcontig_sink)(void *context, char *header, char *fileName, char *seq, int length, bool excluded);
+
+// subcontig a genome and pass the sequences to sink
+void splitGenome(char *genomeLocation, char *strainID, int *contigLengths, int maxSubcontigSize, int minSubcontigSize,
+                 subcontig_sink sink, void *context);
+// build a subcontig's header and pass it to sink
+void emitSubcontig(subcontig_sink sink, void *context, bool excluded, char *subcontigName, char *strainID, char *subcontigSeq, int start,
+                   int length, char *overlap);
+// returns array of contig lengths for a given genome and passes array size to contigLengthsSize
+int *getContigLengths(char *genomeLocation, int minSubcontigSize, int *contigLengthsSize);
+// returns the N50 of a genome, counting only contigs longer than minSubcontigSize
+int genomeN50(char *genomeLocation, int minSubcontigSize);
+// compare function for qsort
+int compare(const void *a, const void *b);
@@ -0,0 +1,122 @@
+#include "tablealloc.h"
+
+static size_t round_to_huge_pages(size_t bytes){
+    return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+// read the online NUMA nodes (e.g. "0-1,3") into mask, returns the number of nodes
+static uint32_t online_numa_nodes(unsigned long* mask){
+    *mask = 0;
+    FILE* fp = fopen("/sys/devices/system/node/online", "r");
+    if(fp == NULL) return 1;
+    uint32_t first, last, num_nodes = 0;
+    int separator;
+    while(fscanf(fp, "%u", &first) == 1){
+        last = first;
+        if((separator = fgetc(fp)) == '-'){
+            if(fscanf(fp, "%u", &last) != 1) break;
+            separator = fgetc(fp);
+        }
+        for(uint32_t node=first; node<=last && node<MAX_NUMA_NODES; ++node){
+            *mask |= 1UL << node;
+            ++num_nodes;
+        }
+        if(separator != ',') break;
+    }
+    fclose(fp);
+    return num_nodes > 0 ? num_nodes : 1;
+}
+
+static void* fill_slice(void* worker){
+    fill_worker* w = (fill_worker*) worker;
+    if(w->source_bytes > 0) memcpy(w->start, w->source, w->source_bytes);
+    memset(w->start + w->source_bytes, 0, w->bytes - w->source_bytes);
+    return NULL;
+}
+
+// touch every page of items from num_threads threads, copying source into the first source_bytes and zeroing the rest
+static void parallel_fill(char* items, size_t bytes, char* source, size_t source_bytes, uint32_t num_threads){
+    pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+    fill_worker* workers = calloc(num_threads, sizeof(fill_worker));
+    // slices are whole huge pages so no page is faulted in by two threads
+    size_t slice = round_to_huge_pages((bytes + num_threads - 1) / num_threads);
+    for(uint32_t i=0; i<num_threads; ++i){
+        size_t start = i*slice < bytes ? i*slice : bytes;
+        size_t end = (i+1)*slice < bytes ? (i+1)*slice : bytes;
+        workers[i].start = items + start;
+        workers[i].bytes = end - start;
+        workers[i].source = source == NULL ? NULL : source + start;
+        workers[i].source_bytes = start >= source_bytes ? 0 : (end < source_bytes ? end : source_bytes) - start;
+        if(pthread_create(&threads[i], NULL, fill_slice, &workers[i]) != 0){
+            fprintf(stderr, "Error: failed to create thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(uint32_t i=0; i<num_threads; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    free(workers);
+    free(threads);
+}
+
+// map bytes of memory, preferring huge pages, and interleave it across NUMA nodes
+static void* table_map(size_t bytes, table_placement* placement){
+    size_t mapped_bytes = round_to_huge_pages(bytes);
+    placement->backing = HUGETLB_PAGES;
+    void* items = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(items == MAP_FAILED){
+        items = mmap(NULL, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(items == MAP_FAILED){
+            fprintf(stderr, "Error: failed to allocate %.1f GiB for the hashtable\n", (double) mapped_bytes / (1UL << 30));
+            exit(EXIT_FAILURE);
+        }
+        placement->backing = madvise(items, mapped_bytes, MADV_HUGEPAGE) == 0 ? TRANSPARENT_HUGE_PAGES : SMALL_PAGES;
+    }
+
+    unsigned long node_mask;
+    placement->numa_nodes = online_numa_nodes(&node_mask);
+    if(placement->numa_nodes > 1 &&
+       syscall(SYS_mbind, items, mapped_bytes, TABLE_MPOL_INTERLEAVE, &node_mask, MAX_NUMA_NODES + 1, 0) != 0){
+        placement->numa_nodes = 1;
+    }
+    return items;
+}
+
+// return zeroed memory for a table of bytes, placement is set to how the memory is backed
+void* table_alloc(size_t bytes, uint32_t num_threads, table_placement* placement){
+    char* items = table_map(bytes, placement);
+    parallel_fill(items, round_to_huge_pages(bytes), NULL, 0, num_threads);
+    return items;
+}
+
+// return zeroed memory for a table of bytes without touching it
+void* table_alloc_lazy(size_t bytes, table_placement* placement){
+    return table_map(bytes, placement);
+}
+
+// move a table into a new allocation of new_bytes, the memory past old_bytes is zeroed and the old allocation is freed
+void* table_realloc(void* items, size_t old_bytes, size_t new_bytes, uint32_t num_threads, table_placement* placement){
+    char* new_items = table_map(new_bytes, placement);
+    parallel_fill(new_items, round_to_huge_pages(new_bytes), items, old_bytes < new_bytes ? old_bytes : new_bytes, num_threads);
+    table_free(items, old_bytes);
+    return new_items;
+}
+
+void table_free(void* items, size_t bytes){
+    if(items != NULL) munmap(items, round_to_huge_pages(bytes));
+}
+
+// give the whole huge pages between byte offsets start and end of a table back to the system, they read as zero afterwards
+void table_release(void* items, size_t start, size_t end){
+    size_t first = round_to_huge_pages(start);
+    size_t last = end / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if(last > first) madvise((char*) items + first, last - first, MADV_DONTNEED);
+}
+
+const char* table_backing_name(table_backing backing){
+    switch(backing){
+        case HUGETLB_PAGES: return "explicit huge pages";
+        case TRANSPARENT_HUGE_PAGES: return "transparent huge pages";
+        default: return "4 KiB pages";
+    }
+}
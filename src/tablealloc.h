@@ -0,0 +1,47 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define HUGE_PAGE_SIZE 2097152 // 2 MiB, tables are rounded up to a whole number of huge pages
+#define MAX_NUMA_NODES 64 // nodes past this are left out of interleaving
+#define TABLE_MPOL_INTERLEAVE 3 // MPOL_INTERLEAVE from linux/mempolicy.h
+
+/*
+ * Allocator for large hash tables
+ * Tables are mapped with explicit huge pages (MAP_HUGETLB) when the system has enough reserved, otherwise with transparent
+ * huge pages requested through madvise, otherwise with normal pages
+ * On machines with several NUMA nodes the pages are interleaved across the nodes so no single node's memory bandwidth limits
+ * random inserts, and every page is faulted in by several threads at allocation instead of one at a time on first insert
+ * Memory from these functions is always zeroed, table_alloc_lazy leaves pages to fault in on first touch so it returns at once
+ */
+
+typedef enum table_backing{
+    SMALL_PAGES = 0,
+    TRANSPARENT_HUGE_PAGES = 1,
+    HUGETLB_PAGES = 2
+} table_backing;
+
+typedef struct table_placement{
+    table_backing backing;
+    uint32_t numa_nodes; // nodes the pages are interleaved across, 1 if they are placed by first touch
+} table_placement;
+
+typedef struct fill_worker{
+    char* start;
+    size_t bytes;
+    char* source; // the first source_bytes are copied from here, the rest is zeroed
+    size_t source_bytes;
+} fill_worker;
+
+void* table_alloc(size_t bytes, uint32_t num_threads, table_placement* placement);
+void* table_alloc_lazy(size_t bytes, table_placement* placement);
+void* table_realloc(void* items, size_t old_bytes, size_t new_bytes, uint32_t num_threads, table_placement* placement);
+void table_free(void* items, size_t bytes);
+void table_release(void* items, size_t start, size_t end);
+const char* table_backing_name(table_backing backing);
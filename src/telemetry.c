@@ -0,0 +1,83 @@
+#include "telemetry.h"
+#include <sys/stat.h>
+
+bool telemetry_enabled(void){
+    char* location = getenv(TELEMETRY_ENV);
+    return location != NULL && *location != '\0';
+}
+
+// seconds on a clock that does not jump with changes to the system time
+double telemetry_wall_time(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double unix_time(void){
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// user and system time of every thread of the process so far
+static double cpu_time(struct rusage* usage){
+    return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 + usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+}
+
+void telemetry_begin(telemetry_stage* stage, const char* tool, const char* name, const char* unit){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    stage->tool = tool;
+    stage->name = name;
+    stage->unit = unit;
+    stage->start_unix = unix_time();
+    stage->start_wall = telemetry_wall_time();
+    stage->start_cpu = cpu_time(&usage);
+    stage->bytes_in = 0;
+    stage->bytes_out = 0;
+    stage->items = 0;
+}
+
+// write the record of a stage, bytes and items are filled in by the caller before
+void telemetry_end(telemetry_stage* stage){
+    if(!telemetry_enabled()) return;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    telemetry_write(stage->tool, stage->name, stage->start_unix, telemetry_wall_time() - stage->start_wall, cpu_time(&usage) - stage->start_cpu,
+                    usage.ru_maxrss, stage->bytes_in, stage->bytes_out, stage->items, stage->unit);
+}
+
+// append a record to the telemetry log, failing to write it never stops the tool
+void telemetry_write(const char* tool, const char* name, double start_unix, double wall, double cpu, long peak_rss_kb, uint64_t bytes_in,
+                     uint64_t bytes_out, uint64_t items, const char* unit){
+    if(!telemetry_enabled()) return;
+    char record[TELEMETRY_LINE];
+    // stages too short for the millisecond times written get a rate of 0
+    int len = snprintf(record, sizeof(record), "{\"tool\":\"%s\",\"stage\":\"%s\",\"start\":%.3f,\"wall_s\":%.3f,\"cpu_s\":%.3f,"
+                       "\"peak_rss_kb\":%ld,\"bytes_in\":%lu,\"bytes_out\":%lu,\"items\":%lu,\"unit\":\"%s\",\"%s_per_s\":%.1f",
+                       tool, name, start_unix, wall, cpu, peak_rss_kb, bytes_in, bytes_out, items, unit, unit, wall >= 0.001 ? items / wall : 0);
+    // the run label comes from the user, quotes and backslashes would break the record so they are left out
+    char* run = getenv(TELEMETRY_RUN_ENV);
+    if(run != NULL && *run != '\0' && len < TELEMETRY_LINE - 16){
+        len += snprintf(&record[len], sizeof(record) - len, ",\"run\":\"");
+        for(; *run != '\0' && len < TELEMETRY_LINE - 4; ++run){
+            if(*run != '"' && *run != '\\' && (unsigned char) *run >= ' ') record[len++] = *run;
+        }
+        record[len++] = '"';
+    }
+    if(len > TELEMETRY_LINE - 3) len = TELEMETRY_LINE - 3;
+    record[len++] = '}';
+    record[len++] = '\n';
+
+    int fd = open(getenv(TELEMETRY_ENV), O_WRONLY | O_APPEND | O_CREAT, 0666);
+    if(fd < 0) return;
+    if(write(fd, record, len) != len) fprintf(stderr, "Warning: failed to write telemetry to %s\n", getenv(TELEMETRY_ENV));
+    close(fd);
+}
+
+// size of a file in bytes, 0 if it does not exist
+uint64_t telemetry_file_size(const char* location){
+    struct stat st;
+    if(stat(location, &st) != 0) return 0;
+    return st.st_size;
+}
@@ -0,0 +1,40 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TELEMETRY_ENV "STRAINR_TELEMETRY" // file stage records are appended to, nothing is recorded when it is not set
+#define TELEMETRY_RUN_ENV "STRAINR_TELEMETRY_RUN" // optional label of the run (such as the sample) added to every record
+#define TELEMETRY_LINE 1024 // longest record, longer run labels are cut short
+
+/*
+ * Structured timing and resource records of pipeline stages, one JSON object per line
+ * Every record has the tool and stage, when it started, its wall and CPU time, the peak RSS of the process at its end, the
+ * bytes it read and wrote, and the items (bases, k-mers, reads...) it processed along with their rate per second of wall time
+ * Records are appended with a single write to a file opened for appending, so every tool of a run can share one log
+ */
+
+typedef struct telemetry_stage{
+    const char* tool;
+    const char* name;
+    const char* unit; // what items counts, the rate is written as <unit>_per_s
+    double start_unix;
+    double start_wall;
+    double start_cpu;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t items;
+} telemetry_stage;
+
+bool telemetry_enabled(void);
+double telemetry_wall_time(void);
+void telemetry_begin(telemetry_stage* stage, const char* tool, const char* name, const char* unit);
+void telemetry_end(telemetry_stage* stage);
+void telemetry_write(const char* tool, const char* name, double start_unix, double wall, double cpu, long peak_rss_kb, uint64_t bytes_in,
+                     uint64_t bytes_out, uint64_t items, const char* unit);
+uint64_t telemetry_file_size(const char* location);
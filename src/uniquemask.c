@@ -0,0 +1,227 @@
+#include "uniquemask.h"
+
+/*
+ * Writer and reader for the unique k-mer positions written by hashcounter -p, see uniquemask.h
+ * Once loaded, the runs of every subcontig are kept decoded and sorted, so counting the unique positions in a range is a
+ * binary search instead of a pass over the subcontig
+ */
+
+unique_mask_writer* unique_mask_writer_create(uint32_t kmer_size){
+    unique_mask_writer* writer = malloc(sizeof(unique_mask_writer));
+    writer->data_capacity = 1 << 20;
+    writer->data = malloc(writer->data_capacity);
+    writer->data_size = 0;
+    writer->offsets_capacity = 1024;
+    writer->offsets = malloc(writer->offsets_capacity * sizeof(uint64_t));
+    writer->offsets[0] = 0;
+    writer->num_subcontigs = 0;
+    writer->kmer_size = kmer_size;
+    return writer;
+}
+
+void unique_mask_writer_destroy(unique_mask_writer* writer){
+    free(writer->data);
+    free(writer->offsets);
+    free(writer);
+}
+
+static void write_varint(unique_mask_writer* writer, uint32_t value){
+    if(writer->data_size + 5 > writer->data_capacity){
+        writer->data_capacity *= 2;
+        writer->data = realloc(writer->data, writer->data_capacity);
+    }
+    while(value >= 0x80){
+        writer->data[writer->data_size++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    writer->data[writer->data_size++] = value;
+}
+
+// subcontigs up to subcontig_id get their offsets, those skipped have no runs
+static void close_subcontigs(unique_mask_writer* writer, uint32_t subcontig_id){
+    while(writer->num_subcontigs < subcontig_id){
+        if(writer->num_subcontigs + 1 == writer->offsets_capacity){
+            writer->offsets_capacity *= 2;
+            writer->offsets = realloc(writer->offsets, writer->offsets_capacity * sizeof(uint64_t));
+        }
+        writer->offsets[++writer->num_subcontigs] = writer->data_size;
+    }
+}
+
+// add the runs of a subcontig, unique[i] is non-zero when the k-mer starting at i is unique to it
+// subcontigs are added in increasing order of id
+void unique_mask_writer_add(unique_mask_writer* writer, uint32_t subcontig_id, uint8_t* unique, uint32_t num_positions){
+    if(subcontig_id < writer->num_subcontigs){
+        fprintf(stderr, "Error: unique positions of subcontig %d were added out of order\n", subcontig_id);
+        exit(EXIT_FAILURE);
+    }
+    close_subcontigs(writer, subcontig_id);
+    uint32_t previous_end = 0;
+    uint32_t i = 0;
+    while(i < num_positions){
+        if(!unique[i]){
+            ++i;
+            continue;
+        }
+        uint32_t start = i;
+        while(i < num_positions && unique[i]) ++i;
+        write_varint(writer, start - previous_end);
+        write_varint(writer, i - start);
+        previous_end = i;
+    }
+    close_subcontigs(writer, subcontig_id + 1);
+}
+
+bool unique_mask_writer_write(unique_mask_writer* writer, char* mask_location, unique_mask_name_func subcontig_name, void* context,
+                              uint32_t num_subcontigs){
+    close_subcontigs(writer, num_subcontigs);
+    FILE* fp = fopen(mask_location, "wb");
+    if(fp == NULL) return false;
+    fwrite(UNIQUE_MASK_MAGIC, sizeof(char), strlen(UNIQUE_MASK_MAGIC), fp);
+    fwrite(&writer->kmer_size, sizeof(uint32_t), 1, fp);
+    fwrite(&num_subcontigs, sizeof(uint32_t), 1, fp);
+    uint64_t data_bytes = writer->offsets[num_subcontigs];
+    fwrite(&data_bytes, sizeof(uint64_t), 1, fp);
+    for(uint32_t i=0; i<num_subcontigs; ++i){
+        const char* name = subcontig_name(context, i);
+        fwrite(name, sizeof(char), strlen(name)+1, fp);
+    }
+    fwrite(writer->offsets, sizeof(uint64_t), num_subcontigs + 1, fp);
+    fwrite(writer->data, sizeof(uint8_t), data_bytes, fp);
+    bool written = !ferror(fp);
+    return fclose(fp) == 0 && written;
+}
+
+// read a NUL-terminated string from fp
+static char* read_name(FILE* fp){
+    uint32_t capacity = 128;
+    uint32_t len = 0;
+    char* name = malloc(capacity);
+    int c;
+    while((c = fgetc(fp)) != EOF && c != '\0'){
+        if(len+1 == capacity){
+            capacity *= 2;
+            name = realloc(name, capacity);
+        }
+        name[len++] = c;
+    }
+    if(c == EOF){
+        free(name);
+        return NULL;
+    }
+    name[len] = '\0';
+    return name;
+}
+
+static bool read_varint(uint8_t* data, uint64_t end, uint64_t* position, uint32_t* value){
+    *value = 0;
+    for(uint32_t shift = 0; shift < 35 && *position < end; shift += 7){
+        uint8_t byte = data[(*position)++];
+        *value |= (uint32_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+unique_mask* unique_mask_load(char* mask_location){
+    FILE* fp = fopen(mask_location, "rb");
+    if(fp == NULL){
+        fprintf(stderr, "Error: failed to open unique position mask %s\n", mask_location);
+        exit(EXIT_FAILURE);
+    }
+    char magic[sizeof(UNIQUE_MASK_MAGIC)] = {0};
+    uint64_t data_bytes;
+    unique_mask* mask = malloc(sizeof(unique_mask));
+    if(fread(magic, sizeof(char), strlen(UNIQUE_MASK_MAGIC), fp) != strlen(UNIQUE_MASK_MAGIC) || strcmp(magic, UNIQUE_MASK_MAGIC) != 0 ||
+       fread(&mask->kmer_size, sizeof(uint32_t), 1, fp) != 1 || fread(&mask->num_subcontigs, sizeof(uint32_t), 1, fp) != 1 ||
+       fread(&data_bytes, sizeof(uint64_t), 1, fp) != 1){
+        fprintf(stderr, "Error: %s is not a unique position mask generated by hashcounter\n", mask_location);
+        exit(EXIT_FAILURE);
+    }
+
+    mask->subcontig_names = calloc(mask->num_subcontigs, sizeof(char*));
+    for(uint32_t i=0; i<mask->num_subcontigs; ++i){
+        if((mask->subcontig_names[i] = read_name(fp)) == NULL){
+            fprintf(stderr, "Error: unique position mask %s is truncated\n", mask_location);
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint64_t* offsets = malloc((mask->num_subcontigs + 1) * sizeof(uint64_t));
+    uint8_t* data = malloc(data_bytes + 1);
+    if(fread(offsets, sizeof(uint64_t), mask->num_subcontigs + 1, fp) != mask->num_subcontigs + 1 ||
+       fread(data, sizeof(uint8_t), data_bytes, fp) != data_bytes){
+        fprintf(stderr, "Error: unique position mask %s is truncated\n", mask_location);
+        exit(EXIT_FAILURE);
+    }
+    fclose(fp);
+
+    // every run takes at least two bytes, so this is room enough for all of them
+    mask->bounds = malloc((data_bytes + 1) * sizeof(uint32_t));
+    mask->runs = malloc((mask->num_subcontigs + 1) * sizeof(uint64_t));
+    uint64_t num_runs = 0;
+    for(uint32_t i=0; i<mask->num_subcontigs; ++i){
+        mask->runs[i] = num_runs;
+        uint64_t position = offsets[i];
+        uint32_t end = 0;
+        while(position < offsets[i+1]){
+            uint32_t gap, length;
+            if(offsets[i+1] > data_bytes || !read_varint(data, offsets[i+1], &position, &gap) ||
+               !read_varint(data, offsets[i+1], &position, &length)){
+                fprintf(stderr, "Error: unique position mask %s is corrupt\n", mask_location);
+                exit(EXIT_FAILURE);
+            }
+            mask->bounds[2*num_runs] = end + gap;
+            mask->bounds[2*num_runs+1] = end + gap + length;
+            end += gap + length;
+            ++num_runs;
+        }
+    }
+    mask->runs[mask->num_subcontigs] = num_runs;
+    free(offsets);
+    free(data);
+    return mask;
+}
+
+void unique_mask_destroy(unique_mask* mask){
+    for(uint32_t i=0; i<mask->num_subcontigs; ++i) free(mask->subcontig_names[i]);
+    free(mask->subcontig_names);
+    free(mask->bounds);
+    free(mask->runs);
+    free(mask);
+}
+
+// number of unique k-mer start positions of a subcontig in [start, end)
+uint64_t unique_mask_count(unique_mask* mask, uint32_t subcontig_id, uint32_t start, uint32_t end){
+    if(subcontig_id >= mask->num_subcontigs || start >= end) return 0;
+    // first run ending after start
+    uint64_t low = mask->runs[subcontig_id];
+    uint64_t high = mask->runs[subcontig_id + 1];
+    while(low < high){
+        uint64_t middle = low + (high - low) / 2;
+        if(mask->bounds[2*middle+1] <= start){
+            low = middle + 1;
+        }else{
+            high = middle;
+        }
+    }
+    uint64_t count = 0;
+    for(uint64_t run = low; run < mask->runs[subcontig_id + 1] && mask->bounds[2*run] < end; ++run){
+        uint32_t run_start = mask->bounds[2*run] > start ? mask->bounds[2*run] : start;
+        uint32_t run_end = mask->bounds[2*run+1] < end ? mask->bounds[2*run+1] : end;
+        count += run_end - run_start;
+    }
+    return count;
+}
+
+// one line per run: subcontig name, start, and end of the unique k-mer start positions, in subcontig order
+bool unique_mask_write_bed(unique_mask* mask, char* bed_location){
+    FILE* bed = fopen(bed_location, "w");
+    if(bed == NULL) return false;
+    for(uint32_t i=0; i<mask->num_subcontigs; ++i){
+        for(uint64_t run = mask->runs[i]; run < mask->runs[i+1]; ++run){
+            fprintf(bed, "%s\t%u\t%u\n", mask->subcontig_names[i], mask->bounds[2*run], mask->bounds[2*run+1]);
+        }
+    }
+    bool written = !ferror(bed);
+    return fclose(bed) == 0 && written;
+}
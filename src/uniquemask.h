@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIQUE_MASK_MAGIC "SR2MASK1"
+
+/*
+ * UniqueRegions.mask holds, for every subcontig, the start positions of the k-mers unique to it, as written by hashcounter -p
+ * Neighbouring unique k-mers are kept as runs, so a subcontig costs a few bytes per stretch of unique sequence rather than
+ * a bit per base, and counters can restrict themselves to unique regions without rebuilding the k-mer table
+ * Layout: magic (8 bytes) | kmer_size (u32) | num_subcontigs (u32) | data_bytes (u64)
+ *         num_subcontigs NUL-terminated subcontig names, the position of a name is its subcontig id (as in UniqueKmers.index)
+ *         num_subcontigs + 1 offsets (u64) into the data, the runs of subcontig i take the bytes from offset i to offset i + 1
+ *         data_bytes of runs, each the gap from the end of the previous run (or from position 0) and the run's length, both
+ *         as LEB128 varints, in increasing order of position
+ * Positions are 0-based start positions of k-mers in the subcontig's sequence, runs are half-open [start, end)
+ */
+
+// name of a subcontig for unique_mask_writer_write, the string only has to stay valid until the next call
+typedef const char* (*unique_mask_name_func)(void* context, uint32_t subcontig_id);
+
+typedef struct unique_mask_writer{
+    uint8_t* data;
+    uint64_t data_size;
+    uint64_t data_capacity;
+    uint64_t* offsets; // offsets[i] is where the runs of subcontig i start, subcontigs never added have no runs
+    uint32_t num_subcontigs;
+    uint32_t offsets_capacity;
+    uint32_t kmer_size;
+} unique_mask_writer;
+
+typedef struct unique_mask{
+    char** subcontig_names;
+    uint32_t* bounds; // start and end of every run, the runs of subcontig i are runs[i] up to runs[i+1]
+    uint64_t* runs;
+    uint32_t num_subcontigs;
+    uint32_t kmer_size;
+} unique_mask;
+
+// writing
+unique_mask_writer* unique_mask_writer_create(uint32_t kmer_size);
+void unique_mask_writer_destroy(unique_mask_writer* writer);
+void unique_mask_writer_add(unique_mask_writer* writer, uint32_t subcontig_id, uint8_t* unique, uint32_t num_positions);
+bool unique_mask_writer_write(unique_mask_writer* writer, char* mask_location, unique_mask_name_func subcontig_name, void* context,
+                              uint32_t num_subcontigs);
+
+// reading
+unique_mask* unique_mask_load(char* mask_location);
+void unique_mask_destroy(unique_mask* mask);
+uint64_t unique_mask_count(unique_mask* mask, uint32_t subcontig_id, uint32_t start, uint32_t end);
+bool unique_mask_write_bed(unique_mask* mask, char* bed_location);
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "strainr.h"
+#include "uniquemask.h"
+
+/*
+ * Checks libstrainr's C API against a brute force count of unique k-mers, with both engines
+ * Subcontigs are built in memory: two that share a stretch, one that holds the reverse complement of a stretch of the first,
+ * one with an N, and an excluded one sharing a stretch with the third
+ * A genome is then added with strainr_table_add_genome and compared to splitting it and adding the subcontigs one at a time
+ * Last, a UniqueRegions.mask is written from random unique positions, and every window's unique_mask_count and the BED export
+ * are compared to the positions it was written from
+ * Run by make test, it exits with an error message at the first check that fails
+ */
+
+#define KMER_SIZE 17 // every base of a 17-mer is hashed, see strainr_options
+#define NUM_SUBCONTIGS 5
+#define SUBCONTIG_LENGTH 400
+#define MASK_SUBCONTIGS 4
+#define MASK_POSITIONS 1000
+
+#define CHECK(condition, ...) do{ if(!(condition)){ fprintf(stderr, "libstrainr test failed: " __VA_ARGS__); exit(EXIT_FAILURE); } }while(0)
+
+typedef struct kmer_occurrence{
+    char kmer[KMER_SIZE + 1];
+    uint32_t subcontig_id;
+    bool excluded;
+} kmer_occurrence;
+
+typedef struct count_check{
+    uint32_t* expected;
+    uint32_t calls;
+} count_check;
+
+typedef struct genome_subcontigs{
+    char** headers;
+    char** seqs;
+    bool* excluded;
+    uint32_t count;
+} genome_subcontigs;
+
+static char complement(char base){
+    switch(base){
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        default: return base;
+    }
+}
+
+static void reverse_complement_into(const char* seq, uint32_t len, char* out){
+    for(uint32_t i=0; i<len; ++i) out[i] = complement(seq[len-1-i]);
+    out[len] = '\0';
+}
+
+static void canonical_into(const char* kmer, char* out){
+    char reverse[KMER_SIZE + 1];
+    reverse_complement_into(kmer, KMER_SIZE, reverse);
+    memcpy(out, strncmp(kmer, reverse, KMER_SIZE) <= 0 ? kmer : reverse, KMER_SIZE);
+    out[KMER_SIZE] = '\0';
+}
+
+static int compare_occurrences(const void* a, const void* b){
+    return strcmp(((const kmer_occurrence*) a)->kmer, ((const kmer_occurrence*) b)->kmer);
+}
+
+// unique k-mers of each subcontig found by sorting every canonical k-mer as a string
+static uint32_t* brute_force_counts(char seqs[][SUBCONTIG_LENGTH + 1], const bool* excluded, uint32_t num_subcontigs,
+                                    kmer_occurrence** occurrences, uint32_t* num_occurrences){
+    *occurrences = malloc(num_subcontigs * SUBCONTIG_LENGTH * sizeof(kmer_occurrence));
+    *num_occurrences = 0;
+    for(uint32_t i=0; i<num_subcontigs; ++i){
+        for(uint32_t j=0; j+KMER_SIZE <= strlen(seqs[i]); ++j){
+            if(memchr(&seqs[i][j], 'N', KMER_SIZE) != NULL) continue;
+            kmer_occurrence* occurrence = &(*occurrences)[(*num_occurrences)++];
+            canonical_into(&seqs[i][j], occurrence->kmer);
+            occurrence->subcontig_id = i;
+            occurrence->excluded = excluded[i];
+        }
+    }
+    qsort(*occurrences, *num_occurrences, sizeof(kmer_occurrence), compare_occurrences);
+    uint32_t* counts = calloc(num_subcontigs, sizeof(uint32_t));
+    for(uint32_t i=0; i<*num_occurrences; ++i){
+        bool single = (i == 0 || strcmp((*occurrences)[i-1].kmer, (*occurrences)[i].kmer) != 0) &&
+                      (i+1 == *num_occurrences || strcmp((*occurrences)[i+1].kmer, (*occurrences)[i].kmer) != 0);
+        if(single && !(*occurrences)[i].excluded) ++counts[(*occurrences)[i].subcontig_id];
+    }
+    return counts;
+}
+
+static void check_count(void* context, uint32_t subcontig_id, const char* name, uint32_t num_unique){
+    count_check* check = (count_check*) context;
+    CHECK(subcontig_id == check->calls, "foreach_count visited subcontig %u out of order\n", subcontig_id);
+    CHECK(num_unique == check->expected[subcontig_id], "subcontig %s has %u unique k-mers, expected %u\n", name, num_unique,
+          check->expected[subcontig_id]);
+    ++check->calls;
+}
+
+static void test_in_memory(strainr_engine engine){
+    char seqs[NUM_SUBCONTIGS][SUBCONTIG_LENGTH + 1];
+    bool excluded[NUM_SUBCONTIGS] = {false, false, false, false, true};
+    const char* names[NUM_SUBCONTIGS] = {"strainA;contig1;1_400;400", "strainB;contig1;1_400;400", "strainC;contig1;1_400;400",
+                                         "strainD;contig1;1_400;400", "strainC;contig2;1_400;400"};
+    for(uint32_t i=0; i<NUM_SUBCONTIGS; ++i){
+        for(uint32_t j=0; j<SUBCONTIG_LENGTH; ++j) seqs[i][j] = "ACGT"[rand() % 4];
+        seqs[i][SUBCONTIG_LENGTH] = '\0';
+    }
+    memcpy(&seqs[1][200], &seqs[0][50], 100); // shared by strains A and B
+    reverse_complement_into(&seqs[0][300], 60, &seqs[2][10]); // A forward, C reverse
+    seqs[3][123] = 'N';
+    memcpy(&seqs[4][0], &seqs[2][250], 80); // C's stretch is excluded through its excluded subcontig
+
+    kmer_occurrence* occurrences;
+    uint32_t num_occurrences;
+    uint32_t* expected = brute_force_counts(seqs, excluded, NUM_SUBCONTIGS, &occurrences, &num_occurrences);
+
+    strainr_options options;
+    strainr_options_init(&options, KMER_SIZE);
+    options.engine = engine;
+    options.num_threads = 2;
+    strainr_table* table = strainr_table_create(&options);
+    CHECK(table != NULL, "could not create a table\n");
+    for(uint32_t i=0; i<NUM_SUBCONTIGS; ++i){
+        CHECK(strainr_table_add(table, names[i], seqs[i], excluded[i]) == i, "subcontig %u was not given id %u\n", i, i);
+    }
+    CHECK(strainr_table_num_subcontigs(table) == NUM_SUBCONTIGS, "the table has %u subcontigs\n", strainr_table_num_subcontigs(table));
+
+    count_check check = {expected, 0};
+    strainr_table_foreach_count(table, check_count, &check);
+    CHECK(check.calls == NUM_SUBCONTIGS, "foreach_count visited %u subcontigs\n", check.calls);
+    CHECK(strainr_table_add(table, "late", seqs[0], false) == STRAINR_ERROR, "a subcontig was added to a finished table\n");
+
+    // every k-mer, from either strand, is unique to its owner exactly when the brute force found it once
+    for(uint32_t i=0; i<num_occurrences; ++i){
+        bool single = (i == 0 || strcmp(occurrences[i-1].kmer, occurrences[i].kmer) != 0) &&
+                      (i+1 == num_occurrences || strcmp(occurrences[i+1].kmer, occurrences[i].kmer) != 0);
+        char reverse[KMER_SIZE + 1];
+        reverse_complement_into(occurrences[i].kmer, KMER_SIZE, reverse);
+        for(uint32_t strand=0; strand<2; ++strand){
+            uint32_t owner = NUM_SUBCONTIGS;
+            strainr_kmer_status status = strainr_table_query(table, strand == 0 ? occurrences[i].kmer : reverse, &owner);
+            if(single && !occurrences[i].excluded){
+                CHECK(status == STRAINR_UNIQUE && owner == occurrences[i].subcontig_id, "%s is not unique to subcontig %u\n",
+                      occurrences[i].kmer, occurrences[i].subcontig_id);
+            }else{
+                CHECK(status == STRAINR_NON_UNIQUE, "%s is not reported as non-unique\n", occurrences[i].kmer);
+            }
+        }
+    }
+    CHECK(strainr_table_query(table, "AAAAAAAAAAAAAAAAA", NULL) == STRAINR_ABSENT, "a k-mer in no subcontig was found\n");
+    CHECK(strainr_table_query(table, "NNNNNNNNNNNNNNNNN", NULL) == STRAINR_ABSENT, "a k-mer with an N was found\n");
+
+    strainr_table_destroy(table);
+    free(expected);
+    free(occurrences);
+}
+
+static void collect_subcontig(void* context, const char* header, const char* seq, uint32_t length, bool excluded){
+    genome_subcontigs* subcontigs = (genome_subcontigs*) context;
+    subcontigs->headers = realloc(subcontigs->headers, (subcontigs->count + 1) * sizeof(char*));
+    subcontigs->seqs = realloc(subcontigs->seqs, (subcontigs->count + 1) * sizeof(char*));
+    subcontigs->excluded = realloc(subcontigs->excluded, (subcontigs->count + 1) * sizeof(bool));
+    subcontigs->headers[subcontigs->count] = strdup(header);
+    subcontigs->seqs[subcontigs->count] = strndup(seq, length);
+    subcontigs->excluded[subcontigs->count] = excluded;
+    ++subcontigs->count;
+}
+
+static void test_genome(strainr_engine engine, const char* genome_location){
+    genome_subcontigs subcontigs = {NULL, NULL, NULL, 0};
+    CHECK(strainr_split_genome(genome_location, "strainG", 1500, 1000, collect_subcontig, &subcontigs) == STRAINR_OK,
+          "could not split %s\n", genome_location);
+    CHECK(subcontigs.count > 2, "%s was split into %u subcontigs\n", genome_location, subcontigs.count);
+
+    strainr_options options;
+    strainr_options_init(&options, KMER_SIZE);
+    options.engine = engine;
+    strainr_table* from_genome = strainr_table_create(&options);
+    strainr_table* from_subcontigs = strainr_table_create(&options);
+    CHECK(strainr_table_add_genome(from_genome, genome_location, "strainG", 1500, 1000) == STRAINR_OK, "could not add %s\n",
+          genome_location);
+    for(uint32_t i=0; i<subcontigs.count; ++i){
+        strainr_table_add(from_subcontigs, subcontigs.headers[i], subcontigs.seqs[i], subcontigs.excluded[i]);
+    }
+    CHECK(strainr_table_num_subcontigs(from_genome) == subcontigs.count, "the genome was added as %u subcontigs, not %u\n",
+          strainr_table_num_subcontigs(from_genome), subcontigs.count);
+    for(uint32_t i=0; i<subcontigs.count; ++i){
+        CHECK(strcmp(strainr_table_subcontig_name(from_genome, i), subcontigs.headers[i]) == 0, "subcontig %u is named %s\n", i,
+              strainr_table_subcontig_name(from_genome, i));
+        CHECK(strainr_table_unique_count(from_genome, i) == strainr_table_unique_count(from_subcontigs, i),
+              "subcontig %s has %u unique k-mers added from the genome and %u added on its own\n", subcontigs.headers[i],
+              strainr_table_unique_count(from_genome, i), strainr_table_unique_count(from_subcontigs, i));
+        free(subcontigs.headers[i]);
+        free(subcontigs.seqs[i]);
+    }
+    // neighbouring subcontigs overlap, so their shared k-mers are not unique
+    CHECK(strainr_table_unique_kmers(from_genome) < strainr_table_distinct_kmers(from_genome), "the overlaps were counted as unique\n");
+    strainr_table_destroy(from_genome);
+    strainr_table_destroy(from_subcontigs);
+    free(subcontigs.headers);
+    free(subcontigs.seqs);
+    free(subcontigs.excluded);
+}
+
+static const char* mask_name(void* names, uint32_t subcontig_id){
+    return ((const char**) names)[subcontig_id];
+}
+
+static void test_mask(void){
+    // subcontig 0 has short runs, 1 runs longer than a one byte varint, 2 is never added, and 3 is unique throughout
+    const char* names[MASK_SUBCONTIGS] = {"strainA;contig1;1_1000;1000", "strainA;contig2;1_1000;1000",
+                                          "strainB;contig1;1_1000;1000", "strainC;contig1;1_1000;1000"};
+    uint8_t unique[MASK_SUBCONTIGS][MASK_POSITIONS] = {{0}};
+    uint32_t mean_run[2] = {4, 300};
+    for(uint32_t i=0; i<2; ++i){
+        uint8_t state = 0;
+        for(uint32_t j=0; j<MASK_POSITIONS; ++j){
+            if(rand() % mean_run[i] == 0) state = !state;
+            unique[i][j] = state;
+        }
+    }
+    memset(unique[3], 1, MASK_POSITIONS);
+
+    char mask_location[] = "/tmp/libstrainr_maskXXXXXX";
+    char bed_location[] = "/tmp/libstrainr_bedXXXXXX";
+    int mask_fd = mkstemp(mask_location);
+    int bed_fd = mkstemp(bed_location);
+    CHECK(mask_fd != -1 && bed_fd != -1, "could not create a temporary mask\n");
+    close(mask_fd);
+    close(bed_fd);
+    unique_mask_writer* writer = unique_mask_writer_create(KMER_SIZE);
+    for(uint32_t i=0; i<MASK_SUBCONTIGS; ++i){
+        if(i != 2) unique_mask_writer_add(writer, i, unique[i], MASK_POSITIONS);
+    }
+    CHECK(unique_mask_writer_write(writer, mask_location, mask_name, names, MASK_SUBCONTIGS), "could not write %s\n", mask_location);
+    unique_mask_writer_destroy(writer);
+
+    unique_mask* mask = unique_mask_load(mask_location);
+    CHECK(mask != NULL && mask->num_subcontigs == MASK_SUBCONTIGS && mask->kmer_size == KMER_SIZE, "could not load %s\n",
+          mask_location);
+    for(uint32_t i=0; i<MASK_SUBCONTIGS; ++i){
+        CHECK(strcmp(mask->subcontig_names[i], names[i]) == 0, "mask subcontig %u is named %s\n", i, mask->subcontig_names[i]);
+        // every window, ends past the subcontig included
+        for(uint32_t start=0; start<=MASK_POSITIONS; start += 7){
+            uint32_t expected = 0;
+            for(uint32_t end=start; end<=MASK_POSITIONS + 10; ++end){
+                CHECK(unique_mask_count(mask, i, start, end) == expected, "subcontig %u has %lu unique positions in [%u, %u), expected %u\n",
+                      i, unique_mask_count(mask, i, start, end), start, end, expected);
+                if(end < MASK_POSITIONS) expected += unique[i][end];
+            }
+        }
+    }
+    CHECK(unique_mask_count(mask, MASK_SUBCONTIGS, 0, MASK_POSITIONS) == 0, "a subcontig past the mask has unique positions\n");
+
+    // the BED intervals cover exactly the unique positions
+    CHECK(unique_mask_write_bed(mask, bed_location), "could not write %s\n", bed_location);
+    uint8_t covered[MASK_SUBCONTIGS][MASK_POSITIONS] = {{0}};
+    FILE* bed = fopen(bed_location, "r");
+    char line[256];
+    while(fgets(line, sizeof(line), bed) != NULL){
+        char* tab = strchr(line, '\t');
+        CHECK(tab != NULL, "malformed BED line %s", line);
+        *tab = '\0';
+        uint32_t start, end;
+        CHECK(sscanf(tab + 1, "%u\t%u", &start, &end) == 2 && start < end && end <= MASK_POSITIONS, "malformed BED interval %s\n", tab + 1);
+        uint32_t id = 0;
+        while(id < MASK_SUBCONTIGS && strcmp(names[id], line) != 0) ++id;
+        CHECK(id < MASK_SUBCONTIGS, "BED interval of unknown subcontig %s\n", line);
+        for(uint32_t j=start; j<end; ++j){
+            CHECK(!covered[id][j], "position %u of %s is in two BED intervals\n", j, line);
+            covered[id][j] = 1;
+        }
+    }
+    fclose(bed);
+    CHECK(memcmp(covered, unique, sizeof(unique)) == 0, "the BED intervals are not the unique positions\n");
+
+    unique_mask_destroy(mask);
+    unlink(mask_location);
+    unlink(bed_location);
+}
+
+int main(int argc, char** argv){
+    srand(7062024);
+    strainr_options options;
+    strainr_options_init(&options, STRAINR_MIN_KMER_SIZE - 1);
+    CHECK(strainr_table_create(&options) == NULL, "a table was created with k-mers shorter than %d\n", STRAINR_MIN_KMER_SIZE);
+
+    // a genome of two contigs long enough to be cut into overlapping subcontigs and a contig too short to be kept
+    char genome_location[] = "/tmp/libstrainr_testXXXXXX";
+    int fd = mkstemp(genome_location);
+    CHECK(fd != -1, "could not create a temporary genome\n");
+    FILE* genome = fdopen(fd, "w");
+    uint32_t contig_lengths[3] = {5000, 3200, 600};
+    for(uint32_t i=0; i<3; ++i){
+        fprintf(genome, ">contig%u\n", i+1);
+        for(uint32_t j=0; j<contig_lengths[i]; ++j) fputc("ACGT"[rand() % 4], genome);
+        fputc('\n', genome);
+    }
+    fclose(genome);
+
+    strainr_engine engines[2] = {STRAINR_HASHTABLE, STRAINR_SORT};
+    for(uint32_t i=0; i<2; ++i){
+        test_in_memory(engines[i]);
+        test_genome(engines[i], genome_location);
+    }
+    unlink(genome_location);
+    test_mask();
+    printf("libstrainr API checks passed\n");
+    return EXIT_SUCCESS;
+}
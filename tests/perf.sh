@@ -0,0 +1,235 @@
+#! /bin/bash
+
+# performance regression harness, run from src with 'make perf' (or 'make perf-baseline' to record a new baseline)
+# synthetic communities are generated offline at several scales, split with subcontig and counted with hashcounter, and the
+# wall time, CPU time, peak RSS, and files written by each are compared against perf_baseline.tsv
+# settings can be changed through the environment, the baseline only applies to runs with the settings it was recorded with:
+#   PERF_SCALES          genomes per community [Default = "10 100 1000"]
+#   PERF_GENOME_LENGTH   bases per genome, spread over four contigs of which two are short enough to be excluded [Default = 50000]
+#   PERF_SHARED          fraction of every genome made of blocks shared with other genomes of the community [Default = 0.1]
+#   PERF_THREADS         threads given to hashcounter [Default = 1]
+#   PERF_KMER_SIZE       k-mer size given to hashcounter, PreProcessR uses twice the read size plus one [Default = 301]
+#   PERF_REPEATS         runs of each tool, the fastest times and largest peak RSS are kept [Default = 3]
+# a run fails when a measurement exceeds its baseline by more than a relative tolerance plus an absolute slack:
+#   PERF_TIME_TOLERANCE  0.25, PERF_TIME_SLACK 1 (seconds) for wall and CPU time
+#   PERF_RSS_TOLERANCE   0.10, PERF_RSS_SLACK 8 (MiB) for peak RSS
+#   PERF_OUTPUT_TOLERANCE 0.01 for bytes written, the number of files written has to match exactly
+
+set -e
+
+scales=${PERF_SCALES:-"10 100 1000"}
+genome_length=${PERF_GENOME_LENGTH:-50000}
+shared=${PERF_SHARED:-0.1}
+threads=${PERF_THREADS:-1}
+kmer_size=${PERF_KMER_SIZE:-301}
+repeats=${PERF_REPEATS:-3}
+time_tolerance=${PERF_TIME_TOLERANCE:-0.25}
+time_slack=${PERF_TIME_SLACK:-1}
+rss_tolerance=${PERF_RSS_TOLERANCE:-0.10}
+rss_slack=${PERF_RSS_SLACK:-8}
+output_tolerance=${PERF_OUTPUT_TOLERANCE:-0.01}
+
+baseline=../tests/perf_baseline.tsv
+settings="genome_length=$genome_length shared=$shared threads=$threads kmer_size=$kmer_size"
+update=false
+if [ "$1" = "--update" ]; then
+  update=true
+fi
+
+if [ ! -d /proc/self ]; then
+  echo "Error: peak RSS is read from /proc, which this system does not have"
+  exit 1
+fi
+
+work=$(mktemp -d)
+trap 'exec 9>&-; rm -rf "$work"' EXIT
+# waiting on a fifo nobody writes to sleeps without starting a process, which would count towards the measured CPU time
+mkfifo "$work"/tick
+exec 9<> "$work"/tick
+
+# generate_community dir genomes: write genomes g0001.fasta... with fixed contig lengths and random sequence
+# sequence comes in blocks of 34 lines of 60 bases, each block is taken from a pool shared by the community with probability
+# PERF_SHARED and is new otherwise, so the fraction of shared sequence is controlled while file sizes do not depend on the
+# random numbers awk produces
+generate_community() {
+  mkdir -p "$1"
+  awk -v dir="$1" -v genomes="$2" -v length_bases="$genome_length" -v shared="$shared" '
+    function random_line(    line, i) {
+      line = ""
+      for (i = 0; i < 10; ++i) line = line hexamer[int(rand() * 4096)]
+      return line
+    }
+    BEGIN {
+      srand(20240706)
+      split("A C G T", base, " ")
+      for (i = 0; i < 4096; ++i) {
+        hexamer[i] = ""
+        x = i
+        for (j = 0; j < 6; ++j) {
+          hexamer[i] = hexamer[i] base[x % 4 + 1]
+          x = int(x / 4)
+        }
+      }
+      block_lines = 34
+      pool_blocks = 50
+      for (i = 0; i < pool_blocks * block_lines; ++i) pool[i] = random_line()
+      # contigs take 50, 30, 15 and 5 percent of the genome, the lengths vary by genome so N50s differ
+      split("0.5 0.3 0.15 0.05", share, " ")
+      total_lines = int(length_bases / 60)
+      for (g = 1; g <= genomes; ++g) {
+        file = sprintf("%s/g%04d.fasta", dir, g)
+        scale = 1 + (g % 5) / 10
+        for (c = 1; c <= 4; ++c) {
+          printf ">g%04d_contig%d synthetic contig\n", g, c > file
+          lines = int(total_lines * share[c] * scale)
+          for (l = 0; l < lines; ++l) {
+            if (l % block_lines == 0) from = rand() < shared ? int(rand() * pool_blocks) * block_lines : -1
+            print (from < 0 ? random_line() : pool[from + l % block_lines]) > file
+          }
+        }
+        close(file)
+      }
+    }'
+}
+
+# measure name command...: run a command with its output in name.log and print its wall seconds, CPU seconds, and peak RSS
+# in MiB
+measure() {
+  local name="$1"
+  shift
+  local start
+  start=$(date +%s.%N)
+  times > "$work"/times.before
+  "$@" > "$work"/"$name".log 2>&1 &
+  local pid=$!
+  local peak=0
+  local state=""
+  local key value unit
+  while [ "$state" != "Z" ] && kill -0 "$pid" 2> /dev/null; do
+    while read -r key value unit; do
+      case "$key" in
+        State:) state="$value" ;;
+        VmHWM:) peak="$value" ;;
+      esac
+    done 2> /dev/null < /proc/"$pid"/status || true
+    read -t 0.02 -u 9 || true
+  done
+  if ! wait "$pid"; then
+    echo "Error: $name failed, its output was:" >&2
+    cat "$work"/"$name".log >&2
+    exit 1
+  fi
+  times > "$work"/times.after
+  local end
+  end=$(date +%s.%N)
+  # the second line of times holds the user and system time of finished children
+  awk -v start="$start" -v end="$end" -v peak="$peak" '
+    function seconds(t) {sub(/s$/, "", t); split(t, part, "m"); return part[1] * 60 + part[2]}
+    FNR == 2 {cpu += (FILENAME ~ /after$/ ? 1 : -1) * (seconds($1) + seconds($2))}
+    END {printf "%.2f\t%.2f\t%.1f\n", end - start, cpu, peak / 1024}' "$work"/times.before "$work"/times.after
+}
+
+# fastest file: append the lowest wall and CPU time and the highest peak RSS of the runs in file to the current row
+# the fastest run is the one least disturbed by whatever else the machine was doing
+fastest() {
+  row="$row\t$(awk -F '\t' 'NR == 1 || $1 < wall {wall = $1} NR == 1 || $2 < cpu {cpu = $2} $3 > peak {peak = $3}
+    END {printf "%.2f\t%.2f\t%.1f", wall, cpu, peak}' "$1")"
+}
+
+# written path...: append the number of files and bytes under the given paths to the current row
+written() {
+  row="$row\t$(find "$@" -type f | wc -l)\t$(find "$@" -type f -printf '%s\n' | awk '{bytes += $1} END {print bytes + 0}')"
+}
+
+# show file: print a tsv with its columns aligned
+show() {
+  awk -F '\t' 'NR == FNR {for (i = 1; i <= NF; ++i) if (length($i) > width[i]) width[i] = length($i); next}
+    {for (i = 1; i <= NF; ++i) printf("%-" width[i] + 2 "s", $i); printf "\n"}' "$1" "$1"
+}
+
+results="$work"/results.tsv
+printf "Genomes\tTool\tWall_s\tCPU_s\tPeakRSS_MiB\tFiles\tBytes\n" > "$results"
+for genomes in $scales; do
+  community="$work"/community_"$genomes"
+  printf "Generating %s genomes\n" "$genomes"
+  generate_community "$community"/genomes "$genomes"
+
+  printf "Running subcontig on %s genomes\n" "$genomes"
+  : > "$work"/runs
+  for run in $(seq "$repeats"); do
+    rm -rf "$community"/Subcontigs "$community"/excludedSubcontigs
+    measure subcontig_"$genomes" ../src/subcontig -i "$community"/genomes -o "$community" >> "$work"/runs
+  done
+  row="$genomes\tsubcontig"
+  fastest "$work"/runs
+  written "$community"/Subcontigs "$community"/excludedSubcontigs
+  printf "$row\n" >> "$results"
+
+  printf "Running hashcounter on %s genomes\n" "$genomes"
+  : > "$work"/runs
+  for run in $(seq "$repeats"); do
+    rm -rf "$community"/kmers
+    mkdir "$community"/kmers
+    measure hashcounter_"$genomes" ../src/hashcounter -s "$community"/Subcontigs -e "$community"/excludedSubcontigs \
+      -k "$kmer_size" -t "$threads" -o "$community"/kmers >> "$work"/runs
+  done
+  row="$genomes\thashcounter"
+  fastest "$work"/runs
+  written "$community"/kmers
+  printf "$row\n" >> "$results"
+  rm -rf "$community"
+done
+
+if [ "$update" = true ]; then
+  { printf "#%s\n" "$settings"; cat "$results"; } > "$baseline"
+  show "$results"
+  printf "Baseline written to %s\n" "$baseline"
+  exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+  show "$results"
+  echo "Error: there is no baseline to compare against, record one with 'make perf-baseline'"
+  exit 1
+fi
+if [ "$(head -n 1 "$baseline")" != "#$settings" ]; then
+  show "$results"
+  echo "Error: the baseline was recorded with $(head -n 1 "$baseline" | cut -c 2-), this run used $settings"
+  exit 1
+fi
+
+# compare every measurement with the baseline row of the same scale and tool, improvements never fail
+awk -F '\t' -v time_tolerance="$time_tolerance" -v time_slack="$time_slack" -v rss_tolerance="$rss_tolerance" \
+  -v rss_slack="$rss_slack" -v output_tolerance="$output_tolerance" '
+  # outputs are checked both ways, a change in what is written is a change in behaviour rather than speed
+  function check(metric, expected, measured, tolerance, slack, both_ways,    limit, status) {
+    limit = expected * (1 + tolerance) + slack
+    status = measured > limit ? "REGRESSED" : "ok"
+    if (both_ways && (measured > limit || measured < expected * (1 - tolerance) - slack)) status = "CHANGED"
+    if (status != "ok") ++regressions
+    printf "%s\t%s\t%s\t%s\t%s\t%+.1f%%\t%s\n", $1, $2, metric, expected, measured,
+      expected == 0 ? 0 : (measured - expected) * 100 / expected, status
+  }
+  FNR == 1 {next}
+  NR == FNR {for (i = 3; i <= NF; ++i) expected[$1 "\t" $2, i] = $i; next}
+  {
+    if (!(($1 "\t" $2, 3) in expected)) {
+      printf "%s\t%s\tall\t-\t-\t-\tNO BASELINE\n", $1, $2
+      ++regressions
+      next
+    }
+    check("Wall_s", expected[$1 "\t" $2, 3], $3, time_tolerance, time_slack, 0)
+    check("CPU_s", expected[$1 "\t" $2, 4], $4, time_tolerance, time_slack, 0)
+    check("PeakRSS_MiB", expected[$1 "\t" $2, 5], $5, rss_tolerance, rss_slack, 0)
+    check("Files", expected[$1 "\t" $2, 6], $6, 0, 0, 1)
+    check("Bytes", expected[$1 "\t" $2, 7], $7, output_tolerance, 0, 1)
+  }
+  END {exit regressions > 0}' <(grep -v '^#' "$baseline") "$results" > "$work"/comparison.tsv && passed=true || passed=false
+
+{ printf "Genomes\tTool\tMetric\tBaseline\tCurrent\tChange\tStatus\n"; cat "$work"/comparison.tsv; } > "$work"/report.tsv
+show "$work"/report.tsv
+if [ "$passed" = false ]; then
+  printf "Performance regressed against %s\n" "$baseline"
+  exit 1
+fi
+printf "Performance within tolerance of %s\n" "$baseline"
@@ -3,6 +3,9 @@
 set -e
 
 printf "Starting testing\n"
+# libstrainr testing, its C API against a brute force count of unique k-mers and the unique regions mask against the positions
+# it was written from
+../src/libstrainr_test
 for test in ../tests/genomes/*/; do
   test_name=$(sed -E 's|.*/(.+)/$|\1|' <(echo $test))
   printf "\nTesting %s case\nSubcontig:\n" $test_name
@@ -14,11 +17,136 @@ for test in ../tests/genomes/*/; do
   diff ../tests/Subcontigs ../tests/expected_output/Subcontigs_"$test_name"
   # hashcounter testing
   printf "Hashcounter:\n"
-  ../src/hashcounter -s ../tests/Subcontigs -e ../tests/excludedSubcontigs -o ../tests \
-    -k 301 -n $(printf "%s+%s\n" $(ls -l ../tests/Subcontigs | wc -l) $(ls -l ../tests/excludedSubcontigs | wc -l) | bc)
+  ../src/hashcounter -s ../tests/Subcontigs -e ../tests/excludedSubcontigs -o ../tests -k 301
   diff <(sort ../tests/KmerContent.report) <(sort ../tests/expected_output/KmerContent_"$test_name".report)
+  # the same k-mers are counted when resizing the table a chunk at a time between subcontigs, by the sort engine without a
+  # hashtable, and from a k-mer library, whose first run hashes every genome into it and second only merges the sets it kept,
+  # and the deprecated -n is still accepted and ignored
+  for options in "-r incremental -t 3" "-a sort -t 2" "-l ../tests/KmerLibrary" "-l ../tests/KmerLibrary" "-n 1"; do
+    mkdir ../tests/KmerCounting
+    ../src/hashcounter -s ../tests/Subcontigs -e ../tests/excludedSubcontigs -o ../tests/KmerCounting -k 301 $options
+    diff <(sort ../tests/KmerCounting/KmerContent.report) <(sort ../tests/expected_output/KmerContent_"$test_name".report)
+    rm -r ../tests/KmerCounting
+  done
+  rm -r ../tests/KmerLibrary
+  # unique regions, with either engine the BED intervals of a subcontig cover as many k-mer starts as it has unique k-mers
+  for options in "" "-a sort"; do
+    mkdir ../tests/UniqueRegions
+    ../src/hashcounter -s ../tests/Subcontigs -e ../tests/excludedSubcontigs -o ../tests/UniqueRegions -k 301 -P $options
+    diff <(awk -F '\t' '{unique[$1] += $3 - $2} END {for (subcontig in unique) print subcontig "\t" unique[subcontig]}' ../tests/UniqueRegions/UniqueRegions.bed | sort) \
+      <(awk -F '\t' 'NR > 1 && $6 > 0 {print $1 "\t" $6}' ../tests/expected_output/KmerContent_"$test_name".report | sort)
+    rm -r ../tests/UniqueRegions
+  done
+  # readcounter testing, a pair of reads spanning a whole subcontig is assigned to it exactly when it has a unique k-mer
+  printf "Readcounter:\n"
+  mkdir ../tests/KmerIndex
+  ../src/hashcounter -s ../tests/Subcontigs -e ../tests/excludedSubcontigs -o ../tests/KmerIndex -k 301 -u
+  awk 'function emit() {qual = seq; gsub(/./, "I", qual); printf "@%s\n%s\n+\n%s\n", name, seq, qual; seq = ""}
+    /^>/ {if (seq != "") emit(); name = substr($0, 2); next} {seq = seq $0} END {emit()}' ../tests/Subcontigs/*.subcontig > ../tests/reads.fastq
+  ../src/readcounter -1 ../tests/reads.fastq -2 ../tests/reads.fastq -i ../tests/KmerIndex/UniqueKmers.index -o ../tests/reads.rpkm
+  diff <(awk -F '\t' '!/^#/ {print $1 "\t" $7}' ../tests/reads.rpkm | sort) \
+    <(awk -F '\t' 'NR > 1 {print $1 "\t" ($6 > 0)}' ../tests/expected_output/KmerContent_"$test_name".report | sort)
+  # the reference k-mer filter keeps every pair of a soft-masked reference, as BBMap maps to lowercase bases too
+  mkdir ../tests/SoftMasked
+  for subcontig in ../tests/Subcontigs/*.subcontig; do
+    awk '/^>/ {print; next} {print tolower($0)}' $subcontig > ../tests/SoftMasked/$(basename $subcontig)
+  done
+  ../src/hashcounter -s ../tests/SoftMasked -e ../tests/excludedSubcontigs -o ../tests/KmerIndex -k 301 -f
+  ../src/readcounter -1 ../tests/reads.fastq -2 ../tests/reads.fastq -F ../tests/KmerIndex/ReferenceKmers.filter -f ../tests/kept.fastq
+  [ $(wc -l < ../tests/kept.fastq) -eq $((2 * $(wc -l < ../tests/reads.fastq))) ]
+  # strain sketches of the soft-masked reference hold the same hashes, so screening the reads finds the same strains
+  for reference in Subcontigs SoftMasked; do
+    cat ../tests/$reference/*.subcontig > ../tests/$reference.fasta
+    ../src/strainscreen -r ../tests/$reference.fasta -o ../tests/$reference.sketch
+    ../src/strainscreen -i ../tests/$reference.sketch -1 ../tests/reads.fastq -o ../tests/$reference.screen
+  done
+  diff ../tests/Subcontigs.screen ../tests/SoftMasked.screen
+  rm ../tests/Subcontigs.fasta ../tests/Subcontigs.sketch ../tests/Subcontigs.screen
+  rm ../tests/SoftMasked.fasta ../tests/SoftMasked.sketch ../tests/SoftMasked.screen
+  rm -r ../tests/KmerIndex ../tests/SoftMasked ../tests/reads.fastq ../tests/reads.rpkm ../tests/kept.fastq
   rm -r ../tests/excludedSubcontigs ../tests/Subcontigs
   rm  ../tests/KmerContent.report
 done
 
+# strainboot testing, its point estimates are those of Plot.R and its intervals do not depend on the number of threads
+printf "\nTesting bootstrap\n"
+../src/strainboot -i ../tests/expected_output/testing_comprehensive.abundances -o ../tests/abundance_ci.tsv -b 200 -t 1
+../src/strainboot -i ../tests/expected_output/testing_comprehensive.abundances -o ../tests/abundance_ci_threads.tsv -b 200 -t 3
+diff ../tests/abundance_ci.tsv ../tests/abundance_ci_threads.tsv
+diff <(awk -F '\t' '{printf "%s\t%.10g\t%.10g\n", $1, $2, $5}' ../tests/abundance_ci.tsv) \
+  <(awk -F '\t' '{printf "%s\t%.10g\t%.10g\n", $1, $2, $8}' ../tests/expected_output/abundance_summary_comprehensive.tsv)
+rm ../tests/abundance_ci.tsv ../tests/abundance_ci_threads.tsv
+
+# reads_1.fastq.gz and reads_2.fastq.gz from the subcontigs of a database: a pair every 2000 bases of every subcontig and, when
+# noisy, every third with a base changed and as many pairs of random bases
+simulate_reads() {
+  awk -v noisy="$1" -v forward=../tests/reads_1.fastq -v reverse=../tests/reads_2.fastq '
+    function complement(s,  r, i, c) {r = ""; for (i = length(s); i > 0; --i) {c = substr(s, i, 1); r = r (c == "A" ? "T" : c == "C" ? "G" : c == "G" ? "C" : "A")}; return r}
+    function pair(f, r) {++n; printf "@pair%d/1\n%s\n+\n%s\n", n, f, quality > forward; printf "@pair%d/2\n%s\n+\n%s\n", n, r, quality > reverse}
+    function emit(  p, f) {
+      for (p = 1; p + 400 <= length(seq); p += 2000) {
+        f = substr(seq, p, 150)
+        if (noisy && n % 3 == 0) f = substr(f, 1, 74) (substr(f, 75, 1) == "A" ? "C" : "A") substr(f, 76)
+        pair(f, complement(substr(seq, p + 250, 150)))
+      }
+      seq = ""
+    }
+    BEGIN {srand(1); quality = sprintf("%150s", ""); gsub(/ /, "I", quality)}
+    /^>/ {if (seq != "") emit(); next} {seq = seq $0}
+    END {
+      emit()
+      for (i = noisy ? n : 0; i > 0; --i) {
+        f = ""; r = ""
+        for (j = 0; j < 150; ++j) {f = f substr("ACGT", int(rand() * 4) + 1, 1); r = r substr("ACGT", int(rand() * 4) + 1, 1)}
+        pair(f, r)
+      }
+    }' "${@:2}"
+  gzip ../tests/reads_1.fastq ../tests/reads_2.fastq
+}
+
+# prefilter testing, the pairs it drops are pairs BBMap can not map, so the .rpkm is the same as without it
+printf "\nTesting prefilter\n"
+# StrainR and PreProcessR print their errors and still exit 0, so without the tools both runs would compare empty
+if command -v bbmap.sh > /dev/null && command -v fastp > /dev/null && command -v samtools > /dev/null && command -v Rscript > /dev/null; then
+  export PATH="$(cd ../src && pwd):$PATH"
+  PreProcessR -i ../tests/genomes/multiple_complete -o ../tests/StrainR2DB -x -t 2
+  simulate_reads 1 ../tests/StrainR2DB/Subcontigs/*.subcontig
+  StrainR -1 ../tests/reads_1.fastq.gz -2 ../tests/reads_2.fastq.gz -r ../tests/StrainR2DB -o ../tests/unfiltered -t 2 -m 4
+  StrainR -1 ../tests/reads_1.fastq.gz -2 ../tests/reads_2.fastq.gz -r ../tests/StrainR2DB -o ../tests/prefiltered -t 2 -m 4 --prefilter
+  # both runs must have written counts, and the .rpkm names the trimmed reads, which are in each run's own directory
+  grep -q -v '^#' ../tests/unfiltered/sample.rpkm
+  grep -q -v '^#' ../tests/prefiltered/sample.rpkm
+  diff <(grep -v '^#File' ../tests/unfiltered/sample.rpkm) <(grep -v '^#File' ../tests/prefiltered/sample.rpkm)
+  rm -r ../tests/StrainR2DB ../tests/unfiltered ../tests/prefiltered ../tests/reads_1.fastq.gz ../tests/reads_2.fastq.gz
+
+  # sharding testing, strains B and C share a stretch of bases with strain A, placed largest first B and C are mapped together
+  # and A on its own, a pair from that stretch is tossed as ambiguous as it is without shards, so the .rpkm is the same
+  printf "\nTesting shards\n"
+  mkdir ../tests/SharedGenomes
+  awk -v dir=../tests/SharedGenomes '
+    function bases(n,  s) {s = ""; while (n-- > 0) s = s substr("ACGT", int(rand() * 4) + 1, 1); return s}
+    function genome(name, seq,  p) {for (p = 1; p <= length(seq); p += 80) print substr(seq, p, 80) > (dir "/" name ".fasta")}
+    BEGIN {
+      srand(2)
+      shared = bases(3000)
+      print ">A" > (dir "/A.fasta"); genome("A", bases(20000) shared bases(20000))
+      print ">B" > (dir "/B.fasta"); genome("B", bases(6000) shared bases(6000))
+      print ">C" > (dir "/C.fasta"); genome("C", bases(5000) shared bases(5000))
+    }'
+  PreProcessR -i ../tests/SharedGenomes -o ../tests/Unsharded -e 1000 -t 2
+  PreProcessR -i ../tests/SharedGenomes -o ../tests/Sharded -e 1000 -t 2 -n 2
+  [ $(awk -F '\t' 'NR > 1 {print $2}' ../tests/Sharded/Shards/shards.tsv | sort -u | wc -l) -eq 2 ]
+  simulate_reads 0 ../tests/Unsharded/Subcontigs/*.subcontig
+  StrainR -1 ../tests/reads_1.fastq.gz -2 ../tests/reads_2.fastq.gz -r ../tests/Unsharded -o ../tests/unsharded -t 2 -m 4
+  StrainR -1 ../tests/reads_1.fastq.gz -2 ../tests/reads_2.fastq.gz -r ../tests/Sharded -o ../tests/sharded -t 2 -m 4
+  # every pair maps perfectly, so the pairs from the shared stretch are the reads left unmapped
+  [ $(awk -F '\t' '$1 == "#Mapped" {print $2}' ../tests/unsharded/sample.rpkm) -lt \
+    $(awk -F '\t' '$1 == "#Reads" {print $2}' ../tests/unsharded/sample.rpkm) ]
+  diff <(grep -v '^#File' ../tests/unsharded/sample.rpkm | sort) <(grep -v '^#File' ../tests/sharded/sample.rpkm | sort)
+  rm -r ../tests/SharedGenomes ../tests/Unsharded ../tests/Sharded ../tests/unsharded ../tests/sharded
+  rm ../tests/reads_1.fastq.gz ../tests/reads_2.fastq.gz
+else
+  printf "bbmap.sh, fastp, samtools, or Rscript not found, skipping the prefilter and shard tests\n"
+fi
+
 printf "Testing successful\n"
\ No newline at end of file